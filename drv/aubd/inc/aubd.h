@@ -0,0 +1,99 @@
+/**
+ * @file aubd.h
+ * @brief AXIS USB Bridge Daemon Client Header
+ * @author Dmitry Matyunin (https://github.com/mcjtag)
+ * @date 19.10.2026
+ * @copyright
+ *  Copyright (c) 2021 Dmitry Matyunin
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef AUBD_H_
+#define AUBD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "aub.h"
+
+typedef void* aubd_client_t;
+
+struct aubd_info {
+	unsigned long long ring_size;	/* IN ring size, bytes */
+	unsigned long long position;	/* IN stream offset of next unread byte */
+	unsigned long long overruns;	/* Times reader fell more than ring size behind and skipped ahead */
+	unsigned int width_in;			/* IN element size, bytes (0 - channel disabled) */
+	unsigned int width_out;			/* OUT element size, bytes (0 - channel disabled) */
+};
+
+/**
+ * @brief Attach to running aubd as IN reader (starts at live position) and OUT writer
+ * @param cli Pointer to client handle
+ * @param name Shared memory name given to aubd (NULL - "aubd")
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int aubd_connect(aubd_client_t *cli, const char *name);
+
+/**
+ * @brief Detach from aubd
+ * @param cli Client handle
+ */
+void aubd_disconnect(aubd_client_t cli);
+
+/**
+ * @brief Map unread IN data in shared ring without copying
+ * @param cli Client handle
+ * @param data Pointer to data pointer (contiguous even across ring wrap)
+ * @param timeout Timeout, ms (0 - do not wait, negative - infinite)
+ * @return error_code (see <enum AUB_ERROR>) or number of bytes at data, AUB_ERROR_OVERFLOW if reader was overrun and skipped ahead
+ */
+int aubd_peek(aubd_client_t cli, void **data, int timeout);
+
+/**
+ * @brief Release data obtained by aubd_peek()
+ * @param cli Client handle
+ * @param length Number of bytes
+ * @return error_code (see <enum AUB_ERROR>), AUB_ERROR_OVERFLOW if data was overwritten while it was held
+ */
+int aubd_consume(aubd_client_t cli, int length);
+
+/**
+ * @brief Queue data to OUT channel (calls from all clients are serialized)
+ * @param cli Client handle
+ * @param data Pointer to data
+ * @param length Number of elements
+ * @param timeout Timeout, ms (negative - infinite)
+ * @return error_code (see <enum AUB_ERROR>) or number of elements queued
+ */
+int aubd_send(aubd_client_t cli, const void *data, int length, int timeout);
+
+/**
+ * @brief Get client information
+ * @param cli Client handle
+ * @param info Pointer to information structure
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int aubd_get_info(aubd_client_t cli, struct aubd_info *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AUBD_H_ */
@@ -0,0 +1,354 @@
+/**
+ * @file aubd.c
+ * @brief AXIS USB Bridge Daemon: one device shared by several processes
+ * @author Dmitry Matyunin (https://github.com/mcjtag)
+ * @date 19.10.2026
+ * @copyright
+ *  Copyright (c) 2021 Dmitry Matyunin
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <grp.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "aubd_shm.h"
+#include "aub.h"
+
+#define MB				(1024ULL * 1024ULL)
+#define RING_SIZE		64			/* MB, default */
+#define OUT_RING_SIZE	(4 * MB)
+#define GET_TIMEOUT		100			/* ms */
+
+static volatile sig_atomic_t stop;
+static aub_device_t dev;
+static struct aubd_shm *shm;
+static unsigned char *in_ring;
+static unsigned char *out_ring;
+
+static void sig_handler(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static int pid_alive(int32_t pid)
+{
+	return (kill(pid, 0) == 0) || (errno == EPERM);
+}
+
+/* Create shared object, replacing one left by a daemon that is gone */
+static int shm_create(const char *path, mode_t mode)
+{
+	struct aubd_shm *old;
+	int fd;
+
+	fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, mode);
+	if ((fd >= 0) || (errno != EEXIST))
+		return fd;
+	fd = shm_open(path, O_RDWR, 0);
+	if (fd < 0)
+		return fd;
+	old = (struct aubd_shm *)mmap(NULL, sizeof(struct aubd_shm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (old != MAP_FAILED) {
+		int busy = (old->magic == AUBD_SHM_MAGIC) && !(old->flags & AUBD_FLAG_CLOSED) && pid_alive(old->pid);
+		munmap(old, sizeof(struct aubd_shm));
+		if (busy) {
+			errno = EBUSY;
+			return -1;
+		}
+	}
+	shm_unlink(path);
+	return shm_open(path, O_RDWR | O_CREAT | O_EXCL, mode);
+}
+
+/* Group name or number, -1 if unknown */
+static gid_t group_id(const char *group)
+{
+	struct group *gr;
+	char *end;
+	unsigned long id;
+
+	gr = getgrnam(group);
+	if (gr)
+		return gr->gr_gid;
+	id = strtoul(group, &end, 10);
+	if (!*group || *end)
+		return (gid_t)-1;
+	return (gid_t)id;
+}
+
+static void shm_sync_init(void)
+{
+	pthread_mutexattr_t ma;
+	pthread_condattr_t ca;
+
+	pthread_mutexattr_init(&ma);
+	pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+	pthread_condattr_init(&ca);
+	pthread_condattr_setpshared(&ca, PTHREAD_PROCESS_SHARED);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+	pthread_mutex_init(&shm->in_lock, &ma);
+	pthread_mutex_init(&shm->out_writer, &ma);
+	pthread_mutex_init(&shm->out_lock, &ma);
+	pthread_cond_init(&shm->in_cond, &ca);
+	pthread_cond_init(&shm->out_data, &ca);
+	pthread_cond_init(&shm->out_space, &ca);
+	pthread_condattr_destroy(&ca);
+	pthread_mutexattr_destroy(&ma);
+}
+
+/* Blocking mode: wait until the slowest live reader leaves room for length bytes */
+static void wait_readers(uint64_t length)
+{
+	uint64_t head = shm->in_head, tail;
+
+	while (!stop) {
+		tail = head;
+		shm_lock(&shm->in_lock);
+		for (int i = 0; i < AUBD_MAX_CLIENTS; i++) {
+			if (!shm->client[i].pid)
+				continue;
+			if (!pid_alive(shm->client[i].pid)) {
+				shm_store(&shm->client[i].pid, 0);
+				continue;
+			}
+			if (shm_load(&shm->client[i].cursor) < tail)
+				tail = shm_load(&shm->client[i].cursor);
+		}
+		shm_unlock(&shm->in_lock);
+		if (head + length - tail <= shm->in_size)
+			return;
+		usleep(100);
+	}
+}
+
+static void *out_thread(void *arg)
+{
+	uint64_t tail, n;
+	int res;
+
+	(void)arg;
+	shm_lock(&shm->out_lock);
+	while (!stop) {
+		tail = shm->out_tail;
+		if (shm->out_head == tail) {
+			shm_wait(&shm->out_data, &shm->out_lock, AUBD_WAIT_SLICE);
+			continue;
+		}
+		n = shm->out_head - tail;
+		if (n > shm->out_size - tail % shm->out_size)
+			n = shm->out_size - tail % shm->out_size;
+		shm_unlock(&shm->out_lock);
+		res = aub_send(dev, out_ring + tail % shm->out_size, (int)(n / shm->width_out));
+		shm_lock(&shm->out_lock);
+		if (res < 0) {
+			fprintf(stderr, "aubd: send error (%d)\n", res);
+			stop = 1;
+			break;
+		}
+		shm_store(&shm->out_tail, tail + (uint64_t)res * shm->width_out);
+		pthread_cond_broadcast(&shm->out_space);
+	}
+	shm_unlock(&shm->out_lock);
+	return NULL;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-s serial] [-n name] [-r ring_MB] [-g group] [-b]\n"
+		   "   -s serial   Device serial number (default - first device)\n"
+		   "   -n name     Shared memory name (default \"%s\")\n"
+		   "   -r ring_MB  IN ring size (default %d)\n"
+		   "   -g group    Share with members of group (default - daemon user only)\n"
+		   "   -b          Block on slowest reader instead of overwriting\n", name, AUBD_SHM_NAME, RING_SIZE);
+}
+
+int main(int argc, char *argv[])
+{
+	struct aub_device_info info;
+	char path[AUBD_SHM_NAME_SIZE];
+	const char *serial = NULL, *name = NULL, *group = NULL;
+	gid_t gid = (gid_t)-1;
+	mode_t mode;
+	uint64_t ring = RING_SIZE * MB, page, header, total;
+	unsigned int width_in, width_out;
+	pthread_t out_tid;
+	void *data;
+	int opt, fd, block = 0, res = -1;
+
+	while ((opt = getopt(argc, argv, "s:n:r:g:bh")) != -1) {
+		switch (opt) {
+		case 's': serial = optarg; break;
+		case 'n': name = optarg; break;
+		case 'r': ring = strtoull(optarg, NULL, 0) * MB; break;
+		case 'g': group = optarg; break;
+		case 'b': block = 1; break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if (ring < MB) {
+		usage(argv[0]);
+		return -1;
+	}
+	if (group) {
+		gid = group_id(group);
+		if (gid == (gid_t)-1) {
+			fprintf(stderr, "aubd: unknown group %s\n", group);
+			return -1;
+		}
+	}
+	/* Shared object carries device data and a writable OUT ring: owner only unless a group is given */
+	mode = group ? 0660 : 0600;
+
+	if (aub_init()) {
+		fprintf(stderr, "aubd: init failed\n");
+		return -1;
+	}
+	if (serial ? aub_open_by_serial(&dev, serial) : aub_open(&dev)) {
+		fprintf(stderr, "aubd: device open error\n");
+		aub_deinit();
+		return -1;
+	}
+	aub_get_device_info(aub_get_device_number(dev), &info);
+	width_in = info.config.chan[AUB_CHAN_IN].enabled ? info.config.chan[AUB_CHAN_IN].width / 8 : 0;
+	width_out = info.config.chan[AUB_CHAN_OUT].enabled ? info.config.chan[AUB_CHAN_OUT].width / 8 : 0;
+
+	page = sysconf(_SC_PAGESIZE);
+	header = (sizeof(struct aubd_shm) + page - 1) / page * page;
+	ring = width_in ? (ring + page - 1) / page * page : 0;
+	total = header + ring + (width_out ? OUT_RING_SIZE : 0);
+
+	shm_path(path, name);
+	fd = shm_create(path, mode);
+	if (fd < 0) {
+		fprintf(stderr, "aubd: %s: %s\n", path, (errno == EBUSY) ? "another daemon is running" : strerror(errno));
+		goto err_open;
+	}
+	/* umask may have cleared group bits, set them explicitly */
+	if ((group && fchown(fd, (uid_t)-1, gid)) || fchmod(fd, mode)) {
+		fprintf(stderr, "aubd: %s: %s\n", path, strerror(errno));
+		goto err_shm;
+	}
+	if (ftruncate(fd, total)) {
+		fprintf(stderr, "aubd: %s: %s\n", path, strerror(errno));
+		goto err_shm;
+	}
+	shm = (struct aubd_shm *)mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED) {
+		shm = NULL;
+		goto err_shm;
+	}
+	memset(shm, 0, sizeof(struct aubd_shm));
+	shm->version = AUBD_SHM_VERSION;
+	shm->in_offset = header;
+	shm->in_size = ring;
+	shm->out_offset = header + ring;
+	shm->out_size = width_out ? OUT_RING_SIZE : 0;
+	shm->width_in = width_in;
+	shm->width_out = width_out;
+	shm->flags = block ? AUBD_FLAG_BLOCK : 0;
+	shm->pid = getpid();
+	shm_sync_init();
+	if (ring) {
+		in_ring = shm_map_ring(fd, header, ring);
+		if (!in_ring)
+			goto err_shm;
+	}
+	out_ring = (unsigned char *)shm + shm->out_offset;
+	shm_store(&shm->magic, AUBD_SHM_MAGIC);
+
+	if (width_in && aub_stream_start(dev, AUB_CHAN_IN, NULL)) {
+		fprintf(stderr, "aubd: stream start error\n");
+		goto err_shm;
+	}
+	if (width_out && pthread_create(&out_tid, NULL, out_thread, NULL)) {
+		fprintf(stderr, "aubd: thread start error\n");
+		goto err_stream;
+	}
+	signal(SIGINT, sig_handler);
+	signal(SIGTERM, sig_handler);
+	printf("aubd: %s, IN ring %llu MB%s, OUT %s\n", path, (unsigned long long)(ring / MB),
+		   block ? " (blocking)" : "", width_out ? "enabled" : "disabled");
+
+	res = 0;
+	while (!stop) {
+		uint64_t head;
+		int len;
+
+		if (!width_in) {
+			usleep(GET_TIMEOUT * 1000);
+			continue;
+		}
+		len = aub_stream_get(dev, &data, GET_TIMEOUT);
+		if (len == AUB_ERROR_TIMEOUT)
+			continue;
+		if (len < 0) {
+			fprintf(stderr, "aubd: stream error (%d)\n", len);
+			res = -1;
+			break;
+		}
+		if (block)
+			wait_readers(len);
+		/* Readers check in_reserve after reading: anything it has passed may be torn */
+		head = shm->in_head;
+		__atomic_store_n(&shm->in_reserve, head + len, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		memcpy(in_ring + head % ring, data, len);
+		aub_stream_put(dev, data);
+		shm_lock(&shm->in_lock);
+		shm_store(&shm->in_head, head + len);
+		pthread_cond_broadcast(&shm->in_cond);
+		shm_unlock(&shm->in_lock);
+	}
+
+	stop = 1;
+	__atomic_or_fetch(&shm->flags, AUBD_FLAG_CLOSED, __ATOMIC_RELEASE);
+	shm_lock(&shm->in_lock);
+	pthread_cond_broadcast(&shm->in_cond);
+	shm_unlock(&shm->in_lock);
+	if (width_out)
+		pthread_join(out_tid, NULL);
+	shm_lock(&shm->out_lock);
+	pthread_cond_broadcast(&shm->out_space);
+	shm_unlock(&shm->out_lock);
+err_stream:
+	if (width_in)
+		aub_stream_stop(dev, AUB_CHAN_IN);
+err_shm:
+	if (shm)
+		__atomic_or_fetch(&shm->flags, AUBD_FLAG_CLOSED, __ATOMIC_RELEASE);
+	if (in_ring)
+		shm_unmap_ring(in_ring, ring);
+	if (shm)
+		munmap(shm, total);
+	shm_unlink(path);
+	close(fd);
+err_open:
+	aub_close(dev);
+	aub_deinit();
+	return res;
+}
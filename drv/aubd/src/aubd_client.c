@@ -0,0 +1,279 @@
+/**
+ * @file aubd_client.c
+ * @brief AXIS USB Bridge Daemon Client
+ * @author Dmitry Matyunin (https://github.com/mcjtag)
+ * @date 19.10.2026
+ * @copyright
+ *  Copyright (c) 2021 Dmitry Matyunin
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "aubd_shm.h"
+#include "aubd.h"
+
+#define PEEK_MAX	(1 << 30)
+
+struct aubd_client {
+	struct aubd_shm *shm;
+	size_t shm_size;
+	unsigned char *in;
+	unsigned char *out;
+	struct aubd_shm_client *slot;
+	uint64_t cursor;
+};
+
+static int pid_alive(int32_t pid);
+static int daemon_alive(struct aubd_shm *shm);
+static void skip_ahead(struct aubd_client *c);
+
+int aubd_connect(aubd_client_t *cli, const char *name)
+{
+	char path[AUBD_SHM_NAME_SIZE];
+	struct aubd_client *c;
+	struct aubd_shm *shm;
+	struct stat st;
+	int fd, res = AUB_ERROR_NOT_READY;
+
+	if (!cli)
+		return AUB_ERROR_INVALID_PARAM;
+	shm_path(path, name);
+	fd = shm_open(path, O_RDWR, 0);
+	if (fd < 0)
+		return AUB_ERROR_NO_DEVICE_FOUND;
+	c = (struct aubd_client *)calloc(1, sizeof(struct aubd_client));
+	if (!c || fstat(fd, &st) || ((size_t)st.st_size < sizeof(struct aubd_shm))) {
+		res = AUB_ERROR_LOWLEVEL;
+		goto err;
+	}
+	c->shm_size = st.st_size;
+	shm = (struct aubd_shm *)mmap(NULL, c->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED) {
+		res = AUB_ERROR_LOWLEVEL;
+		goto err;
+	}
+	c->shm = shm;
+	/* Magic is written last by daemon, header is complete once it matches */
+	if ((shm_load(&shm->magic) != AUBD_SHM_MAGIC) || (shm->version != AUBD_SHM_VERSION) || !daemon_alive(shm))
+		goto err;
+	if (shm->in_size) {
+		c->in = shm_map_ring(fd, shm->in_offset, shm->in_size);
+		if (!c->in) {
+			res = AUB_ERROR_LOWLEVEL;
+			goto err;
+		}
+	}
+	c->out = (unsigned char *)shm + shm->out_offset;
+
+	shm_lock(&shm->in_lock);
+	for (int i = 0; i < AUBD_MAX_CLIENTS; i++) {
+		if (!shm->client[i].pid || !pid_alive(shm->client[i].pid)) {
+			c->slot = &shm->client[i];
+			c->cursor = shm->in_head;
+			c->slot->overruns = 0;
+			shm_store(&c->slot->cursor, c->cursor);
+			shm_store(&c->slot->pid, (int32_t)getpid());
+			break;
+		}
+	}
+	shm_unlock(&shm->in_lock);
+	if (!c->slot) {
+		res = AUB_ERROR_BUSY;
+		goto err;
+	}
+	close(fd);
+	*cli = c;
+	return AUB_SUCCESS;
+
+err:
+	if (c && c->in)
+		shm_unmap_ring(c->in, c->shm->in_size);
+	if (c && c->shm)
+		munmap(c->shm, c->shm_size);
+	free(c);
+	close(fd);
+	return res;
+}
+
+void aubd_disconnect(aubd_client_t cli)
+{
+	struct aubd_client *c = (struct aubd_client *)cli;
+
+	if (!c)
+		return;
+	shm_lock(&c->shm->in_lock);
+	shm_store(&c->slot->pid, 0);
+	shm_unlock(&c->shm->in_lock);
+	if (c->in)
+		shm_unmap_ring(c->in, c->shm->in_size);
+	munmap(c->shm, c->shm_size);
+	free(c);
+}
+
+int aubd_peek(aubd_client_t cli, void **data, int timeout)
+{
+	struct aubd_client *c = (struct aubd_client *)cli;
+	struct aubd_shm *shm;
+	struct timespec ts;
+	uint64_t head, now, deadline = 0;
+
+	if (!c || !data)
+		return AUB_ERROR_INVALID_PARAM;
+	shm = c->shm;
+	if (!c->in)
+		return AUB_ERROR_NOT_READY;
+	if (timeout > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		deadline = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 + timeout;
+	}
+
+	for (;;) {
+		head = shm_load(&shm->in_head);
+		if (shm_load(&shm->in_reserve) - c->cursor > shm->in_size) {
+			skip_ahead(c);
+			return AUB_ERROR_OVERFLOW;
+		}
+		if (head != c->cursor) {
+			*data = c->in + c->cursor % shm->in_size;
+			return (head - c->cursor > PEEK_MAX) ? PEEK_MAX : (int)(head - c->cursor);
+		}
+		if (!daemon_alive(shm))
+			return AUB_ERROR_NO_DEVICE_FOUND;
+		if (timeout == 0)
+			return AUB_ERROR_TIMEOUT;
+		if (timeout > 0) {
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			now = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+			if (now >= deadline)
+				return AUB_ERROR_TIMEOUT;
+		}
+		shm_lock(&shm->in_lock);
+		if (shm->in_head == c->cursor)
+			shm_wait(&shm->in_cond, &shm->in_lock, AUBD_WAIT_SLICE);
+		shm_unlock(&shm->in_lock);
+	}
+}
+
+int aubd_consume(aubd_client_t cli, int length)
+{
+	struct aubd_client *c = (struct aubd_client *)cli;
+	struct aubd_shm *shm;
+
+	if (!c || !c->in)
+		return AUB_ERROR_INVALID_PARAM;
+	shm = c->shm;
+	/* Reads of the held range must complete before the overwrite check */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (shm_load(&shm->in_reserve) - c->cursor > shm->in_size) {
+		skip_ahead(c);
+		return AUB_ERROR_OVERFLOW;
+	}
+	if ((length < 0) || (c->cursor + length > shm_load(&shm->in_head)))
+		return AUB_ERROR_INVALID_PARAM;
+	c->cursor += length;
+	shm_store(&c->slot->cursor, c->cursor);
+	return AUB_SUCCESS;
+}
+
+int aubd_send(aubd_client_t cli, const void *data, int length, int timeout)
+{
+	struct aubd_client *c = (struct aubd_client *)cli;
+	const unsigned char *pdata = (const unsigned char *)data;
+	struct aubd_shm *shm;
+	uint64_t bytes, done = 0, space, n;
+	int waited = 0, res = AUB_SUCCESS;
+
+	if (!c || (length < 0) || (length && !data))
+		return AUB_ERROR_INVALID_PARAM;
+	shm = c->shm;
+	if (!shm->width_out || !shm->out_size)
+		return AUB_ERROR_NOT_READY;
+	bytes = (uint64_t)length * shm->width_out;
+
+	shm_lock(&shm->out_writer);
+	shm_lock(&shm->out_lock);
+	while (done < bytes) {
+		space = shm->out_size - (shm->out_head - shm->out_tail);
+		if (space == 0) {
+			if (!daemon_alive(shm)) {
+				res = AUB_ERROR_NO_DEVICE_FOUND;
+				break;
+			}
+			if ((timeout >= 0) && (waited >= timeout)) {
+				res = AUB_ERROR_TIMEOUT;
+				break;
+			}
+			shm_wait(&shm->out_space, &shm->out_lock, AUBD_WAIT_SLICE);
+			waited += AUBD_WAIT_SLICE;
+			continue;
+		}
+		n = bytes - done;
+		if (n > space)
+			n = space;
+		if (n > shm->out_size - shm->out_head % shm->out_size)
+			n = shm->out_size - shm->out_head % shm->out_size;
+		memcpy(c->out + shm->out_head % shm->out_size, pdata + done, n);
+		shm_store(&shm->out_head, shm->out_head + n);
+		done += n;
+		pthread_cond_signal(&shm->out_data);
+	}
+	shm_unlock(&shm->out_lock);
+	shm_unlock(&shm->out_writer);
+	if (done == 0 && res)
+		return res;
+	return (int)(done / shm->width_out);
+}
+
+int aubd_get_info(aubd_client_t cli, struct aubd_info *info)
+{
+	struct aubd_client *c = (struct aubd_client *)cli;
+
+	if (!c || !info)
+		return AUB_ERROR_INVALID_PARAM;
+	info->ring_size = c->shm->in_size;
+	info->position = c->cursor;
+	info->overruns = c->slot->overruns;
+	info->width_in = c->shm->width_in;
+	info->width_out = c->shm->width_out;
+	return AUB_SUCCESS;
+}
+
+static int pid_alive(int32_t pid)
+{
+	return (kill(pid, 0) == 0) || (errno == EPERM);
+}
+
+static int daemon_alive(struct aubd_shm *shm)
+{
+	return !(shm_load(&shm->flags) & AUBD_FLAG_CLOSED) && pid_alive(shm->pid);
+}
+
+/* Reader was lapped: continue from live position */
+static void skip_ahead(struct aubd_client *c)
+{
+	c->cursor = shm_load(&c->shm->in_head);
+	c->slot->overruns++;
+	shm_store(&c->slot->cursor, c->cursor);
+}
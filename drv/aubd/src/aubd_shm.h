@@ -0,0 +1,146 @@
+/**
+ * @file aubd_shm.h
+ * @brief AXIS USB Bridge Daemon Shared Memory Layout
+ * @author Dmitry Matyunin (https://github.com/mcjtag)
+ * @date 19.10.2026
+ * @copyright
+ *  Copyright (c) 2021 Dmitry Matyunin
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef AUBD_SHM_H_
+#define AUBD_SHM_H_
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#define AUBD_SHM_MAGIC		0x44425541	/* "AUBD" */
+#define AUBD_SHM_VERSION	1
+#define AUBD_SHM_NAME		"aubd"
+#define AUBD_SHM_NAME_SIZE	64
+#define AUBD_MAX_CLIENTS	16
+#define AUBD_WAIT_SLICE		100			/* ms, waits are split to notice a dead peer */
+
+#define shm_load(p)			__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define shm_store(p, v)		__atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+enum AUBD_FLAG {
+	AUBD_FLAG_BLOCK = 1,	/* Daemon waits for slowest reader instead of overwriting */
+	AUBD_FLAG_CLOSED = 2	/* Daemon has exited */
+};
+
+struct aubd_shm_client {
+	uint64_t cursor;		/* IN bytes consumed */
+	uint64_t overruns;
+	int32_t pid;			/* 0 - free slot */
+	uint32_t reserved;
+};
+
+/*
+ * Object layout: header, IN ring (in_offset), OUT ring (out_offset), all page aligned.
+ * IN ring is mapped twice back to back, so any unread range is contiguous.
+ */
+struct aubd_shm {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t in_offset;
+	uint64_t in_size;
+	uint64_t out_offset;
+	uint64_t out_size;
+	uint32_t width_in;
+	uint32_t width_out;
+	uint32_t flags;
+	int32_t pid;				/* Daemon */
+	/* IN: written by daemon only */
+	uint64_t in_reserve;		/* Bytes being written: anything below in_reserve - in_size may be gone */
+	uint64_t in_head;			/* Bytes written */
+	pthread_mutex_t in_lock;
+	pthread_cond_t in_cond;		/* Broadcast on every in_head update */
+	struct aubd_shm_client client[AUBD_MAX_CLIENTS];
+	/* OUT: written by clients, drained by daemon */
+	pthread_mutex_t out_writer;	/* Held by one client for a whole aubd_send() */
+	pthread_mutex_t out_lock;
+	pthread_cond_t out_data;
+	pthread_cond_t out_space;
+	uint64_t out_head;
+	uint64_t out_tail;
+};
+
+static inline void shm_path(char *path, const char *name)
+{
+	snprintf(path, AUBD_SHM_NAME_SIZE, "/%s", name ? name : AUBD_SHM_NAME);
+}
+
+/* Robust mutex: take over state left by a process that died holding it */
+static inline void shm_lock(pthread_mutex_t *m)
+{
+	if (pthread_mutex_lock(m) == EOWNERDEAD)
+		pthread_mutex_consistent(m);
+}
+
+static inline void shm_unlock(pthread_mutex_t *m)
+{
+	pthread_mutex_unlock(m);
+}
+
+/* Returns nonzero on timeout */
+static inline int shm_wait(pthread_cond_t *c, pthread_mutex_t *m, int timeout)
+{
+	struct timespec ts;
+	int res;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += timeout / 1000;
+	ts.tv_nsec += (long)(timeout % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	res = pthread_cond_timedwait(c, m, &ts);
+	if (res == EOWNERDEAD)
+		pthread_mutex_consistent(m);
+	return res == ETIMEDOUT;
+}
+
+static inline unsigned char *shm_map_ring(int fd, uint64_t offset, uint64_t size)
+{
+	unsigned char *base;
+
+	/* Reserve twice the size, then place the same pages in both halves */
+	base = (unsigned char *)mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return NULL;
+	if ((mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset) == MAP_FAILED) ||
+		(mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset) == MAP_FAILED)) {
+		munmap(base, 2 * size);
+		return NULL;
+	}
+	return base;
+}
+
+static inline void shm_unmap_ring(unsigned char *ring, uint64_t size)
+{
+	munmap(ring, 2 * size);
+}
+
+#endif /* AUBD_SHM_H_ */
@@ -56,12 +56,22 @@ int main(void)
 		printf(" > STR.SERIAL:                 %s\n", dev_info.str.serial);
 		printf(" > CFG.SPEED:                  %s\n", dev_info.config.speed ? "high-speed" : "full-speed");
 		printf(" > CFG.MODE:                   %s\n", dev_info.config.mode ? "packet" : "stream");
+		printf(" > CFG.TIMESTAMP:              %s\n", dev_info.config.timestamp ? "yes" : "no");
+		printf(" > CFG.TEST:                   %s\n", dev_info.config.test ? "yes" : "no");
+		printf(" > CFG.MEM:                    %s\n", dev_info.config.mem ? "yes" : "no");
+		printf(" > CFG.REG_BLOCK:              %s\n", dev_info.config.block ? "yes" : "no");
+		printf(" > CFG.FRAME:                  %s\n", dev_info.config.frame ? "yes" : "no");
+		printf(" > CFG.FIFO_FILL:              %s\n", dev_info.config.fill ? "yes" : "no");
+		printf(" > CFG.PACKET_QUEUE:           %s\n", dev_info.config.plq ? "yes" : "no");
+		printf(" > CFG.COMPRESS:               %s\n", dev_info.config.compress ? "yes" : "no");
+		printf(" > CFG.TIMESTAMP_QUEUE:        %s\n", dev_info.config.tsq ? "yes" : "no");
 		printf(" > CFG.CHAN[IN].ENABLED:       %s\n", dev_info.config.chan[AUB_CHAN_IN].enabled ? "yes" : "no");
 		printf(" > CFG.CHAN[IN].WIDTH:         %d\n", dev_info.config.chan[AUB_CHAN_IN].width);
 		printf(" > CFG.CHAN[IN].ENDIANESS:     %s\n", dev_info.config.chan[AUB_CHAN_IN].endianess ? "big-endian" : "little-endian");
 		printf(" > CFG.CHAN[IN].FIFO_ENABLED:  %s\n", dev_info.config.chan[AUB_CHAN_IN].fifo_enabled ? "yes" : "no");
 		printf(" > CFG.CHAN[IN].FIFO_MODE:     %s\n", dev_info.config.chan[AUB_CHAN_IN].fifo_mode ? "packet" : "stream");
 		printf(" > CFG.CHAN[IN].FIFO_DEPTH:    %d\n", dev_info.config.chan[AUB_CHAN_IN].fifo_depth);
+		printf(" > CFG.CHAN[IN].PACKED:        %d\n", dev_info.config.chan[AUB_CHAN_IN].packed);
 		printf(" > CFG.CHAN[OUT].ENABLED:      %s\n", dev_info.config.chan[AUB_CHAN_OUT].enabled ? "yes" : "no");
 		printf(" > CFG.CHAN[OUT].WIDTH:        %d\n", dev_info.config.chan[AUB_CHAN_OUT].width);
 		printf(" > CFG.CHAN[OUT].ENDIANESS:    %s\n", dev_info.config.chan[AUB_CHAN_OUT].endianess ? "big-endian" : "little-endian");
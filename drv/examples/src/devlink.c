@@ -0,0 +1,187 @@
+/**
+ * @file devlink.c
+ * @brief Link Test with Device Generator, Checker and Loopback
+ * @author Dmitry Matyunin (https://github.com/mcjtag)
+ * @date 19.10.2026
+ * @copyright
+ *  Copyright (c) 2021 Dmitry Matyunin
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "aub.h"
+
+#define CHUNK_SIZE		65536
+#define MB				(1024.0 * 1024.0)
+
+static unsigned char tx_data[CHUNK_SIZE];
+static unsigned char rx_data[CHUNK_SIZE];
+
+static aub_device_t dev;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int test_in(double seconds, int pattern)
+{
+	struct aub_verify v;
+	void *data;
+	double start;
+	int res;
+
+	aub_verify_init(&v, pattern);
+	if (aub_stream_start(dev, AUB_CHAN_IN, NULL))
+		return -1;
+	start = now();
+	while (now() - start < seconds) {
+		res = aub_stream_get(dev, &data, 100);
+		if (res == AUB_ERROR_TIMEOUT)
+			continue;
+		if (res < 0)
+			break;
+		aub_verify(&v, data, res);
+		aub_stream_put(dev, data);
+	}
+	aub_stream_stop(dev, AUB_CHAN_IN);
+	printf("IN:  %.1f MB, %.2f MB/s, %llu errors\n", v.bytes / MB, v.bytes / MB / (now() - start), v.errors);
+	return v.errors ? -1 : 0;
+}
+
+static int test_out(double seconds, int pattern, int width_k)
+{
+	struct aub_verify g;
+	unsigned int errors;
+	double start;
+	int res, locked;
+
+	aub_verify_init(&g, pattern);
+	start = now();
+	while (now() - start < seconds) {
+		aub_pattern_fill(&g, tx_data, CHUNK_SIZE);
+		while ((res = aub_try_send(dev, tx_data, CHUNK_SIZE / width_k)) == AUB_ERROR_NOT_READY)
+			aub_handle_events(10);
+		if (res < 0)
+			break;
+	}
+	aub_stream_flush(dev, 1000);
+	aub_stream_stop(dev, AUB_CHAN_OUT);
+	if (aub_test_get_errors(dev, &errors, &locked))
+		return -1;
+	printf("OUT: %.1f MB, %.2f MB/s, %u errors%s\n", g.bytes / MB, g.bytes / MB / (now() - start), errors, locked ? "" : " (checker not locked)");
+	return (errors || !locked) ? -1 : 0;
+}
+
+static int test_loop(double seconds, int pattern, int width_k, int in_width_k)
+{
+	struct aub_verify g, v;
+	unsigned int tx_off = CHUNK_SIZE;
+	double start;
+	int res;
+
+	aub_verify_init(&g, pattern);
+	aub_verify_init(&v, pattern);
+	start = now();
+	while (now() - start < seconds) {
+		if (tx_off == CHUNK_SIZE) {
+			aub_pattern_fill(&g, tx_data, CHUNK_SIZE);
+			tx_off = 0;
+		}
+		res = aub_try_send(dev, tx_data + tx_off, (CHUNK_SIZE - tx_off) / width_k);
+		if (res > 0)
+			tx_off += res * width_k;
+		else if (res != AUB_ERROR_NOT_READY)
+			break;
+		res = aub_try_recv(dev, rx_data, CHUNK_SIZE / in_width_k);
+		if (res > 0)
+			aub_verify(&v, rx_data, res * in_width_k);
+		else if (res != AUB_ERROR_NOT_READY)
+			break;
+		aub_handle_events(1);
+	}
+	aub_stream_stop(dev, AUB_CHAN_OUT);
+	aub_stream_stop(dev, AUB_CHAN_IN);
+	printf("LOOP: sent %.1f MB, received %.1f MB, %.2f MB/s, %llu errors\n",
+		   g.bytes / MB, v.bytes / MB, v.bytes / MB / (now() - start), v.errors);
+	return v.errors ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct aub_device_info dev_info;
+	double seconds = 10.0;
+	int pattern = AUB_PATTERN_PRBS31;
+	int mode, width_k, in_width_k, res = -1;
+
+	if (argc < 2) {
+		printf("Usage: %s in|out|loop [seconds [counter]]\n"
+			   "   in      Device generator -> host verifier\n"
+			   "   out     Host generator -> device checker\n"
+			   "   loop    Host -> device loopback -> host\n", argv[0]);
+		return -1;
+	}
+	if (strcmp(argv[1], "in") == 0 || strcmp(argv[1], "out") == 0) {
+		mode = AUB_TEST_PRBS;
+	} else if (strcmp(argv[1], "loop") == 0) {
+		mode = AUB_TEST_LOOPBACK;
+	} else {
+		printf("Unknown test '%s'\n", argv[1]);
+		return -1;
+	}
+	if (argc > 2)
+		seconds = atof(argv[2]);
+	if (argc > 3)
+		pattern = AUB_PATTERN_COUNTER;
+
+	if (aub_init())
+		return -1;
+
+	if (!aub_open(&dev)) {
+		aub_get_device_info(aub_get_device_number(dev), &dev_info);
+		width_k = dev_info.config.chan[AUB_CHAN_OUT].width / 8;
+		in_width_k = dev_info.config.chan[AUB_CHAN_IN].width / 8;
+		if (!dev_info.config.test) {
+			printf("Device is built without TEST_ENABLE\n");
+		} else if (dev_info.config.mode != AUB_MODE_STREAM || !width_k || !in_width_k) {
+			printf("Link test needs stream mode with both channels enabled\n");
+		} else if (!aub_test_set(dev, mode, pattern)) {
+			if (strcmp(argv[1], "in") == 0)
+				res = test_in(seconds, pattern);
+			else if (strcmp(argv[1], "out") == 0)
+				res = test_out(seconds, pattern, width_k);
+			else
+				res = test_loop(seconds, pattern, width_k, in_width_k);
+			aub_test_set(dev, AUB_TEST_OFF, pattern);
+		}
+		aub_close(dev);
+	} else {
+		printf("Device open error!\n");
+	}
+
+	aub_deinit();
+
+	return res;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file devping.c
+ * @brief Round-Trip Time of Messages in Low-Latency Mode
+ * @author Dmitry Matyunin (https://github.com/mcjtag)
+ * @date 19.10.2026
+ * @copyright
+ *  Copyright (c) 2021 Dmitry Matyunin
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "aub.h"
+
+#define MSG_MAX			65536
+#define RECV_TIMEOUT	100000	/* us */
+
+static unsigned char tx_data[MSG_MAX];
+static unsigned char rx_data[MSG_MAX];
+
+static aub_device_t dev;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Message goes OUT, comes back on IN (device loopback or user logic echoing it with tlast) */
+static int ping(int size, int count, int width_k, double frame_us)
+{
+	struct aub_latency_stats stats;
+	double *rtt, start, sum = 0.0;
+	int res, lost = 0, bad = 0, done = 0;
+
+	rtt = (double *)calloc(count, sizeof(double));
+	if (!rtt)
+		return -1;
+	for (int i = 0; i < count; i++) {
+		for (int k = 0; k < size; k++)
+			tx_data[k] = (unsigned char)(i + k);
+		start = now();
+		res = aub_latency_send(dev, tx_data, size / width_k, -1);
+		if (res < 0)
+			break;
+		res = aub_latency_recv(dev, rx_data, MSG_MAX / width_k, RECV_TIMEOUT);
+		if (res == AUB_ERROR_TIMEOUT) {
+			lost++;
+			/* IN transfer stays submitted: drop a late reply so it is not taken as the next echo */
+			while ((res = aub_latency_recv(dev, rx_data, MSG_MAX / width_k, RECV_TIMEOUT)) >= 0)
+				;
+			if (res != AUB_ERROR_TIMEOUT)
+				break;
+			continue;
+		}
+		if (res < 0)
+			break;
+		rtt[done++] = (now() - start) * 1e6;
+		if ((res * width_k != size) || memcmp(tx_data, rx_data, size))
+			bad++;
+	}
+	if (res < 0 && res != AUB_ERROR_TIMEOUT) {
+		printf("Transfer error (%d)\n", res);
+		free(rtt);
+		return -1;
+	}
+
+	/* Completed round trips only */
+	if (done) {
+		for (int i = 0; i < done; i++)
+			sum += rtt[i];
+		qsort(rtt, done, sizeof(double), cmp_double);
+		printf("RTT, us:  min %.1f  median %.1f  p99 %.1f  max %.1f  mean %.1f\n",
+			   rtt[0], rtt[done / 2], rtt[done - 1 - done / 100], rtt[done - 1], sum / done);
+		printf("RTT, microframes:  min %.2f  median %.2f  p99 %.2f\n",
+			   rtt[0] / frame_us, rtt[done / 2] / frame_us, rtt[done - 1 - done / 100] / frame_us);
+	}
+	if (!aub_latency_get_stats(dev, &stats))
+		printf("Messages %d, lost %d, corrupted %d, buffers %slocked, event thread %s\n", count, lost, bad,
+			   stats.locked ? "" : "not ", stats.realtime ? "SCHED_FIFO" : "normal");
+	free(rtt);
+	return (lost || bad) ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct aub_device_info dev_info;
+	struct aub_latency_config cfg;
+	int size = 64, count = 10000;
+	int width_k, in_width_k, loopback, res = -1;
+
+	if ((argc > 1) && (strcmp(argv[1], "-h") == 0)) {
+		printf("Usage: %s [size [count [thread [busy [priority [cpu_mask]]]]]]\n"
+			   "   size        Message bytes (default 64)\n"
+			   "   count       Number of round trips (default 10000)\n"
+			   "   thread      Event thread (0 - caller handles events, default)\n"
+			   "   busy        Spin instead of sleeping (default 0)\n"
+			   "   priority    Event thread SCHED_FIFO priority (0 - normal, default)\n"
+			   "   cpu_mask    Event thread CPUs, hex (0 - any, default)\n", argv[0]);
+		return -1;
+	}
+	memset(&cfg, 0, sizeof(cfg));
+	if (argc > 1)
+		size = atoi(argv[1]);
+	if (argc > 2)
+		count = atoi(argv[2]);
+	if (argc > 3)
+		cfg.thread = atoi(argv[3]);
+	if (argc > 4)
+		cfg.busy_poll = atoi(argv[4]);
+	if (argc > 5)
+		cfg.priority = atoi(argv[5]);
+	if (argc > 6)
+		cfg.cpu_mask = strtoull(argv[6], NULL, 16);
+	if ((size < 1) || (size > MSG_MAX) || (count < 1)) {
+		printf("Invalid size or count\n");
+		return -1;
+	}
+
+	if (aub_init())
+		return -1;
+
+	if (!aub_open(&dev)) {
+		aub_get_device_info(aub_get_device_number(dev), &dev_info);
+		width_k = dev_info.config.chan[AUB_CHAN_OUT].width / 8;
+		in_width_k = dev_info.config.chan[AUB_CHAN_IN].width / 8;
+		/* Whole packets per transfer, a short packet ends the message early */
+		cfg.transfer_size = (size + 511) / 512 * 512;
+		cfg.transfer_count = 4;
+		loopback = dev_info.config.test;
+		if (dev_info.config.mode != AUB_MODE_STREAM || !width_k || width_k != in_width_k || size % width_k) {
+			printf("Ping needs stream mode, both channels of equal width and whole samples\n");
+		} else if (loopback && aub_test_set(dev, AUB_TEST_LOOPBACK, AUB_PATTERN_COUNTER)) {
+			printf("Loopback setup failed\n");
+		} else {
+			printf("%s, %d bytes, %d round trips\n", loopback ? "Device loopback" : "User logic echo", size, count);
+			res = aub_latency_start(dev, &cfg);
+			if (res) {
+				printf("Low-latency mode failed (%d)\n", res);
+			} else {
+				res = ping(size, count, width_k, dev_info.config.speed ? 125.0 : 1000.0);
+				aub_latency_stop(dev);
+			}
+			if (loopback)
+				aub_test_set(dev, AUB_TEST_OFF, AUB_PATTERN_COUNTER);
+		}
+		aub_close(dev);
+	} else {
+		printf("Device open error!\n");
+	}
+
+	aub_deinit();
+
+	return res;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file devplay.c
+ * @brief File Replay to OUT Channel
+ * @author Dmitry Matyunin (https://github.com/mcjtag)
+ * @date 19.10.2026
+ * @copyright
+ *  Copyright (c) 2021 Dmitry Matyunin
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aub.h"
+
+#define MB		(1024.0 * 1024.0)
+
+static volatile sig_atomic_t stop;
+static aub_device_t dev;
+
+static void sig_handler(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static int AUB_CALL progress(void *user, const struct aub_stream_stats *stats)
+{
+	unsigned long long *last = (unsigned long long *)user;
+
+	printf("Sent %10.1f MB, %7.2f MB/s, min in flight %u, errors %llu\n",
+		   (double)stats->bytes / MB, (double)(stats->bytes - *last) / MB,
+		   stats->inflight_min, stats->errors);
+	*last = stats->bytes;
+	return stop;
+}
+
+int main(int argc, char *argv[])
+{
+	struct aub_replay_config cfg;
+	unsigned long long last = 0;
+	int res;
+
+	if (argc < 2) {
+		printf("Usage: %s file [rate_MBps [loops [transfer_KB [transfers]]]]\n"
+			   "   rate_MBps   Pacing (0 - full link rate, default)\n"
+			   "   loops       Number of passes (0 - infinite, default 1)\n", argv[0]);
+		return -1;
+	}
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.loops = 1;
+	if (argc > 2)
+		cfg.rate = (unsigned long long)(atof(argv[2]) * MB);
+	if (argc > 3)
+		cfg.loops = atoi(argv[3]);
+	if (argc > 4)
+		cfg.transfer_size = atoi(argv[4]) * 1024;
+	if (argc > 5)
+		cfg.transfer_count = atoi(argv[5]);
+
+	res = aub_init();
+	printf("Init: %s\n", res ? "failed" : "success");
+	if (res)
+		return -1;
+
+	if (!aub_open(&dev)) {
+		signal(SIGINT, sig_handler);
+		res = aub_replay_file(dev, argv[1], &cfg, progress, &last);
+		printf("Replay: %s (%d)\n", res ? "failed" : "done", res);
+		aub_close(dev);
+	} else {
+		printf("Device open error!\n");
+	}
+
+	aub_deinit();
+
+	return res ? -1 : 0;
+}
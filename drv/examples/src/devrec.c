@@ -0,0 +1,376 @@
+/**
+ * @file devrec.c
+ * @brief Stream-to-disk Recorder (Linux)
+ * @author Dmitry Matyunin (https://github.com/mcjtag)
+ * @date 19.10.2026
+ * @copyright
+ *  Copyright (c) 2021 Dmitry Matyunin
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ * Records AUB_CHAN_IN into a sequence of preallocated chunk files
+ * (<prefix>_NNNN.bin). USB buffers are received asynchronously into the
+ * library pool and handed to a writer thread, which writes them with O_DIRECT.
+ * The pool depth (-n x -b) is the amount of data that can be buffered while
+ * the disk stalls.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		/* O_DIRECT */
+#endif
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "aub.h"
+
+#define ALIGN			4096
+#define MB				(1024ULL * 1024ULL)
+
+#define DEF_BUFSIZE		1024	/* KB */
+#define DEF_BUFCOUNT	256
+#define DEF_XFERCOUNT	16
+#define DEF_CHUNKSIZE	1024	/* MB */
+#define DEF_STALL		50		/* ms */
+
+struct block {
+	void *data;
+	int length;
+};
+
+struct recorder {
+	/* Queue: USB -> writer */
+	struct block *queue;
+	unsigned int queue_size;
+	unsigned int head;
+	unsigned int tail;
+	unsigned int count;
+	unsigned int count_max;
+	int done;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/* Writer */
+	const char *prefix;
+	unsigned long long chunk_size;
+	unsigned int stall_ms;
+	int fd;
+	int index;
+	unsigned long long file_written;
+	unsigned char *stage;
+	size_t stage_size;
+	size_t staged;
+	int error;
+	/* Statistics */
+	unsigned long long bytes;
+	unsigned long long stalls;
+	double write_max;
+};
+
+static volatile sig_atomic_t stop;
+static aub_device_t dev;
+
+static void sig_handler(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int raw_write(struct recorder *rec, const void *data, size_t length)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	double t0, dt;
+	ssize_t res;
+
+	t0 = now_sec();
+	while (length > 0) {
+		res = write(rec->fd, p, length);
+		if (res < 0) {
+			perror("write");
+			return -1;
+		}
+		p += res;
+		length -= res;
+	}
+	dt = now_sec() - t0;
+	if (dt > rec->write_max)
+		rec->write_max = dt;
+	if (dt * 1000.0 > rec->stall_ms)
+		rec->stalls++;
+	return 0;
+}
+
+static int file_close(struct recorder *rec)
+{
+	int res = 0;
+
+	if (rec->fd < 0)
+		return 0;
+	if (rec->staged) {
+		if (rec->staged % ALIGN)
+			fcntl(rec->fd, F_SETFL, fcntl(rec->fd, F_GETFL) & ~O_DIRECT);
+		res = raw_write(rec, rec->stage, rec->staged);
+		rec->staged = 0;
+	}
+	if (ftruncate(rec->fd, rec->file_written))
+		perror("ftruncate");
+	close(rec->fd);
+	rec->fd = -1;
+	return res;
+}
+
+static int file_open(struct recorder *rec)
+{
+	char name[1024];
+	int res;
+
+	snprintf(name, sizeof(name), "%s_%04d.bin", rec->prefix, rec->index++);
+	rec->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if (rec->fd < 0) {
+		perror(name);
+		return -1;
+	}
+	res = posix_fallocate(rec->fd, 0, rec->chunk_size);
+	if (res)
+		fprintf(stderr, "%s: preallocation failed (%s)\n", name, strerror(res));
+	rec->file_written = 0;
+	return 0;
+}
+
+static int block_write(struct recorder *rec, const unsigned char *data, size_t length)
+{
+	size_t n;
+
+	while (length > 0) {
+		if ((rec->fd < 0) || (rec->file_written == rec->chunk_size)) {
+			if (file_close(rec) || file_open(rec))
+				return -1;
+		}
+		n = length;
+		if (n > rec->chunk_size - rec->file_written)
+			n = rec->chunk_size - rec->file_written;
+		if ((rec->staged == 0) && ((n % ALIGN) == 0) && (((uintptr_t)data % ALIGN) == 0)) {
+			if (raw_write(rec, data, n))
+				return -1;
+		} else {
+			if (n > rec->stage_size - rec->staged)
+				n = rec->stage_size - rec->staged;
+			memcpy(rec->stage + rec->staged, data, n);
+			rec->staged += n;
+			if (rec->staged == rec->stage_size) {
+				if (raw_write(rec, rec->stage, rec->staged))
+					return -1;
+				rec->staged = 0;
+			}
+		}
+		rec->file_written += n;
+		rec->bytes += n;
+		data += n;
+		length -= n;
+	}
+	return 0;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct recorder *rec = (struct recorder *)arg;
+	struct block blk;
+
+	for (;;) {
+		pthread_mutex_lock(&rec->lock);
+		while ((rec->count == 0) && !rec->done)
+			pthread_cond_wait(&rec->cond, &rec->lock);
+		if (rec->count == 0) {
+			pthread_mutex_unlock(&rec->lock);
+			break;
+		}
+		blk = rec->queue[rec->head];
+		rec->head = (rec->head + 1) % rec->queue_size;
+		rec->count--;
+		pthread_mutex_unlock(&rec->lock);
+
+		if (!rec->error && block_write(rec, (const unsigned char *)blk.data, blk.length))
+			rec->error = 1;
+		aub_stream_put(dev, blk.data);
+	}
+	if (file_close(rec))
+		rec->error = 1;
+	return NULL;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s -o prefix [options]\n"
+		   "   -o prefix   Output file prefix (files are <prefix>_NNNN.bin)\n"
+		   "   -d number   Device number (default: first accessible)\n"
+		   "   -b size     Buffer size, KB (default: %d)\n"
+		   "   -n count    Buffer count (default: %d)\n"
+		   "   -q count    USB transfers in flight (default: %d)\n"
+		   "   -c size     Chunk file size, MB (default: %d)\n"
+		   "   -s time     Disk stall threshold, ms (default: %d)\n"
+		   "   -t time     Record duration, s (default: until Ctrl+C)\n",
+		   name, DEF_BUFSIZE, DEF_BUFCOUNT, DEF_XFERCOUNT, DEF_CHUNKSIZE, DEF_STALL);
+}
+
+int main(int argc, char *argv[])
+{
+	struct aub_stream_config cfg;
+	struct aub_stream_stats stats;
+	struct recorder rec;
+	pthread_t writer;
+	double t_start, t_report, t_now, duration = 0.0;
+	unsigned long long last_bytes = 0;
+	int opt, res, devnum = -1;
+	void *data;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.chunk_size = DEF_CHUNKSIZE * MB;
+	rec.stall_ms = DEF_STALL;
+	rec.fd = -1;
+	cfg.transfer_size = DEF_BUFSIZE * 1024;
+	cfg.buffer_count = DEF_BUFCOUNT;
+	cfg.transfer_count = DEF_XFERCOUNT;
+	cfg.timeout = 100;
+
+	while ((opt = getopt(argc, argv, "o:d:b:n:q:c:s:t:h")) != -1) {
+		switch (opt) {
+		case 'o': rec.prefix = optarg; break;
+		case 'd': devnum = atoi(optarg); break;
+		case 'b': cfg.transfer_size = atoi(optarg) * 1024; break;
+		case 'n': cfg.buffer_count = atoi(optarg); break;
+		case 'q': cfg.transfer_count = atoi(optarg); break;
+		case 'c': rec.chunk_size = strtoull(optarg, NULL, 0) * MB; break;
+		case 's': rec.stall_ms = atoi(optarg); break;
+		case 't': duration = atof(optarg); break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if (!rec.prefix || (cfg.transfer_size == 0) || (cfg.transfer_size % ALIGN) || (rec.chunk_size == 0)) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	rec.stage_size = cfg.transfer_size;
+	if (posix_memalign((void **)&rec.stage, ALIGN, rec.stage_size))
+		return -1;
+	rec.queue_size = cfg.buffer_count + 1;
+	rec.queue = (struct block *)calloc(rec.queue_size, sizeof(struct block));
+	if (!rec.queue)
+		return -1;
+	pthread_mutex_init(&rec.lock, NULL);
+	pthread_cond_init(&rec.cond, NULL);
+
+	res = aub_init();
+	if (res) {
+		fprintf(stderr, "Init failed\n");
+		return -1;
+	}
+	res = (devnum < 0) ? aub_open(&dev) : aub_open_by_number(&dev, devnum);
+	if (res) {
+		fprintf(stderr, "Device open error!\n");
+		aub_deinit();
+		return -1;
+	}
+	res = aub_stream_start(dev, AUB_CHAN_IN, &cfg);
+	if (res) {
+		fprintf(stderr, "Stream start error (%d)\n", res);
+		aub_close(dev);
+		aub_deinit();
+		return -1;
+	}
+
+	signal(SIGINT, sig_handler);
+	signal(SIGTERM, sig_handler);
+	pthread_create(&writer, NULL, writer_thread, &rec);
+
+	t_start = now_sec();
+	t_report = t_start;
+	while (!stop && !rec.error) {
+		t_now = now_sec();
+		if ((duration > 0.0) && (t_now - t_start >= duration))
+			break;
+		if (t_now - t_report >= 1.0) {
+			aub_stream_get_stats(dev, AUB_CHAN_IN, &stats);
+			fprintf(stderr, "%8.1f s: %7.2f MB/s, %10.1f MB, queue %u/%u (max %u), "
+					"usb overruns %llu, min in flight %u, write max %.1f ms, stalls %llu\n",
+					t_now - t_start, (double)(stats.bytes - last_bytes) / (t_now - t_report) / MB,
+					(double)stats.bytes / MB, rec.count, cfg.buffer_count, rec.count_max,
+					stats.overruns, stats.inflight_min, rec.write_max * 1000.0, rec.stalls);
+			last_bytes = stats.bytes;
+			t_report = t_now;
+		}
+		res = aub_stream_get(dev, &data, 100);
+		if (res == AUB_ERROR_TIMEOUT)
+			continue;
+		if (res < 0) {
+			fprintf(stderr, "Receive error (%d)\n", res);
+			break;
+		}
+		pthread_mutex_lock(&rec.lock);
+		rec.queue[rec.tail].data = data;
+		rec.queue[rec.tail].length = res;
+		rec.tail = (rec.tail + 1) % rec.queue_size;
+		if (++rec.count > rec.count_max)
+			rec.count_max = rec.count;
+		pthread_cond_signal(&rec.cond);
+		pthread_mutex_unlock(&rec.lock);
+	}
+
+	pthread_mutex_lock(&rec.lock);
+	rec.done = 1;
+	pthread_cond_signal(&rec.cond);
+	pthread_mutex_unlock(&rec.lock);
+	pthread_join(writer, NULL);
+
+	aub_stream_get_stats(dev, AUB_CHAN_IN, &stats);
+	t_now = now_sec();
+	printf("Recorded:\n"
+		   "   Bytes:        %llu (%d files)\n"
+		   "   Rate:         %.2f MB/s\n"
+		   "   USB overruns: %llu\n"
+		   "   USB errors:   %llu\n"
+		   "   Queue max:    %u of %u buffers\n"
+		   "   Write max:    %.1f ms\n"
+		   "   Disk stalls:  %llu (> %u ms)\n",
+		   rec.bytes, rec.index, (double)rec.bytes / (t_now - t_start) / MB,
+		   stats.overruns, stats.errors, rec.count_max, cfg.buffer_count,
+		   rec.write_max * 1000.0, rec.stalls, rec.stall_ms);
+
+	aub_stream_stop(dev, AUB_CHAN_IN);
+	aub_close(dev);
+	aub_deinit();
+	free(rec.queue);
+	free(rec.stage);
+
+	return rec.error ? -1 : 0;
+}
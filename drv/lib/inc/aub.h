@@ -61,6 +61,11 @@ enum AUB_ERROR {
 	AUB_ERROR_NOT_READY = -4,
 	AUB_ERROR_OVERFLOW = -5,
 	AUB_ERROR_IO = -6,
+	AUB_ERROR_TIMEOUT = -7,
+	AUB_ERROR_BUSY = -8,
+	AUB_ERROR_INVALID_PARAM = -9,
+	AUB_ERROR_FILE = -10,
+	AUB_ERROR_BUS = -11,
 };
 
 enum AUB_STATE {
@@ -78,6 +83,45 @@ enum AUB_MODE {
 	AUB_MODE_PACKET = 1
 };
 
+enum AUB_TEST_MODE {
+	AUB_TEST_OFF = 0,		/* User data path */
+	AUB_TEST_PRBS = 1,		/* Generator on IN, checker on OUT */
+	AUB_TEST_LOOPBACK = 2	/* OUT looped back to IN inside device */
+};
+
+enum AUB_TEST_PATTERN {
+	AUB_PATTERN_PRBS31 = 0,
+	AUB_PATTERN_COUNTER = 1
+};
+
+#define AUB_FRAME_SIZE		512		/* Integrity frame: sequence number, payload, CRC32C */
+#define AUB_FRAME_PAYLOAD	504
+
+#define AUB_COMPRESS_BLOCK		16		/* Samples per compressed block */
+#define AUB_DECODE_BLOCK_MAX	66		/* Largest compressed block: header, count, 16 32-bit samples */
+#define AUB_COMPRESS_SYNC_SIZE	4		/* Restart marker opening every compressed stream: 7F 41 55 42 */
+
+enum AUB_INTEGRITY_EVENT {
+	AUB_INTEGRITY_GAP = 0,		/* Sequence number jumped forward: frames lost */
+	AUB_INTEGRITY_REPEAT = 1,	/* Sequence number went back: frames duplicated or reordered */
+	AUB_INTEGRITY_CRC = 2,		/* Frame failed CRC, payload dropped */
+	AUB_INTEGRITY_RESYNC = 3	/* Frame alignment lost, searching for next valid frame */
+};
+
+enum AUB_TRACE_KIND {
+	AUB_TRACE_CONTROL = 0,	/* Control transfer (register/config request) */
+	AUB_TRACE_BULK = 1,		/* Synchronous bulk transfer */
+	AUB_TRACE_ASYNC = 2		/* Asynchronous bulk transfer (stream, prefetch, try_send/try_recv) */
+};
+
+enum AUB_TRACE_REASON {
+	AUB_TRACE_REASON_NONE = 0,
+	AUB_TRACE_REASON_TIMEOUT = 1,	/* Transfer timed out, caller continues with another one */
+	AUB_TRACE_REASON_SHORT = 2,		/* Fewer bytes than requested, caller continues with another one */
+	AUB_TRACE_REASON_STALL = 3,		/* Endpoint halted */
+	AUB_TRACE_REASON_ERROR = 4		/* Other failure */
+};
+
 struct aub_device_info {
 	unsigned int devnum;
 	unsigned char busnum;
@@ -95,12 +139,201 @@ struct aub_device_info {
 			unsigned char fifo_enabled;
 			unsigned char fifo_mode;
 			unsigned int fifo_depth;
+			unsigned int packed;
 		} chan[2];
 		unsigned char speed;
 		unsigned char mode;
+		unsigned char timestamp;
+		unsigned char test;
+		unsigned char mem;
+		unsigned char block;
+		unsigned char frame;
+		unsigned char fill;
+		unsigned char plq;
+		unsigned char compress;
+		unsigned char tsq;
 	} config;
 };
 
+struct aub_stream_config {
+	unsigned int transfer_size;		/* IN: bytes per bulk transfer (multiple of 512) */
+	unsigned int transfer_count;	/* Transfers kept in flight */
+	unsigned int buffer_count;		/* IN: buffers in pool (>= transfer_count) */
+	unsigned int timeout;			/* IN: ms before a partially filled buffer is returned (0 - wait for full buffer) */
+};
+
+struct aub_stream_stats {
+	unsigned long long bytes;		/* Bytes transferred */
+	unsigned long long transfers;	/* Completed transfers */
+	unsigned long long overruns;	/* IN: completions without a free buffer to requeue */
+	unsigned long long errors;		/* Failed transfers */
+	unsigned int inflight;			/* Transfers currently submitted */
+	unsigned int ready;				/* IN: filled buffers waiting for aub_stream_get() */
+	unsigned int ready_max;			/* IN: high watermark of ready buffers */
+	unsigned int inflight_min;		/* Low watermark of submitted transfers */
+};
+
+struct aub_prefetch_config {
+	unsigned long long ring_size;	/* Ring size, bytes (rounded up to whole transfers) */
+	unsigned int transfer_size;		/* Bytes per bulk transfer (multiple of 512) */
+	unsigned int transfer_count;	/* Transfers kept in flight */
+	unsigned int timeout;			/* ms before a partially filled transfer is stored (0 - wait for full transfer) */
+	int huge_pages;					/* Back ring with huge pages if the system provides them */
+};
+
+struct aub_prefetch_stats {
+	unsigned long long bytes;			/* Bytes stored in ring */
+	unsigned long long fill;			/* Bytes waiting in ring */
+	unsigned long long fill_max;		/* High watermark of fill */
+	unsigned long long overruns;		/* Gaps: ring was full and data had to be discarded */
+	unsigned long long dropped;			/* Bytes discarded while ring was full */
+	unsigned long long overrun_offset;	/* Stream offset (bytes stored before) of latest gap */
+	unsigned long long overrun_ns;		/* Host monotonic time of latest gap, ns */
+	unsigned long long errors;			/* Failed transfers */
+	int huge_pages;						/* Ring is backed by huge pages */
+};
+
+struct aub_latency_config {
+	unsigned int transfer_size;		/* Bytes per transfer (multiple of 512): largest message */
+	unsigned int transfer_count;	/* IN transfers kept submitted, OUT transfers in flight at most */
+	int thread;						/* Event thread (0 - waiting calls handle events themselves) */
+	int busy_poll;					/* Event handling spins instead of sleeping */
+	int priority;					/* Event thread SCHED_FIFO priority (0 - normal scheduling) */
+	unsigned long long cpu_mask;	/* CPUs the event thread may run on (0 - any) */
+};
+
+struct aub_latency_stats {
+	unsigned long long messages_in;	/* IN transfers completed */
+	unsigned long long messages_out;/* OUT transfers completed */
+	unsigned long long bytes_in;
+	unsigned long long bytes_out;
+	unsigned long long errors;		/* Failed transfers */
+	int locked;						/* Buffers are locked in memory */
+	int realtime;					/* Event thread runs with SCHED_FIFO priority */
+};
+
+struct aub_replay_config {
+	unsigned int transfer_size;		/* Bytes per bulk transfer (multiple of page size) */
+	unsigned int transfer_count;	/* Transfers kept in flight */
+	unsigned int readahead;			/* Bytes hinted for read-ahead beyond submitted data */
+	unsigned long long rate;		/* Pacing, bytes per second (0 - unlimited) */
+	unsigned int loops;				/* Number of passes over file (0 - infinite) */
+};
+
+struct aub_recovery_stats {
+	unsigned long long halts;		/* Halted transfers seen (LIBUSB_ERROR_PIPE) */
+	unsigned long long recoveries;	/* Halts cleared in place */
+	unsigned long long failures;	/* Halts that could not be cleared (channel reports AUB_ERROR_IO) */
+	unsigned long long lost_max;	/* Upper bound of bytes lost (IN) or repeated (OUT) by recoveries, one packet each */
+	unsigned long long last_duration_ns;	/* Duration of latest recovery, ns */
+};
+
+struct aub_io_params {
+	int min_length;					/* Return once this many elements are transferred (0 - fill whole array) */
+	int deadline;					/* Overall call timeout, ms (negative - infinite) */
+	int gap;						/* Timeout without data progress, ms (negative - infinite) */
+};
+
+struct aub_timestamp {
+	unsigned int frame;				/* SOF counter (microframes for High-Speed, frames for Full-Speed) */
+	unsigned int phase;				/* 60 MHz clock cycles since SOF */
+};
+
+struct aub_packet_timestamp {
+	unsigned long long packet;		/* IN packet number since queue was enabled */
+	struct aub_timestamp ts;		/* Timestamp of bulk packet carrying first byte of the packet */
+};
+
+/**
+ * @brief Replay progress callback (called about once per second)
+ * @param user User pointer
+ * @param stats OUT stream statistics
+ * @return 0 to continue, non-zero to stop replay
+ */
+typedef int (AUB_CALL *aub_replay_cb_t)(void *user, const struct aub_stream_stats *stats);
+
+struct aub_verify {
+	unsigned int pattern;			/* Expected pattern (see <enum AUB_TEST_PATTERN>) */
+	unsigned int history;			/* Last four bytes, latest in LSB */
+	unsigned int fill;				/* Bytes in history */
+	unsigned long long bytes;		/* Bytes verified */
+	unsigned long long errors;		/* Mismatched bytes */
+};
+
+/**
+ * @brief Integrity event notification
+ * @param user User pointer
+ * @param event Event (see <enum AUB_INTEGRITY_EVENT>)
+ * @param expected Expected sequence number
+ * @param seq Received sequence number (equals expected for CRC and resync events)
+ */
+typedef void (AUB_CALL *aub_integrity_cb_t)(void *user, int event, unsigned int expected, unsigned int seq);
+
+struct aub_integrity {
+	unsigned long long frames;		/* Valid frames */
+	unsigned long long bytes;		/* Payload bytes delivered */
+	unsigned long long gaps;		/* Sequence discontinuities */
+	unsigned long long lost;		/* Frames missing according to sequence numbers */
+	unsigned long long crc_errors;	/* Frames failing CRC while aligned */
+	unsigned long long resyncs;		/* Alignment searches */
+	unsigned long long skipped;		/* Bytes discarded while searching for alignment */
+	unsigned int seq;				/* Expected sequence number of next frame */
+	unsigned int fill;				/* Bytes of partial frame carried to next call */
+	int synced;						/* Frame alignment known */
+	int bad;						/* Consecutive CRC failures while aligned */
+	aub_integrity_cb_t cb;
+	void *user;
+	unsigned char frame[AUB_FRAME_SIZE];
+};
+
+struct aub_decoder {
+	unsigned long long blocks;		/* Blocks decoded */
+	unsigned long long raw;			/* Blocks stored uncompressed */
+	unsigned long long in_bytes;	/* Compressed bytes consumed */
+	unsigned long long out_samples;	/* Samples stored */
+	unsigned long long restarts;	/* Restart markers found */
+	unsigned long long skipped;		/* Bytes skipped looking for restart marker */
+	unsigned int width;				/* Sample size, bytes */
+	int big_endian;					/* Sample byte order */
+	unsigned int prev;				/* Last decoded sample */
+	unsigned int fill;				/* Bytes of partial block carried to next call */
+	unsigned int pend_pos;			/* Next sample of held block */
+	unsigned int pend_len;			/* Samples of held block (decoded, did not fit output) */
+	int hunting;					/* Skipping input until restart marker */
+	unsigned int sync;				/* Marker bytes matched so far */
+	int failed;						/* Block structure lost after samples were stored, reported by next call */
+	unsigned int pend[AUB_COMPRESS_BLOCK];
+	unsigned char block[AUB_DECODE_BLOCK_MAX + 8];
+};
+
+struct aub_pollfd {
+	int fd;							/* File descriptor */
+	short events;					/* Events to poll for (POLLIN, POLLOUT) */
+};
+
+struct aub_trace_event {
+	unsigned long long submit_ns;	/* Host monotonic time of submit */
+	unsigned long long complete_ns;	/* Host monotonic time of completion */
+	unsigned int length;			/* Requested bytes */
+	unsigned int actual;			/* Transferred bytes */
+	int status;						/* 0 or libusb error code */
+	unsigned int thread;			/* OS thread that completed transfer */
+	unsigned int devnum;			/* Device number */
+	unsigned char kind;				/* see <enum AUB_TRACE_KIND> */
+	unsigned char endpoint;			/* Endpoint address (0 - control) */
+	unsigned char request;			/* Control: vendor request, register address in value */
+	unsigned char reason;			/* see <enum AUB_TRACE_REASON> */
+	unsigned short value;			/* Control: wValue */
+};
+
+/**
+ * @brief Pollable file descriptor notification
+ * @param fd File descriptor
+ * @param events Events to poll for (0 - descriptor removed)
+ * @param user User pointer
+ */
+typedef void (AUB_CALL *aub_pollfd_cb_t)(int fd, short events, void *user);
+
 /**
  * @brief Open library and create device list
  * @return error_code (see <enum AUB_ERROR>)
@@ -182,6 +415,532 @@ int AUB_CALL AUB_API aub_send(aub_device_t dev, const void *data, int length);
  */
 int AUB_CALL AUB_API aub_recv(aub_device_t dev, void *data, int length);
 
+/**
+ * @brief Switch device between stream and packet mode (re-reads device configuration)
+ * @param dev AUB device
+ * @param mode Mode (see <enum AUB_MODE>)
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_set_mode(aub_device_t dev, int mode);
+
+/**
+ * @brief Send data with explicit timing parameters
+ * @param dev AUB device
+ * @param data Pointer to data array
+ * @param length Array length
+ * @param params Pointer to timing parameters (NULL - device parameters)
+ * @return error_code (see <enum AUB_ERROR>) or number of elements actual sent
+ */
+int AUB_CALL AUB_API aub_send_ex(aub_device_t dev, const void *data, int length, const struct aub_io_params *params);
+
+/**
+ * @brief Receive data with explicit timing parameters
+ * @param dev AUB device
+ * @param data Pointer to data array
+ * @param length Array length
+ * @param params Pointer to timing parameters (NULL - device parameters)
+ * @return error_code (see <enum AUB_ERROR>) or number of elements actual received
+ */
+int AUB_CALL AUB_API aub_recv_ex(aub_device_t dev, void *data, int length, const struct aub_io_params *params);
+
+/**
+ * @brief Get length of next whole packet waiting in packet length queue, without receiving it (packet mode)
+ * @param dev AUB device
+ * @param timeout Timeout, ms (negative - infinite)
+ * @return error_code (see <enum AUB_ERROR>) or packet length, elements
+ */
+int AUB_CALL AUB_API aub_recv_peek_len(aub_device_t dev, int timeout);
+
+/**
+ * @brief Receive queued whole packets back to back, transfers are sized from packet length queue (packet mode)
+ * @param dev AUB device
+ * @param data Pointer to data array
+ * @param length Array length
+ * @param lengths Pointer to array of received packet lengths, elements
+ * @param count Lengths array size (maximum number of packets)
+ * @return error_code (see <enum AUB_ERROR>) or number of packets received
+ */
+int AUB_CALL AUB_API aub_recv_packets(aub_device_t dev, void *data, int length, int *lengths, int count);
+
+/**
+ * @brief Set timing parameters used by aub_send()/aub_recv()
+ * @param dev AUB device
+ * @param chan Channel (see <enum AUB_CHAN>)
+ * @param params Pointer to timing parameters (NULL - mode defaults)
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_set_io_params(aub_device_t dev, int chan, const struct aub_io_params *params);
+
+/**
+ * @brief Get timing parameters used by aub_send()/aub_recv()
+ * @param dev AUB device
+ * @param chan Channel (see <enum AUB_CHAN>)
+ * @param params Pointer to timing parameters
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_get_io_params(aub_device_t dev, int chan, struct aub_io_params *params);
+
+/**
+ * @brief Start asynchronous stream on channel
+ * @param dev AUB device
+ * @param chan Channel (see <enum AUB_CHAN>)
+ * @param cfg Pointer to stream configuration (NULL - defaults)
+ * @return error_code (see <enum AUB_ERROR>), AUB_ERROR_NOT_READY for IN while compression is on
+ */
+int AUB_CALL AUB_API aub_stream_start(aub_device_t dev, int chan, const struct aub_stream_config *cfg);
+
+/**
+ * @brief Stop asynchronous stream on channel (cancels transfers in flight)
+ * @param dev AUB device
+ * @param chan Channel (see <enum AUB_CHAN>)
+ * @return void
+ */
+void AUB_CALL AUB_API aub_stream_stop(aub_device_t dev, int chan);
+
+/**
+ * @brief Get next filled buffer from IN stream
+ * @param dev AUB device
+ * @param data Pointer to buffer pointer (buffer is owned by caller until aub_stream_put())
+ * @param timeout Timeout, ms (0 - do not wait, negative - infinite)
+ * @return error_code (see <enum AUB_ERROR>) or number of bytes in buffer
+ */
+int AUB_CALL AUB_API aub_stream_get(aub_device_t dev, void **data, int timeout);
+
+/**
+ * @brief Return buffer to IN stream pool (may be called from any thread)
+ * @param dev AUB device
+ * @param data Buffer obtained by aub_stream_get()
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_stream_put(aub_device_t dev, void *data);
+
+/**
+ * @brief Submit data to OUT stream without copying
+ * @param dev AUB device
+ * @param data Pointer to data (must stay valid until transfer completes)
+ * @param length Number of bytes
+ * @param timeout Timeout for free transfer slot, ms (0 - do not wait, negative - infinite)
+ * @return error_code (see <enum AUB_ERROR>), AUB_ERROR_NOT_READY in packet mode
+ */
+int AUB_CALL AUB_API aub_stream_submit(aub_device_t dev, const void *data, int length, int timeout);
+
+/**
+ * @brief Wait until all OUT stream transfers are completed
+ * @param dev AUB device
+ * @param timeout Timeout, ms (negative - infinite)
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_stream_flush(aub_device_t dev, int timeout);
+
+/**
+ * @brief Get stream statistics
+ * @param dev AUB device
+ * @param chan Channel (see <enum AUB_CHAN>)
+ * @param stats Pointer to statistics structure
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_stream_get_stats(aub_device_t dev, int chan, struct aub_stream_stats *stats);
+
+/**
+ * @brief Start background thread draining IN channel into host ring (stream mode only)
+ * @param dev AUB device
+ * @param cfg Pointer to configuration (NULL - defaults)
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_prefetch_start(aub_device_t dev, const struct aub_prefetch_config *cfg);
+
+/**
+ * @brief Stop background thread and free ring (unread data is lost)
+ * @param dev AUB device
+ */
+void AUB_CALL AUB_API aub_prefetch_stop(aub_device_t dev);
+
+/**
+ * @brief Map oldest unread data in ring without copying
+ * @param dev AUB device
+ * @param data Pointer to data pointer (valid until aub_prefetch_consume())
+ * @param timeout Timeout, ms (0 - do not wait, negative - infinite)
+ * @return error_code (see <enum AUB_ERROR>) or number of contiguous bytes at data
+ */
+int AUB_CALL AUB_API aub_prefetch_peek(aub_device_t dev, void **data, int timeout);
+
+/**
+ * @brief Release data obtained by aub_prefetch_peek()
+ * @param dev AUB device
+ * @param length Number of bytes (no more than returned by aub_prefetch_peek())
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_prefetch_consume(aub_device_t dev, int length);
+
+/**
+ * @brief Get prefetch ring statistics
+ * @param dev AUB device
+ * @param stats Pointer to statistics structure
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_prefetch_get_stats(aub_device_t dev, struct aub_prefetch_stats *stats);
+
+/**
+ * @brief Start low-latency mode: IN transfers stay submitted, data path uses no control requests (stream mode only)
+ * @param dev AUB device
+ * @param cfg Pointer to configuration (NULL - defaults: one packet per transfer, 4 transfers, no event thread)
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_latency_start(aub_device_t dev, const struct aub_latency_config *cfg);
+
+/**
+ * @brief Stop low-latency mode (cancels submitted transfers, data not received is lost)
+ * @param dev AUB device
+ */
+void AUB_CALL AUB_API aub_latency_stop(aub_device_t dev);
+
+/**
+ * @brief Send message in low-latency mode (returns once the transfer is submitted)
+ * @param dev AUB device
+ * @param data Pointer to data array (copied, may be reused on return)
+ * @param length Array length (no more than transfer_size bytes)
+ * @param timeout Timeout for a free OUT transfer, us (0 - do not wait, negative - infinite)
+ * @return error_code (see <enum AUB_ERROR>) or number of elements sent, AUB_ERROR_IO if an earlier message failed (not sent then)
+ */
+int AUB_CALL AUB_API aub_latency_send(aub_device_t dev, const void *data, int length, int timeout);
+
+/**
+ * @brief Receive next message in low-latency mode (one IN transfer, ended by a short packet or transfer_size)
+ * @param dev AUB device
+ * @param data Pointer to data array
+ * @param length Array length
+ * @param timeout Timeout, us (0 - do not wait, negative - infinite)
+ * @return error_code (see <enum AUB_ERROR>) or number of elements received, AUB_ERROR_OVERFLOW leaves message queued,
+ * AUB_ERROR_IO for a lost message (next call takes the next one)
+ */
+int AUB_CALL AUB_API aub_latency_recv(aub_device_t dev, void *data, int length, int timeout);
+
+/**
+ * @brief Get low-latency mode statistics
+ * @param dev AUB device
+ * @param stats Pointer to statistics structure
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_latency_get_stats(aub_device_t dev, struct aub_latency_stats *stats);
+
+/**
+ * @brief Send data without blocking (starts OUT stream with defaults if not running)
+ * @param dev AUB device
+ * @param data Pointer to data array (copied, may be reused on return)
+ * @param length Array length
+ * @return error_code (see <enum AUB_ERROR>) or number of elements queued, AUB_ERROR_NOT_READY if all transfers are in flight
+ * or in packet mode (use aub_send())
+ */
+int AUB_CALL AUB_API aub_try_send(aub_device_t dev, const void *data, int length);
+
+/**
+ * @brief Receive data without blocking (starts IN stream with defaults if not running)
+ * @param dev AUB device
+ * @param data Pointer to data array
+ * @param length Array length
+ * @return error_code (see <enum AUB_ERROR>) or number of elements received, AUB_ERROR_NOT_READY if no data
+ * or in packet mode (use aub_recv())
+ * @note With compression on, decodes what the prefetch ring already holds (no data without prefetch)
+ */
+int AUB_CALL AUB_API aub_try_recv(aub_device_t dev, void *data, int length);
+
+/**
+ * @brief Replay file to OUT channel (file is memory-mapped and sent without copying)
+ * @param dev AUB device
+ * @param path File path
+ * @param cfg Pointer to replay configuration (NULL - defaults)
+ * @param cb Progress callback (may be NULL)
+ * @param user User pointer for callback
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_replay_file(aub_device_t dev, const char *path, const struct aub_replay_config *cfg, aub_replay_cb_t cb, void *user);
+
+/**
+ * @brief Get current device SOF counter
+ * @param dev AUB device
+ * @param ts Pointer to timestamp
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_get_frame_counter(aub_device_t dev, struct aub_timestamp *ts);
+
+/**
+ * @brief Get timestamp of latest bulk IN packet (captured by device when packet was sent)
+ * @param dev AUB device
+ * @param ts Pointer to timestamp
+ * @return error_code (see <enum AUB_ERROR>), AUB_ERROR_NOT_READY if timestamp queue is empty
+ * @note With timestamp queue enabled takes the oldest queued packet timestamp instead
+ */
+int AUB_CALL AUB_API aub_get_packet_timestamp(aub_device_t dev, struct aub_timestamp *ts);
+
+/**
+ * @brief Enable or disable packet timestamp queue (Packet Mode), enabling empties the queue
+ * @param dev AUB device
+ * @param enable Enable flag (see <enum AUB_STATE>)
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_set_timestamp_queue(aub_device_t dev, int enable);
+
+/**
+ * @brief Take queued IN packet timestamps, oldest first, in one control transfer (Packet Mode)
+ * @param dev AUB device
+ * @param ts Pointer to timestamp array
+ * @param count Array size (at most 8 are taken per call)
+ * @return error_code (see <enum AUB_ERROR>) or number of timestamps taken
+ */
+int AUB_CALL AUB_API aub_get_packet_timestamps(aub_device_t dev, struct aub_packet_timestamp *ts, int count);
+
+/**
+ * @brief Synchronize device SOF counter with host monotonic clock
+ * @note First call sets the reference, later calls (>= 1 s apart) also correct the frame period
+ * @param dev AUB device
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_sync_clock(aub_device_t dev);
+
+/**
+ * @brief Convert device timestamp to host monotonic time (CLOCK_MONOTONIC on POSIX)
+ * @param dev AUB device
+ * @param ts Pointer to timestamp
+ * @param ns Pointer to result, ns
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_timestamp_to_host(aub_device_t dev, const struct aub_timestamp *ts, unsigned long long *ns);
+
+/**
+ * @brief Select link test mode (device built with TEST_ENABLE), restarts generator and checker
+ * @param dev AUB device
+ * @param mode Test mode (see <enum AUB_TEST_MODE>)
+ * @param pattern Test pattern (see <enum AUB_TEST_PATTERN>)
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_test_set(aub_device_t dev, int mode, int pattern);
+
+/**
+ * @brief Get device checker state
+ * @param dev AUB device
+ * @param errors Pointer to mismatched byte count since aub_test_set()
+ * @param locked Pointer to lock flag (checker has seen enough bytes to predict next one)
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_test_get_errors(aub_device_t dev, unsigned int *errors, int *locked);
+
+/**
+ * @brief Initialize host-side pattern verifier
+ * @param v Pointer to verifier state
+ * @param pattern Expected pattern (see <enum AUB_TEST_PATTERN>)
+ */
+void AUB_CALL AUB_API aub_verify_init(struct aub_verify *v, int pattern);
+
+/**
+ * @brief Verify received block against test pattern (continues from previous block)
+ * @param v Pointer to verifier state
+ * @param data Pointer to data
+ * @param length Data length, bytes
+ * @return Number of mismatched bytes in block
+ */
+unsigned int AUB_CALL AUB_API aub_verify(struct aub_verify *v, const void *data, unsigned int length);
+
+/**
+ * @brief Fill buffer with test pattern (continues from previous call)
+ * @param v Pointer to generator state (initialized with aub_verify_init())
+ * @param data Pointer to data
+ * @param length Data length, bytes
+ */
+void AUB_CALL AUB_API aub_pattern_fill(struct aub_verify *v, void *data, unsigned int length);
+
+/**
+ * @brief Read live user FIFO fill levels
+ * @param dev Device
+ * @param in_fill Pointer to IN FIFO fill, elements (may be NULL)
+ * @param out_fill Pointer to OUT FIFO fill, elements (may be NULL)
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_get_fifo_fill(aub_device_t dev, unsigned int *in_fill, unsigned int *out_fill);
+
+/**
+ * @brief Get endpoint halt recovery statistics
+ * @param dev Device
+ * @param chan Channel (see <enum AUB_CHAN>)
+ * @param stats Pointer to statistics
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_get_recovery_stats(aub_device_t dev, int chan, struct aub_recovery_stats *stats);
+
+/**
+ * @brief Enable or disable IN stream integrity framing in device
+ * @param dev Device
+ * @param enable Enable flag (see <enum AUB_STATE>)
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_set_integrity(aub_device_t dev, int enable);
+
+/**
+ * @brief Initialize integrity checker for framed IN stream
+ * @param ic Pointer to checker state
+ * @param cb Event notification (may be NULL)
+ * @param user User pointer
+ */
+void AUB_CALL AUB_API aub_integrity_init(struct aub_integrity *ic, aub_integrity_cb_t cb, void *user);
+
+/**
+ * @brief Check framed IN data and extract payload (continues from previous block)
+ * @param ic Pointer to checker state
+ * @param data Pointer to received data
+ * @param length Data length, bytes
+ * @param payload Pointer to payload output (may be NULL; must not overlap data; room for length + AUB_FRAME_SIZE bytes)
+ * @return error_code (see <enum AUB_ERROR>) or number of payload bytes stored
+ */
+int AUB_CALL AUB_API aub_integrity_check(struct aub_integrity *ic, const void *data, unsigned int length, void *payload);
+
+/**
+ * @brief Unpack bit-packed IN samples to 16-bit integers (SIMD for 12-bit samples when CPU has SSSE3/AVX2)
+ * @param data Pointer to packed data (sample i starts at bit i * width, LSB first)
+ * @param samples Pointer to samples output
+ * @param count Number of samples
+ * @param width Sample width, bits (config.chan[AUB_CHAN_IN].packed)
+ * @param is_signed Samples are two's complement and get sign-extended (0 - zero-extended)
+ * @return error_code (see <enum AUB_ERROR>) or number of packed bytes consumed
+ */
+int AUB_CALL AUB_API aub_unpack_i16(const void *data, short *samples, unsigned int count, unsigned int width, int is_signed);
+
+/**
+ * @brief Unpack bit-packed IN samples to float, full scale is 1.0
+ * @param data Pointer to packed data (sample i starts at bit i * width, LSB first)
+ * @param samples Pointer to samples output
+ * @param count Number of samples
+ * @param width Sample width, bits (config.chan[AUB_CHAN_IN].packed)
+ * @param is_signed Samples are two's complement: [-1, 1) (0 - unsigned: [0, 1))
+ * @return error_code (see <enum AUB_ERROR>) or number of packed bytes consumed
+ */
+int AUB_CALL AUB_API aub_unpack_float(const void *data, float *samples, unsigned int count, unsigned int width, int is_signed);
+
+/**
+ * @brief Enable or disable IN stream compression in device (Stream Mode)
+ * @param dev Device
+ * @param enable Enable flag (see <enum AUB_STATE>)
+ * @return error_code (see <enum AUB_ERROR>)
+ * @note aub_recv() and aub_try_recv() (from prefetch ring) decode transparently, aub_stream_start() for IN is refused while enabled
+ */
+int AUB_CALL AUB_API aub_set_compression(aub_device_t dev, int enable);
+
+/**
+ * @brief Initialize decoder for compressed IN stream, input is skipped up to the restart marker
+ * @param dec Pointer to decoder state
+ * @param width Sample width, bits (config.chan[AUB_CHAN_IN].width: 8, 16 or 32)
+ * @param big_endian Byte order of decoded samples (config.chan[AUB_CHAN_IN].endianess)
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_decode_init(struct aub_decoder *dec, unsigned int width, int big_endian);
+
+/**
+ * @brief Decode compressed IN data (continues from previous block)
+ * @param dec Pointer to decoder state
+ * @param data Pointer to compressed data
+ * @param length Data length, bytes
+ * @param samples Pointer to samples output
+ * @param count Room in output, samples
+ * @param consumed Pointer to compressed bytes taken (may be NULL; less than length once output is full)
+ * @return error_code (see <enum AUB_ERROR>) or number of samples stored
+ * @note After AUB_ERROR_IO (block structure lost) input is skipped up to the next restart marker
+ */
+int AUB_CALL AUB_API aub_decode(struct aub_decoder *dec, const void *data, unsigned int length, void *samples, unsigned int count, unsigned int *consumed);
+
+/**
+ * @brief Read consecutive device registers (one control transfer per 64 registers)
+ * @param dev AUB device
+ * @param addr First register address
+ * @param values Pointer to register values
+ * @param count Number of registers
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_reg_read_block(aub_device_t dev, unsigned int addr, unsigned int *values, int count);
+
+/**
+ * @brief Write consecutive device registers (one control transfer per 64 registers)
+ * @param dev AUB device
+ * @param addr First register address
+ * @param values Pointer to register values
+ * @param count Number of registers
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_reg_write_block(aub_device_t dev, unsigned int addr, const unsigned int *values, int count);
+
+/**
+ * @brief Read FPGA memory through AXI4 master
+ * @param dev AUB device
+ * @param addr Bus address, bytes (multiple of 4)
+ * @param buf Pointer to data
+ * @param len Data length, bytes (multiple of 4)
+ * @return error_code (see <enum AUB_ERROR>), AUB_ERROR_BUS if slave returned error
+ */
+int AUB_CALL AUB_API aub_mem_read(aub_device_t dev, unsigned int addr, void *buf, unsigned int len);
+
+/**
+ * @brief Write FPGA memory through AXI4 master
+ * @param dev AUB device
+ * @param addr Bus address, bytes (multiple of 4)
+ * @param buf Pointer to data
+ * @param len Data length, bytes (multiple of 4)
+ * @return error_code (see <enum AUB_ERROR>), AUB_ERROR_BUS if slave returned error
+ */
+int AUB_CALL AUB_API aub_mem_write(aub_device_t dev, unsigned int addr, const void *buf, unsigned int len);
+
+/**
+ * @brief Get file descriptors to poll for USB events
+ * @param fds Pointer to descriptor array
+ * @param count Array length
+ * @return error_code (see <enum AUB_ERROR>) or number of descriptors (only first count are stored)
+ */
+int AUB_CALL AUB_API aub_get_pollfds(struct aub_pollfd *fds, int count);
+
+/**
+ * @brief Set notifiers for descriptors added to or removed from poll set
+ * @param cb Notifier (NULL - disable)
+ * @param user User pointer
+ */
+void AUB_CALL AUB_API aub_set_pollfd_notifier(aub_pollfd_cb_t cb, void *user);
+
+/**
+ * @brief Get time until aub_handle_events() must be called even without descriptor activity
+ * @param timeout Pointer to timeout, ms
+ * @return error_code (see <enum AUB_ERROR>) or 1 if timeout is set, 0 if none pending
+ */
+int AUB_CALL AUB_API aub_get_next_timeout(int *timeout);
+
+/**
+ * @brief Process pending USB events and complete transfers
+ * @param timeout Maximum wait, ms (0 - do not block)
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_handle_events(int timeout);
+
+/**
+ * @brief Start recording every transfer into in-memory trace ring
+ * @param size Ring size, events (0 - default; fixed by first call until aub_deinit())
+ * @return error_code (see <enum AUB_ERROR>)
+ */
+int AUB_CALL AUB_API aub_trace_start(unsigned int size);
+
+/**
+ * @brief Stop recording transfers (recorded events stay readable)
+ */
+void AUB_CALL AUB_API aub_trace_stop(void);
+
+/**
+ * @brief Take oldest recorded events out of trace ring (one reader at a time)
+ * @param events Pointer to event array
+ * @param count Array length
+ * @param lost Pointer to number of events overwritten before they were read (may be NULL)
+ * @return error_code (see <enum AUB_ERROR>) or number of events
+ */
+int AUB_CALL AUB_API aub_trace_read(struct aub_trace_event *events, int count, unsigned long long *lost);
+
+/**
+ * @brief Drain trace ring into Chrome trace / Perfetto JSON file
+ * @param path File path
+ * @return error_code (see <enum AUB_ERROR>) or number of events written
+ */
+int AUB_CALL AUB_API aub_trace_export(const char *path);
 
 #ifdef __cplusplus
 }
@@ -24,10 +24,54 @@
  *  THE SOFTWARE.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE		/* pthread_setaffinity_np() */
+#endif
 #include <libusb.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#ifdef AUB_USDT
+#include <sys/sdt.h>
+#endif
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CRC32C_X86
+#define CRC32C_TARGET	__attribute__((target("sse4.2")))
+#define UNPACK_X86
+#define UNPACK_SSSE3_TARGET	__attribute__((target("ssse3")))
+#define UNPACK_AVX2_TARGET	__attribute__((target("avx2")))
+#ifdef __SSE2__
+#define DECODE_SSE2
+#endif
+#elif defined(_M_X64)
+#include <intrin.h>
+#include <immintrin.h>
+#define CRC32C_X86
+#define CRC32C_TARGET
+#define UNPACK_X86
+#define UNPACK_SSSE3_TARGET
+#define UNPACK_AVX2_TARGET
+#define DECODE_SSE2
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARM
+#endif
 #include "list.h"
 #include "aub.h"
 
@@ -40,6 +84,88 @@
 #define PACKETSIZE_HS	512
 #define PACKETSIZE_FS	64
 
+#define BUF_ALIGN		4096
+
+#define IO_CHUNK_PACKETS		64
+#define IO_GAP_STREAM			TIMEOUT
+#define IO_WAIT_MAX				100
+#define IO_CREDIT_MARGIN		2048	/* OUT bytes that may still be on their way to user FIFO, at most */
+#define IO_CREDIT_MARGIN_DIV	4		/* ... and at most this fraction of FIFO capacity */
+#define IO_CREDIT_POLL_US		250
+#define IO_RECOVERY_MAX			3		/* Halts in a row without progress before giving up */
+
+#define PLQ_WINDOW				8		/* Packet lengths visible in PQ0..PQ7 */
+#define TSQ_WINDOW				8		/* Packet timestamps visible in TQ0..TQ15 */
+
+#define DECODE_SYNC_HEADER		0x7F	/* First byte of restart marker, never a valid block header */
+
+#define UNPACK_BLOCK			256		/* Samples per step of aub_unpack_float(), multiple of 8 */
+
+#define STREAM_TRANSFER_SIZE	65536
+#define STREAM_TRANSFER_COUNT	8
+#define STREAM_BUFFER_COUNT		32
+#define STREAM_TIMEOUT			100
+
+#define PREFETCH_RING_SIZE		(64ULL * 1024 * 1024)
+#define PREFETCH_HUGE_SIZE		(2ULL * 1024 * 1024)
+#define PREFETCH_EVENT_TIMEOUT	100
+#define PREFETCH_POLL_US		100
+
+#define LATENCY_TRANSFER_COUNT	4
+#define LATENCY_EVENT_TIMEOUT	100
+#define LATENCY_POLL_US			10
+
+#define REPLAY_TRANSFER_SIZE	(1024 * 1024)
+#define REPLAY_TRANSFER_COUNT	8
+#define REPLAY_READAHEAD		(16 * 1024 * 1024)
+#define REPLAY_DROP_SIZE		(16 * 1024 * 1024)
+#define REPLAY_REPORT			1000
+
+#define REG_BLOCK_MAX			64
+
+#define MEM_CMD_SIZE			16
+#define MEM_STATUS_SIZE			4
+#define MEM_CHUNK_SIZE			65536
+#define MEM_PIPELINE			2
+#define MEM_TIMEOUT				1000
+
+#define TRACE_SIZE				65536
+#define TRACE_READ_CHUNK		256
+
+#define CLOCK_SYNC_TRIES		8
+#define CLOCK_DRIFT_MIN			1000000000ULL
+#define PHASE_NS				(1000.0 / 60.0)
+#define FRAME_NS_HS				125000.0
+#define FRAME_NS_FS				1000000.0
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION aub_lock_t;
+#define lock_init(l)	InitializeCriticalSection(l)
+#define lock_destroy(l)	DeleteCriticalSection(l)
+#define lock_get(l)		EnterCriticalSection(l)
+#define lock_put(l)		LeaveCriticalSection(l)
+typedef HANDLE aub_thread_t;
+#define THREAD_FN		DWORD WINAPI
+#define THREAD_EXIT		0
+#define thread_create(t, fn, arg)	((*(t) = CreateThread(NULL, 0, fn, arg, 0, NULL)) ? 0 : -1)
+#define thread_join(t)	do { WaitForSingleObject(t, INFINITE); CloseHandle(t); } while (0)
+#else
+typedef pthread_mutex_t aub_lock_t;
+#define lock_init(l)	pthread_mutex_init(l, NULL)
+#define lock_destroy(l)	pthread_mutex_destroy(l)
+#define lock_get(l)		pthread_mutex_lock(l)
+#define lock_put(l)		pthread_mutex_unlock(l)
+typedef pthread_t aub_thread_t;
+#define THREAD_FN		void *
+#define THREAD_EXIT		NULL
+#define thread_create(t, fn, arg)	pthread_create(t, NULL, fn, arg)
+#define thread_join(t)	pthread_join(t, NULL)
+#endif
+
+/* Single producer / single consumer ring indices */
+#define ring_load(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ring_store(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+
 enum REQUEST_TYPE {
 	REQUEST_TYPE_IN = LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR,
 	REQUEST_TYPE_OUT = LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR
@@ -47,18 +173,37 @@ enum REQUEST_TYPE {
 
 enum BULK_ENDPOINT {
 	BULK_ENDPOINT_IN = LIBUSB_ENDPOINT_IN | 1,
-	BULK_ENDPOINT_OUT = LIBUSB_ENDPOINT_OUT | 1
+	BULK_ENDPOINT_OUT = LIBUSB_ENDPOINT_OUT | 1,
+	BULK_ENDPOINT_MEM_IN = LIBUSB_ENDPOINT_IN | 2,
+	BULK_ENDPOINT_MEM_OUT = LIBUSB_ENDPOINT_OUT | 2
 };
 
 enum REQUEST {
 	REQUEST_CFG_GET = 0,
-	REQUEST_REG_OPER = 1
+	REQUEST_REG_OPER = 1,
+	REQUEST_REG_BLOCK = 2
 };
 
 enum REG {
 	REG_TSR = 0,
 	REG_TLR = 1,
-	REG_RSR = 2
+	REG_RSR = 2,
+	REG_SFL = 3,
+	REG_SFH = 4,
+	REG_SFP = 5,
+	REG_PTL = 6,
+	REG_PTH = 7,
+	REG_PTP = 8,
+	REG_TCR = 9,
+	REG_TEL = 10,
+	REG_TEH = 11,
+	REG_MCR = 12,
+	REG_FIL = 13,
+	REG_FOL = 14,
+	REG_PQC = 15,
+	REG_PQ0 = 16,
+	REG_TQC = 24,
+	REG_TQ0 = 25
 };
 
 enum REG_TSR_BIT {
@@ -71,6 +216,31 @@ enum REG_RSR_BIT {
 	REG_RSR_BIT_LST = 2
 };
 
+enum REG_TCR_BIT {
+	REG_TCR_BIT_MODE = 0x0003,
+	REG_TCR_BIT_PATTERN = 0x0004,
+	REG_TCR_BIT_LOCKED = 0x0100
+};
+
+enum REG_MCR_BIT {
+	REG_MCR_BIT_PACKET = 1,
+	REG_MCR_BIT_FRAME = 2,
+	REG_MCR_BIT_PLQ = 4,
+	REG_MCR_BIT_COMPRESS = 8,
+	REG_MCR_BIT_TSQ = 16
+};
+
+enum MEM_OPCODE {
+	MEM_OPCODE_WRITE = 1,
+	MEM_OPCODE_READ = 2
+};
+
+enum MEM_STATUS {
+	MEM_STATUS_OKAY = 0x00,
+	MEM_STATUS_SLVERR = 0x02,
+	MEM_STATUS_DECERR = 0x03
+};
+
 enum DATA_WIDTH {
 	DATA_WIDTH_NONE = 0,
 	DATA_WIDTH_8 = 1,
@@ -86,11 +256,20 @@ struct aub_config {
 		uint16_t fifo_enabled:1;
 		uint16_t fifo_mode:1;
 		uint16_t fifo_depth:5;
-		uint16_t :5;
+		uint16_t packed:5;
 	}chan[2];
 	uint16_t speed:1;
 	uint16_t mode:1;
-	uint16_t :14;
+	uint16_t tstamp:1;
+	uint16_t test:1;
+	uint16_t mem:1;
+	uint16_t block:1;
+	uint16_t frame:1;
+	uint16_t fill:1;
+	uint16_t plq:1;
+	uint16_t compress:1;
+	uint16_t tsq:1;
+	uint16_t :5;
 };
 
 struct aub_device_str_info {
@@ -99,6 +278,133 @@ struct aub_device_str_info {
 	unsigned char serial[INFO_SIZE];
 };
 
+struct aub_stream;
+
+struct aub_stream_buf {
+	struct list_head list;
+	unsigned char *data;
+	int length;
+};
+
+struct aub_stream_xfer {
+	struct list_head list;
+	struct libusb_transfer *xfer;
+	struct aub_stream *stream;
+	struct aub_stream_buf *buf;
+	unsigned char *bounce;		/* OUT: copy of data queued by aub_try_send() */
+	int active;
+	uint64_t seq;				/* OUT: submission order */
+	uint64_t submit_ns;			/* Trace: submit time, 0 - not traced */
+};
+
+struct aub_stream {
+	struct aub_device *adev;
+	struct aub_stream_config cfg;
+	struct aub_stream_stats stats;
+	struct aub_stream_buf *bufs;
+	struct aub_stream_xfer *xfers;
+	struct list_head buf_free;
+	struct list_head buf_ready;
+	struct list_head xfer_idle;
+	struct list_head xfer_halted;	/* OUT: unsent tails waiting for halt clear, in submission order */
+	struct aub_stream_buf *cur;	/* IN: buffer being drained by aub_try_recv() */
+	int cur_off;
+	aub_lock_t lock;
+	uint64_t seq;
+	int chan;
+	int running;
+	int error;
+	int halted;					/* Endpoint halted, transfers are not requeued until cleared */
+};
+
+struct aub_prefetch;
+
+struct aub_prefetch_xfer {
+	struct libusb_transfer *xfer;
+	struct aub_prefetch *pf;
+	int64_t slot;				/* Ring slot being filled, -1 - ring full, data is discarded */
+	int active;
+	uint64_t submit_ns;			/* Trace: submit time, 0 - not traced */
+};
+
+struct aub_prefetch {
+	struct aub_device *adev;
+	struct aub_prefetch_config cfg;
+	struct aub_prefetch_stats stats;
+	struct aub_prefetch_xfer *xfers;
+	unsigned char *ring;
+	unsigned char *scratch;
+	unsigned int *slot_len;
+	uint64_t ring_size;
+	uint64_t nslots;
+	/* Producer (transfer callback) */
+	uint64_t submit;			/* Slots handed to transfers */
+	uint64_t head;				/* Slots filled */
+	uint64_t bytes_in;			/* Bytes stored */
+	int gap;					/* Data discarded since last stored transfer */
+	char pad[64];
+	/* Consumer */
+	uint64_t tail;				/* Slots released */
+	unsigned int tail_off;		/* Bytes consumed in tail slot */
+	uint64_t bytes_out;			/* Bytes consumed */
+	aub_lock_t lock;
+	aub_thread_t thread;
+	unsigned int inflight;
+	int running;
+	int error;
+	int halted;
+};
+
+struct aub_latency_xfer {
+	struct libusb_transfer *xfer;
+	struct aub_latency *lat;
+	unsigned char *data;
+	int done;					/* Completed and not taken yet (OUT: free) */
+	int active;
+	uint64_t submit_ns;			/* Trace: submit time, 0 - not traced */
+};
+
+struct aub_latency {
+	struct aub_device *adev;
+	struct aub_latency_config cfg;
+	struct aub_latency_stats stats;
+	struct aub_latency_xfer *xfers;		/* transfer_count IN, then transfer_count OUT */
+	unsigned char *buf;
+	size_t buf_size;
+	uint64_t in_next;					/* IN transfer holding next message */
+	uint64_t out_next;					/* OUT transfer used by next message */
+	aub_lock_t lock;
+	aub_thread_t thread;
+	unsigned int inflight;
+	int running;
+	int halted;							/* Bit per channel */
+};
+
+struct aub_clock {
+	int valid;
+	uint64_t ref_ns;		/* Host time of reference point */
+	double ref_ticks;		/* Device time of reference point, phase ticks */
+	uint64_t last_ns;		/* Host time of latest point */
+	double last_ticks;		/* Device time of latest point, phase ticks */
+	uint64_t last_frame;	/* Unwrapped SOF counter of latest point */
+	double tick_ns;			/* Phase tick period, ns */
+	double frame_ticks;		/* Frame period, phase ticks */
+};
+
+struct aub_trace_slot {
+	uint64_t seq;				/* Event index + 1 once written, 0 while being written */
+	struct aub_trace_event ev;
+};
+
+/* Multiple producers (any thread completing a transfer), one reader; oldest events are overwritten */
+struct aub_trace {
+	struct aub_trace_slot *ring;
+	uint64_t mask;
+	uint64_t head;				/* Events claimed by producers */
+	uint64_t tail;				/* Events taken by reader */
+	int enabled;
+};
+
 struct aub_device {
 	libusb_device *dev;
 	libusb_device_handle *hdev;
@@ -111,21 +417,123 @@ struct aub_device {
 	struct list_head list;
 	int width_k[2];
 	int wmaxpacketsize;
+	struct aub_io_params io[2];
+	unsigned char residue[2 * PACKETSIZE_HS];	/* IN bytes received beyond caller array */
+	int residue_len;
+	int plq;									/* Packet length queue enabled */
+	int compress;								/* IN compression enabled, aub_recv() decodes */
+	int tsq;									/* Packet timestamp queue enabled */
+	uint64_t tsq_seq;							/* Number of next packet expected from timestamp queue */
+	struct aub_decoder dec;
+	unsigned char zbuf[IO_CHUNK_PACKETS * PACKETSIZE_HS];	/* Compressed IN bytes not decoded yet */
+	int zpos;
+	int zlen;
+	struct aub_stream stream[2];
+	struct aub_prefetch pf;
+	struct aub_latency lat;
+	struct aub_clock clk;
+	struct aub_recovery_stats recovery[2];
 };
 
 static libusb_context *usb_ctx = NULL;
 static struct aub_device *device_list = NULL;
 static unsigned int device_count;
+static aub_pollfd_cb_t pollfd_cb = NULL;
+static void *pollfd_user = NULL;
+static struct aub_trace trace;
+static uint32_t crc32c_table[8][256];
+static const uint8_t decode_sync[AUB_COMPRESS_SYNC_SIZE] = {DECODE_SYNC_HEADER, 0x41, 0x55, 0x42};
+static uint32_t (*crc32c_update)(uint32_t crc, const uint8_t *p, size_t len) = NULL;
+static void (*unpack12)(const uint8_t *p, int16_t *out, unsigned int count, int is_signed) = NULL;
 
 static int create_device_list(void);
 static void destroy_device_list(void);
 static int open_device(struct aub_device *adev);
 static void close_device(struct aub_device *adev);
-static inline int bulk_send(struct aub_device *adev, const unsigned char *data, uint16_t length, int *act_len);
-static inline int bulk_recv(struct aub_device *adev, unsigned char *data, uint16_t length, int *act_len);
+static inline int bulk_send(struct aub_device *adev, const unsigned char *data, int length, int *act_len, int timeout);
+static inline int bulk_recv(struct aub_device *adev, unsigned char *data, int length, int *act_len, int timeout);
 static inline int request_cfg_get(struct aub_device *adev);
 static inline int request_reg_write(struct aub_device *adev, uint16_t regaddr, uint16_t regval);
 static inline int request_reg_read(struct aub_device *adev, uint16_t regaddr, uint16_t *regval);
+static int request_reg_block(struct aub_device *adev, uint8_t type, uint16_t regaddr, uint8_t *data, int count);
+static int reg_read(struct aub_device *adev, uint16_t regaddr, uint32_t *values, int count);
+static int reg_write(struct aub_device *adev, uint16_t regaddr, const uint32_t *values, int count);
+static uint64_t time_ms(void);
+static uint64_t time_ns(void);
+static void io_defaults(struct aub_device *adev, struct aub_io_params *params);
+static int io_wait(uint64_t deadline_at, uint64_t gap_at);
+static int residue_take(struct aub_device *adev, unsigned char *pdata, int length);
+static int residue_keep(struct aub_device *adev, unsigned char *pdata, int length, int width_k);
+static int recv_packet(struct aub_device *adev, unsigned char *pdata, int length, const struct aub_io_params *params);
+static int plq_enable(struct aub_device *adev, int enable);
+static int plq_wait(struct aub_device *adev, uint32_t *lengths, uint64_t deadline_at, uint64_t gap_at);
+static int plq_recv(struct aub_device *adev, unsigned char *pdata, const uint32_t *lengths, int count);
+static int compress_enable(struct aub_device *adev, int enable);
+static int compress_recv(struct aub_device *adev, unsigned char *pdata, int length, const struct aub_io_params *params);
+static int compress_try(struct aub_device *adev, unsigned char *pdata, int length);
+static int timestamp_read(struct aub_device *adev, uint16_t regaddr, struct aub_timestamp *ts);
+static inline uint8_t pattern_next(unsigned int pattern, uint32_t history);
+static inline uint64_t load_be64(const uint8_t *p);
+static inline uint32_t load_le32(const uint8_t *p);
+static inline uint64_t load_le64(const uint8_t *p);
+static void *buf_alloc(size_t size);
+static void buf_free(void *buf);
+static int stream_pump(int timeout);
+static void *file_map(const char *path, uint64_t *size);
+static void file_unmap(void *addr, uint64_t size);
+static void file_advise(void *addr, uint64_t size, int willneed);
+static int stream_submit_in(struct aub_stream *s, struct aub_stream_xfer *sx);
+static int stream_release_in(struct aub_stream *s, struct aub_stream_buf *buf);
+static void LIBUSB_CALL stream_callback(struct libusb_transfer *xfer);
+static void LIBUSB_CALL pollfd_added(int fd, short events, void *user);
+static void LIBUSB_CALL pollfd_removed(int fd, void *user);
+static void *ring_alloc(uint64_t size, int huge, int *is_huge);
+static void ring_free(void *ring, uint64_t size, int is_huge);
+static int prefetch_submit(struct aub_prefetch *pf, struct aub_prefetch_xfer *px);
+static int prefetch_avail(struct aub_prefetch *pf, unsigned char **data);
+static void prefetch_release(struct aub_prefetch *pf, unsigned int length);
+static int prefetch_recv(struct aub_device *adev, unsigned char *pdata, int length, const struct aub_io_params *params);
+static void prefetch_sleep(void);
+static int send_credit(struct aub_device *adev, int *limit);
+static int credit_bytes(struct aub_device *adev, int64_t elements);
+static void credit_sleep(void);
+static int ep_recover(struct aub_device *adev, int chan);
+static void stream_halt(struct aub_stream *s, struct aub_stream_xfer *sx);
+static int stream_recover(struct aub_stream *s);
+static int prefetch_recover(struct aub_prefetch *pf);
+static THREAD_FN prefetch_thread(void *arg);
+static void LIBUSB_CALL prefetch_callback(struct libusb_transfer *xfer);
+static int latency_submit(struct aub_latency *lat, struct aub_latency_xfer *lx);
+static int latency_wait(struct aub_latency *lat, struct aub_latency_xfer *lx, uint64_t deadline_ns);
+static uint64_t latency_deadline(int timeout);
+static void latency_sleep(void);
+static void latency_sched(struct aub_latency *lat);
+static THREAD_FN latency_thread(void *arg);
+static int latency_recover(struct aub_latency *lat, int chan);
+static void LIBUSB_CALL latency_callback(struct libusb_transfer *xfer);
+static int buf_lock(void *buf, size_t size);
+static void buf_unlock(void *buf, size_t size);
+static int mem_command(struct aub_device *adev, uint8_t opcode, uint32_t addr, uint32_t length);
+static int mem_send(struct aub_device *adev, const unsigned char *data, unsigned int length);
+static int mem_recv(struct aub_device *adev, unsigned char *data, unsigned int length);
+static int mem_response(struct aub_device *adev, unsigned char *data, unsigned int length);
+static void crc32c_select(void);
+static uint32_t crc32c(const uint8_t *p, size_t len);
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t len);
+static int integrity_frame(struct aub_integrity *ic, const uint8_t *frame, uint8_t *out);
+static void unpack_select(void);
+static void unpack(const uint8_t *p, int16_t *out, unsigned int count, unsigned int width, int is_signed);
+static void unpack_sw(const uint8_t *p, int16_t *out, unsigned int count, unsigned int width, int is_signed);
+static void unpack12_sw(const uint8_t *p, int16_t *out, unsigned int count, int is_signed);
+static int decode_block(struct aub_decoder *dec, const uint8_t *p, unsigned int length, uint32_t *values, unsigned int *count);
+static void decode_delta(uint32_t *values, unsigned int count, uint32_t *prev);
+static void decode_store(struct aub_decoder *dec, const uint32_t *values, unsigned int count, uint8_t *out);
+static inline uint64_t trace_begin(void);
+static inline void trace_end(struct aub_device *adev, uint64_t submit_ns, int kind, int endpoint, int request, int value, int length, int actual, int status);
+static void trace_record(struct aub_device *adev, uint64_t submit_ns, int kind, int endpoint, int request, int value, int length, int actual, int status);
+static int trace_status(enum libusb_transfer_status status);
+static unsigned int trace_thread(void);
+static void trace_write_json(FILE *f, const struct aub_trace_event *ev, uint64_t id, int first);
 
 int AUB_CALL aub_init(void)
 {
@@ -141,6 +549,9 @@ void AUB_CALL aub_deinit(void)
 		libusb_exit(usb_ctx);
 		usb_ctx = NULL;
 	}
+	__atomic_store_n(&trace.enabled, 0, __ATOMIC_RELAXED);
+	free(trace.ring);
+	trace.ring = NULL;
 }
 
 int AUB_CALL aub_get_device_count(void)
@@ -169,10 +580,20 @@ int AUB_CALL aub_get_device_info(unsigned int dev_number, struct aub_device_info
 			dev_info->str.serial = (char *)adev->info.serial;
 			dev_info->config.mode = adev->cfg.mode;
 			dev_info->config.speed = adev->cfg.speed;
+			dev_info->config.timestamp = adev->cfg.tstamp;
+			dev_info->config.test = adev->cfg.test;
+			dev_info->config.mem = adev->cfg.mem;
+			dev_info->config.block = adev->cfg.block;
+			dev_info->config.frame = adev->cfg.frame;
+			dev_info->config.fill = adev->cfg.fill;
+			dev_info->config.plq = adev->cfg.plq;
+			dev_info->config.compress = adev->cfg.compress;
+			dev_info->config.tsq = adev->cfg.tsq;
 			for (int i = 0; i < 2; i++) {
 				dev_info->config.chan[i].enabled = adev->cfg.chan[i].enabled;
 				dev_info->config.chan[i].width = 8 * adev->width_k[i];
 				dev_info->config.chan[i].endianess = adev->cfg.chan[i].endianess;
+				dev_info->config.chan[i].packed = adev->cfg.chan[i].packed;
 				dev_info->config.chan[i].fifo_enabled = adev->cfg.chan[i].fifo_enabled;
 				dev_info->config.chan[i].fifo_mode = adev->cfg.chan[i].fifo_mode;
 				dev_info->config.chan[i].fifo_depth = (1 << adev->cfg.chan[i].fifo_depth);
@@ -277,233 +698,4003 @@ void AUB_CALL aub_close(aub_device_t dev)
 {
 	struct aub_device *adev = (struct aub_device *)dev;
 
-	if (adev)
+	if (adev) {
+		aub_latency_stop(dev);
+		aub_prefetch_stop(dev);
+		aub_stream_stop(dev, AUB_CHAN_IN);
+		aub_stream_stop(dev, AUB_CHAN_OUT);
 		close_device(adev);
+	}
 }
 
 int AUB_CALL aub_send(aub_device_t dev, const void *data, int length)
+{
+	return aub_send_ex(dev, data, length, NULL);
+}
+
+int AUB_CALL aub_recv(aub_device_t dev, void *data, int length)
+{
+	return aub_recv_ex(dev, data, length, NULL);
+}
+
+int AUB_CALL aub_set_mode(aub_device_t dev, int mode)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	uint32_t mcr;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if ((mode != AUB_MODE_STREAM) && (mode != AUB_MODE_PACKET))
+		return AUB_ERROR_INVALID_PARAM;
+	if (adev->stream[AUB_CHAN_IN].running || adev->stream[AUB_CHAN_OUT].running || adev->pf.running || adev->lat.running)
+		return AUB_ERROR_BUSY;
+	if (reg_read(adev, REG_MCR, &mcr, 1))
+		return AUB_ERROR_IO;
+	mcr = (mcr & (REG_MCR_BIT_FRAME | REG_MCR_BIT_COMPRESS)) | ((mode == AUB_MODE_PACKET) ? REG_MCR_BIT_PACKET : 0);
+	if (reg_write(adev, REG_MCR, &mcr, 1))
+		return AUB_ERROR_IO;
+	if (request_cfg_get(adev))
+		return AUB_ERROR_IO;
+	if (plq_enable(adev, 1))
+		return AUB_ERROR_IO;
+	/* Mode change clears the timestamp queue bit */
+	adev->tsq = 0;
+	/* Compressor is bypassed in packet mode and restarted in stream mode, data in flight is stale */
+	if ((mode == AUB_MODE_STREAM) && (mcr & REG_MCR_BIT_COMPRESS)) {
+		if (compress_enable(adev, 1))
+			return AUB_ERROR_IO;
+	} else {
+		adev->compress = 0;
+		aub_decode_init(&adev->dec, 8 * adev->width_k[AUB_CHAN_IN], adev->cfg.chan[AUB_CHAN_IN].endianess);
+		adev->zlen = 0;
+	}
+	adev->residue_len = 0;
+	io_defaults(adev, &adev->io[AUB_CHAN_IN]);
+	io_defaults(adev, &adev->io[AUB_CHAN_OUT]);
+	/* Bitstreams without mode register keep their synthesis-time mode */
+	if (adev->cfg.mode != mode)
+		return AUB_ERROR_NOT_READY;
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_send_ex(aub_device_t dev, const void *data, int length, const struct aub_io_params *params)
 {
 	const unsigned char *pdata = (const unsigned char *)data;
 	struct aub_device *adev = (struct aub_device *)dev;
-	int res, act_len, send_len, cur_len = 0;
+	uint64_t deadline_at = 0, gap_at = 0;
+	int res, act_len, send_len, timeout, credit, limit, cur_len = 0;
+	int use_credit, halts = 0;
 
+	if (!params)
+		params = &adev->io[AUB_CHAN_OUT];
 	length *= adev->width_k[AUB_CHAN_OUT];
 	if (length == 0 || length < 0)
 		return 0;
 
+	/* Bulk OUT would interleave with low-latency OUT transfers */
+	if (adev->lat.running)
+		return AUB_ERROR_BUSY;
 	if (adev->cfg.mode == AUB_MODE_PACKET) {
 		if (request_reg_write(adev, REG_TLR, length))
 			return AUB_ERROR_IO;
 	}
 
-	do {
-		send_len = (length > adev->wmaxpacketsize) ? adev->wmaxpacketsize : length;
-		res = bulk_send(adev, pdata + cur_len, send_len, &act_len);
-		act_len /= adev->width_k[AUB_CHAN_OUT];
+	if (params->deadline >= 0)
+		deadline_at = time_ms() + params->deadline + 1;
+	if (params->gap >= 0)
+		gap_at = time_ms() + params->gap + 1;
+	/* Stream mode with FIFO fill register: send only what the OUT FIFO can take */
+	use_credit = adev->cfg.fill && adev->cfg.chan[AUB_CHAN_OUT].fifo_enabled && (adev->cfg.mode == AUB_MODE_STREAM);
+
+	while (cur_len < length) {
+		timeout = io_wait(deadline_at, gap_at);
+		if (timeout == 0)
+			break;
+		send_len = length - cur_len;
+		if (use_credit) {
+			credit = send_credit(adev, &limit);
+			if (credit < 0)
+				return AUB_ERROR_IO;
+			/* Wait for a chunk, the rest of the data or a drained FIFO; gap keeps running, a stalled FIFO is no progress */
+			if ((credit < send_len) && (credit < IO_CHUNK_PACKETS * adev->wmaxpacketsize) && (credit < limit)) {
+				credit_sleep();
+				continue;
+			}
+			if (send_len > credit)
+				send_len = credit;
+		} else if (send_len > IO_CHUNK_PACKETS * adev->wmaxpacketsize) {
+			send_len = IO_CHUNK_PACKETS * adev->wmaxpacketsize;
+		}
+		res = bulk_send(adev, pdata + cur_len, send_len, &act_len, timeout);
+		cur_len += act_len;
+		if (act_len > 0)
+			halts = 0;
+		if ((act_len > 0) && (params->gap >= 0))
+			gap_at = time_ms() + params->gap + 1;
 		if (res < 0) {
-			if ((res == LIBUSB_ERROR_PIPE) || (res == LIBUSB_ERROR_TIMEOUT)) {
-				if (adev->cfg.mode == AUB_MODE_STREAM) {
-					cur_len += act_len;
-					break;
+			if (res == LIBUSB_ERROR_PIPE) {
+				/* Clear halt in place, unsent tail goes out after it */
+				if ((++halts > IO_RECOVERY_MAX) || ep_recover(adev, AUB_CHAN_OUT)) {
+					if (adev->cfg.mode == AUB_MODE_STREAM)
+						break;
+					return AUB_ERROR_IO;
 				}
-			} else {
+			} else if (res != LIBUSB_ERROR_TIMEOUT) {
 				return AUB_ERROR_IO;
 			}
 		}
-		cur_len += act_len;
-		length -= act_len;
-	} while (length > 0);
-	return cur_len;
+	}
+	return cur_len / adev->width_k[AUB_CHAN_OUT];
 }
 
-int AUB_CALL aub_recv(aub_device_t dev, void *data, int length)
+int AUB_CALL aub_recv_ex(aub_device_t dev, void *data, int length, const struct aub_io_params *params)
 {
 	unsigned char *pdata = (unsigned char *)data;
 	struct aub_device *adev = (struct aub_device *)dev;
-	uint16_t reg_data = 0;
-	int res, act_len, cur_len;
+	int width_k = adev->width_k[AUB_CHAN_IN];
+	uint64_t deadline_at = 0, gap_at = 0;
+	int res, act_len, recv_len, timeout, min_len, cur_len, halts = 0;
 
-	length *= adev->width_k[AUB_CHAN_IN];
+	if (!params)
+		params = &adev->io[AUB_CHAN_IN];
+	length *= width_k;
 	if (length == 0 || length < 0)
 		return 0;
 
-	if (adev->cfg.mode == AUB_MODE_PACKET) {
-		if (request_reg_write(adev, REG_RSR, 0))
-			return AUB_ERROR_IO;
-	}
-	cur_len = 0;
-	do {
-		res = bulk_recv(adev, pdata + cur_len, adev->wmaxpacketsize, &act_len);
-		act_len /= adev->width_k[AUB_CHAN_IN];
+	/* Submitted low-latency transfers take IN data first */
+	if (adev->lat.running)
+		return AUB_ERROR_BUSY;
+	if (adev->compress)
+		return compress_recv(adev, pdata, length, params);
+	if (adev->pf.running)
+		return prefetch_recv(adev, pdata, length, params);
+	if (adev->cfg.mode == AUB_MODE_PACKET)
+		return recv_packet(adev, pdata, length, params);
+
+	min_len = (params->min_length > 0) ? params->min_length * width_k : length;
+	if (min_len > length)
+		min_len = length;
+	if (params->deadline >= 0)
+		deadline_at = time_ms() + params->deadline + 1;
+	if (params->gap >= 0)
+		gap_at = time_ms() + params->gap + 1;
+
+	cur_len = residue_take(adev, pdata, length);
+
+	while (cur_len < min_len) {
+		timeout = io_wait(deadline_at, gap_at);
+		if (timeout == 0)
+			break;
+		/* Request whole packets, no more than needed to reach minimum */
+		recv_len = min_len - cur_len;
+		recv_len = (recv_len + adev->wmaxpacketsize - 1) / adev->wmaxpacketsize * adev->wmaxpacketsize;
+		if (recv_len > IO_CHUNK_PACKETS * adev->wmaxpacketsize)
+			recv_len = IO_CHUNK_PACKETS * adev->wmaxpacketsize;
+		if (recv_len <= length - cur_len) {
+			res = bulk_recv(adev, pdata + cur_len, recv_len, &act_len, timeout);
+			cur_len += act_len;
+		} else {
+			/* Array tail is shorter than packet, keep the rest for next call */
+			res = bulk_recv(adev, adev->residue, adev->wmaxpacketsize, &act_len, timeout);
+			recv_len = (act_len < length - cur_len) ? act_len : length - cur_len;
+			memcpy(pdata + cur_len, adev->residue, recv_len);
+			memmove(adev->residue, adev->residue + recv_len, act_len - recv_len);
+			adev->residue_len = act_len - recv_len;
+			cur_len += recv_len;
+		}
+		if (act_len > 0)
+			halts = 0;
+		if ((act_len > 0) && (params->gap >= 0))
+			gap_at = time_ms() + params->gap + 1;
 		if (res < 0) {
-			if ((res == LIBUSB_ERROR_PIPE) || (res == LIBUSB_ERROR_TIMEOUT)) {
-				if (adev->cfg.mode == AUB_MODE_STREAM) {
-					cur_len += act_len;
+			if (res == LIBUSB_ERROR_PIPE) {
+				if ((++halts > IO_RECOVERY_MAX) || ep_recover(adev, AUB_CHAN_IN))
 					break;
-				} else {
-					continue;
-				}
-			} else {
+			} else if (res != LIBUSB_ERROR_TIMEOUT) {
 				return AUB_ERROR_IO;
 			}
 		}
-		length -= act_len;
-		cur_len += act_len;
-		if (adev->cfg.mode == AUB_MODE_PACKET) {
-			if (request_reg_read(adev, REG_RSR, &reg_data))
-				return AUB_ERROR_IO;
-			if (reg_data & REG_RSR_BIT_LST)
-				return cur_len;
-		}
-	} while (length > 0);
-	if (adev->cfg.mode == AUB_MODE_PACKET)
-		return AUB_ERROR_OVERFLOW;
+	}
 
-	return cur_len;
+	return residue_keep(adev, pdata, cur_len, width_k) / width_k;
 }
 
-static int create_device_list(void)
+int AUB_CALL aub_recv_peek_len(aub_device_t dev, int timeout)
 {
-	struct libusb_device_descriptor desc;
-	libusb_device **dev_list;
-	struct aub_device *adev;
-	libusb_device *dev;
-	ssize_t dev_count;
+	struct aub_device *adev = (struct aub_device *)dev;
+	uint32_t lengths[PLQ_WINDOW];
+	uint64_t deadline_at = 0;
+	int res;
 
-	device_count = 0;
-	device_list = (struct aub_device *)malloc(sizeof(struct aub_device));
-	if (!device_list)
-		return AUB_ERROR_LOWLEVEL;
-	device_list->dev = NULL;
-	device_list->hdev = NULL;
-	INIT_LIST_HEAD(&device_list->list);
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!adev->plq)
+		return AUB_ERROR_NOT_READY;
+	if (timeout >= 0)
+		deadline_at = time_ms() + timeout + 1;
+	res = plq_wait(adev, lengths, deadline_at, 0);
+	if (res < 0)
+		return res;
+	return (int)(lengths[0] / adev->width_k[AUB_CHAN_IN]);
+}
 
-	dev_count = libusb_get_device_list(usb_ctx, &dev_list);
-	if (dev_count < 0)
-		return AUB_ERROR_LOWLEVEL;
+int AUB_CALL aub_recv_packets(aub_device_t dev, void *data, int length, int *lengths, int count)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	const struct aub_io_params *params;
+	uint32_t queued[PLQ_WINDOW];
+	uint64_t deadline_at = 0, gap_at = 0, len = 0;
+	int res, n;
 
-	for (int i = 0; i < dev_count; i++) {
-		if ((dev = dev_list[i]) == NULL)
-			break;
-		if (libusb_get_device_descriptor(dev, &desc) < 0)
-			continue;
-		if ((desc.idVendor == VENDOR_ID) && (desc.idProduct == PRODUCT_ID)) {
-			adev = (struct aub_device *)malloc(sizeof(struct aub_device));
-			if (!adev) {
-				libusb_free_device_list(dev_list, 1);
-				return AUB_ERROR_LOWLEVEL;
-			}
-			adev->dev = dev;
-			adev->hdev = NULL;
-			adev->devnum = device_count++;
-			adev->busnum = libusb_get_bus_number(dev);
-			adev->devaddr = libusb_get_device_address(dev);
-			open_device(adev);
-			close_device(adev);
-			list_add_tail(&adev->list, &device_list->list);
-		}
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!data || !lengths)
+		return AUB_ERROR_INVALID_PARAM;
+	if (!adev->plq)
+		return AUB_ERROR_NOT_READY;
+	length *= adev->width_k[AUB_CHAN_IN];
+	if (length <= 0 || count <= 0)
+		return 0;
+
+	params = &adev->io[AUB_CHAN_IN];
+	if (params->deadline >= 0)
+		deadline_at = time_ms() + params->deadline + 1;
+	if (params->gap >= 0)
+		gap_at = time_ms() + params->gap + 1;
+	res = plq_wait(adev, queued, deadline_at, gap_at);
+	if (res < 0)
+		return res;
+	if (res > count)
+		res = count;
+	/* Take queued packets while they fit, a packet that does not fit stays queued */
+	for (n = 0; (n < res) && (len + queued[n] <= (uint64_t)length); n++) {
+		len += queued[n];
+		lengths[n] = (int)(queued[n] / adev->width_k[AUB_CHAN_IN]);
 	}
-	libusb_free_device_list(dev_list, 0);
-	return AUB_SUCCESS;
+	if (n == 0)
+		return AUB_ERROR_OVERFLOW;
+	res = plq_recv(adev, (unsigned char *)data, queued, n);
+	return res ? res : n;
 }
 
-static void destroy_device_list(void)
+int AUB_CALL aub_set_io_params(aub_device_t dev, int chan, const struct aub_io_params *params)
 {
-	struct list_head *pos, *q;
-	struct aub_device *adev;
+	struct aub_device *adev = (struct aub_device *)dev;
 
-	if (!device_list)
-		return;
-	list_for_each_safe(pos, q, &device_list->list) {
-		adev = list_entry(pos, struct aub_device, list);
-		list_del(pos);
-		close_device(adev);
-		free(adev);
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if ((chan != AUB_CHAN_IN) && (chan != AUB_CHAN_OUT))
+		return AUB_ERROR_INVALID_PARAM;
+	if (params) {
+		if (params->min_length < 0)
+			return AUB_ERROR_INVALID_PARAM;
+		adev->io[chan] = *params;
+	} else {
+		io_defaults(adev, &adev->io[chan]);
 	}
-	device_count = 0;
-	free(device_list);
+	return AUB_SUCCESS;
 }
 
-static int open_device(struct aub_device *adev)
+int AUB_CALL aub_get_io_params(aub_device_t dev, int chan, struct aub_io_params *params)
 {
-	if (adev->hdev)
+	struct aub_device *adev = (struct aub_device *)dev;
+
+	if (!adev || !adev->hdev)
 		return AUB_ERROR_NOT_INITIALIZED;
-	if (libusb_open(adev->dev, &adev->hdev)) {
-		return AUB_ERROR_LOWLEVEL;
+	if ((chan != AUB_CHAN_IN) && (chan != AUB_CHAN_OUT))
+		return AUB_ERROR_INVALID_PARAM;
+	*params = adev->io[chan];
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_stream_start(aub_device_t dev, int chan, const struct aub_stream_config *cfg)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_stream *s;
+	struct aub_stream_xfer *sx;
+	struct aub_stream_buf *buf;
+	int res;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if ((chan != AUB_CHAN_IN) && (chan != AUB_CHAN_OUT))
+		return AUB_ERROR_INVALID_PARAM;
+	s = &adev->stream[chan];
+	if (s->running || ((chan == AUB_CHAN_IN) && adev->pf.running) || adev->lat.running)
+		return AUB_ERROR_BUSY;
+	/* Stream buffers are handed out as they are, compressed data would pass undecoded */
+	if ((chan == AUB_CHAN_IN) && adev->compress)
+		return AUB_ERROR_NOT_READY;
+	/* Stream does not pop packet lengths, queue would fill up and stall IN */
+	if ((chan == AUB_CHAN_IN) && adev->plq && plq_enable(adev, 0))
+		return AUB_ERROR_IO;
+
+	memset(s, 0, sizeof(struct aub_stream));
+	s->adev = adev;
+	s->chan = chan;
+	if (cfg) {
+		s->cfg = *cfg;
 	} else {
-		libusb_reset_device(adev->hdev);
-		libusb_get_device_descriptor(adev->dev, &adev->desc);
-		libusb_get_string_descriptor_ascii(adev->hdev, adev->desc.iManufacturer, adev->info.manufacturer, INFO_SIZE);
-		libusb_get_string_descriptor_ascii(adev->hdev, adev->desc.iProduct, adev->info.product, INFO_SIZE);
-		libusb_get_string_descriptor_ascii(adev->hdev, adev->desc.iSerialNumber, adev->info.serial, INFO_SIZE);
-		libusb_claim_interface(adev->hdev, 0);
-		if (request_cfg_get(adev)) {
-			close_device(adev);
-			return AUB_ERROR_IO;
-		}
-		for (int i = 0; i < 2; i++) {
-			switch (adev->cfg.chan[i].width) {
-			case DATA_WIDTH_NONE:
-				adev->width_k[i] = 0;
-				break;
-			case DATA_WIDTH_8:
-				adev->width_k[i] = 1;
-				break;
-			case DATA_WIDTH_16:
-				adev->width_k[i] = 2;
-				break;
-			case DATA_WIDTH_32:
-				adev->width_k[i] = 4;
-				break;
+		s->cfg.transfer_size = STREAM_TRANSFER_SIZE;
+		s->cfg.transfer_count = STREAM_TRANSFER_COUNT;
+		s->cfg.buffer_count = STREAM_BUFFER_COUNT;
+		s->cfg.timeout = STREAM_TIMEOUT;
+	}
+	if (s->cfg.transfer_count == 0)
+		return AUB_ERROR_INVALID_PARAM;
+	if (chan == AUB_CHAN_IN) {
+		if ((s->cfg.transfer_size == 0) || (s->cfg.transfer_size % adev->wmaxpacketsize))
+			return AUB_ERROR_INVALID_PARAM;
+		if (s->cfg.buffer_count < s->cfg.transfer_count)
+			s->cfg.buffer_count = s->cfg.transfer_count;
+	} else {
+		s->cfg.buffer_count = 0;
+	}
+
+	INIT_LIST_HEAD(&s->buf_free);
+	INIT_LIST_HEAD(&s->buf_ready);
+	INIT_LIST_HEAD(&s->xfer_idle);
+	INIT_LIST_HEAD(&s->xfer_halted);
+	s->xfers = (struct aub_stream_xfer *)calloc(s->cfg.transfer_count, sizeof(struct aub_stream_xfer));
+	if (s->cfg.buffer_count)
+		s->bufs = (struct aub_stream_buf *)calloc(s->cfg.buffer_count, sizeof(struct aub_stream_buf));
+	if (!s->xfers || (s->cfg.buffer_count && !s->bufs))
+		goto err_alloc;
+	for (unsigned int i = 0; i < s->cfg.transfer_count; i++) {
+		sx = &s->xfers[i];
+		sx->stream = s;
+		sx->xfer = libusb_alloc_transfer(0);
+		if (!sx->xfer)
+			goto err_alloc;
+		list_add_tail(&sx->list, &s->xfer_idle);
+	}
+	for (unsigned int i = 0; i < s->cfg.buffer_count; i++) {
+		buf = &s->bufs[i];
+		buf->data = (unsigned char *)buf_alloc(s->cfg.transfer_size);
+		if (!buf->data)
+			goto err_alloc;
+		list_add_tail(&buf->list, &s->buf_free);
+	}
+	lock_init(&s->lock);
+	s->stats.inflight_min = s->cfg.transfer_count;
+	s->running = 1;
+
+	if (chan == AUB_CHAN_IN) {
+		lock_get(&s->lock);
+		while (!list_empty(&s->xfer_idle)) {
+			sx = list_entry(s->xfer_idle.next, struct aub_stream_xfer, list);
+			list_del(&sx->list);
+			sx->buf = list_entry(s->buf_free.next, struct aub_stream_buf, list);
+			list_del(&sx->buf->list);
+			res = stream_submit_in(s, sx);
+			if (res) {
+				lock_put(&s->lock);
+				aub_stream_stop(dev, chan);
+				return res;
 			}
 		}
-		adev->wmaxpacketsize = adev->cfg.speed ? PACKETSIZE_HS : PACKETSIZE_FS;
+		lock_put(&s->lock);
 	}
 	return AUB_SUCCESS;
-}
 
-static void close_device(struct aub_device *adev)
-{
-	if (adev->hdev) {
-		libusb_release_interface(adev->hdev, 0);
-		libusb_close(adev->hdev);
-		adev->hdev = NULL;
+err_alloc:
+	for (unsigned int i = 0; s->xfers && (i < s->cfg.transfer_count); i++) {
+		if (s->xfers[i].xfer)
+			libusb_free_transfer(s->xfers[i].xfer);
 	}
+	for (unsigned int i = 0; s->bufs && (i < s->cfg.buffer_count); i++)
+		buf_free(s->bufs[i].data);
+	free(s->xfers);
+	free(s->bufs);
+	s->xfers = NULL;
+	s->bufs = NULL;
+	return AUB_ERROR_LOWLEVEL;
 }
 
-static inline int bulk_send(struct aub_device *adev, const unsigned char *data, uint16_t length, int *act_len)
+void AUB_CALL aub_stream_stop(aub_device_t dev, int chan)
 {
-	return libusb_bulk_transfer(adev->hdev, BULK_ENDPOINT_OUT, (unsigned char *)data, length, act_len, TIMEOUT);
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_stream *s;
+	unsigned int inflight;
+
+	if (!adev || ((chan != AUB_CHAN_IN) && (chan != AUB_CHAN_OUT)))
+		return;
+	s = &adev->stream[chan];
+	if (!s->running)
+		return;
+
+	lock_get(&s->lock);
+	s->running = 0;
+	for (unsigned int i = 0; i < s->cfg.transfer_count; i++) {
+		if (s->xfers[i].active)
+			libusb_cancel_transfer(s->xfers[i].xfer);
+	}
+	lock_put(&s->lock);
+
+	/* Cancelled transfers own their buffers until reaped, however long that takes */
+	for (;;) {
+		lock_get(&s->lock);
+		inflight = s->stats.inflight;
+		lock_put(&s->lock);
+		if (inflight == 0)
+			break;
+		if (stream_pump(STREAM_TIMEOUT)) {
+			/* Event loop failed: leak rather than free buffers libusb may still own */
+			s->xfers = NULL;
+			s->bufs = NULL;
+			s->cur = NULL;
+			return;
+		}
+	}
+
+	for (unsigned int i = 0; i < s->cfg.transfer_count; i++) {
+		libusb_free_transfer(s->xfers[i].xfer);
+		buf_free(s->xfers[i].bounce);
+	}
+	for (unsigned int i = 0; i < s->cfg.buffer_count; i++)
+		buf_free(s->bufs[i].data);
+	free(s->xfers);
+	free(s->bufs);
+	s->xfers = NULL;
+	s->bufs = NULL;
+	s->cur = NULL;
+	lock_destroy(&s->lock);
 }
 
-static inline int bulk_recv(struct aub_device *adev, unsigned char *data, uint16_t length, int *act_len)
+int AUB_CALL aub_stream_get(aub_device_t dev, void **data, int timeout)
 {
-	return libusb_bulk_transfer(adev->hdev, BULK_ENDPOINT_IN, data, length, act_len, TIMEOUT);
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_stream *s;
+	struct aub_stream_buf *buf;
+	uint64_t deadline = 0;
+	int remain, error;
+
+	if (!adev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	s = &adev->stream[AUB_CHAN_IN];
+	if (!s->running)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (timeout > 0)
+		deadline = time_ms() + timeout;
+
+	for (;;) {
+		if (stream_recover(s))
+			return AUB_ERROR_IO;
+		lock_get(&s->lock);
+		if (!list_empty(&s->buf_ready)) {
+			buf = list_entry(s->buf_ready.next, struct aub_stream_buf, list);
+			list_del(&buf->list);
+			s->stats.ready--;
+			lock_put(&s->lock);
+			*data = buf->data;
+			return buf->length;
+		}
+		error = s->error;
+		lock_put(&s->lock);
+		if (error)
+			return AUB_ERROR_IO;
+		if (timeout < 0) {
+			remain = STREAM_TIMEOUT;
+		} else if (timeout == 0) {
+			remain = 0;
+		} else {
+			if (time_ms() >= deadline)
+				return AUB_ERROR_TIMEOUT;
+			remain = (int)(deadline - time_ms());
+		}
+		if (stream_pump(remain))
+			return AUB_ERROR_LOWLEVEL;
+		if (timeout == 0) {
+			lock_get(&s->lock);
+			error = list_empty(&s->buf_ready);
+			lock_put(&s->lock);
+			if (error)
+				return AUB_ERROR_TIMEOUT;
+		}
+	}
 }
 
-static inline int request_reg_read(struct aub_device *adev, uint16_t regaddr, uint16_t *regval)
+int AUB_CALL aub_stream_put(aub_device_t dev, void *data)
 {
-	int res = libusb_control_transfer(adev->hdev, REQUEST_TYPE_IN, REQUEST_REG_OPER, regaddr, 0, (uint8_t *)regval, sizeof(uint16_t), TIMEOUT);
-	if (res == sizeof(uint16_t))
-		return AUB_SUCCESS;
-	else
-		return AUB_ERROR_IO;
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_stream *s;
+	struct aub_stream_buf *buf = NULL;
+
+	if (!adev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	s = &adev->stream[AUB_CHAN_IN];
+	if (!s->running)
+		return AUB_ERROR_NOT_INITIALIZED;
+	for (unsigned int i = 0; i < s->cfg.buffer_count; i++) {
+		if (s->bufs[i].data == (unsigned char *)data) {
+			buf = &s->bufs[i];
+			break;
+		}
+	}
+	if (!buf)
+		return AUB_ERROR_INVALID_PARAM;
+	return stream_release_in(s, buf);
+}
+
+int AUB_CALL aub_stream_submit(aub_device_t dev, const void *data, int length, int timeout)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_stream *s;
+	struct aub_stream_xfer *sx;
+	uint64_t deadline = 0;
+	int res, remain;
+
+	if (!adev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	s = &adev->stream[AUB_CHAN_OUT];
+	if (!s->running)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (adev->cfg.mode == AUB_MODE_PACKET)
+		return AUB_ERROR_NOT_READY;
+	if (length <= 0)
+		return AUB_ERROR_INVALID_PARAM;
+	if (timeout > 0)
+		deadline = time_ms() + timeout;
+
+	for (;;) {
+		if (stream_recover(s))
+			return AUB_ERROR_IO;
+		lock_get(&s->lock);
+		if (s->error) {
+			lock_put(&s->lock);
+			return AUB_ERROR_IO;
+		}
+		if (!list_empty(&s->xfer_idle) && !s->halted) {
+			sx = list_entry(s->xfer_idle.next, struct aub_stream_xfer, list);
+			list_del(&sx->list);
+			libusb_fill_bulk_transfer(sx->xfer, adev->hdev, BULK_ENDPOINT_OUT, (unsigned char *)data, length, stream_callback, sx, 0);
+			sx->seq = s->seq++;
+			sx->submit_ns = trace_begin();
+			res = libusb_submit_transfer(sx->xfer);
+			if (res) {
+				list_add_tail(&sx->list, &s->xfer_idle);
+				s->stats.errors++;
+				lock_put(&s->lock);
+				return AUB_ERROR_IO;
+			}
+			sx->active = 1;
+			s->stats.inflight++;
+			lock_put(&s->lock);
+			return AUB_SUCCESS;
+		}
+		lock_put(&s->lock);
+		if (timeout < 0) {
+			remain = STREAM_TIMEOUT;
+		} else if (timeout == 0) {
+			return AUB_ERROR_TIMEOUT;
+		} else {
+			if (time_ms() >= deadline)
+				return AUB_ERROR_TIMEOUT;
+			remain = (int)(deadline - time_ms());
+		}
+		if (stream_pump(remain))
+			return AUB_ERROR_LOWLEVEL;
+	}
+}
+
+int AUB_CALL aub_stream_flush(aub_device_t dev, int timeout)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_stream *s;
+	uint64_t deadline = 0;
+	unsigned int inflight;
+	int error;
+
+	if (!adev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	s = &adev->stream[AUB_CHAN_OUT];
+	if (!s->running)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (timeout >= 0)
+		deadline = time_ms() + timeout;
+
+	for (;;) {
+		if (stream_recover(s))
+			return AUB_ERROR_IO;
+		lock_get(&s->lock);
+		/* Tails waiting for halt clear count as in flight */
+		inflight = s->stats.inflight + !list_empty(&s->xfer_halted);
+		error = s->error;
+		lock_put(&s->lock);
+		if (inflight == 0)
+			return error ? AUB_ERROR_IO : AUB_SUCCESS;
+		if ((timeout >= 0) && (time_ms() >= deadline))
+			return AUB_ERROR_TIMEOUT;
+		if (stream_pump(timeout < 0 ? STREAM_TIMEOUT : (int)(deadline - time_ms())))
+			return AUB_ERROR_LOWLEVEL;
+	}
+}
+
+int AUB_CALL aub_stream_get_stats(aub_device_t dev, int chan, struct aub_stream_stats *stats)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_stream *s;
+
+	if (!adev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if ((chan != AUB_CHAN_IN) && (chan != AUB_CHAN_OUT))
+		return AUB_ERROR_INVALID_PARAM;
+	s = &adev->stream[chan];
+	if (!s->running)
+		return AUB_ERROR_NOT_INITIALIZED;
+	lock_get(&s->lock);
+	*stats = s->stats;
+	lock_put(&s->lock);
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_prefetch_start(aub_device_t dev, const struct aub_prefetch_config *cfg)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_prefetch *pf;
+	struct aub_prefetch_xfer *px;
+	uint64_t size;
+	int huge;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	pf = &adev->pf;
+	if (pf->running || adev->stream[AUB_CHAN_IN].running || adev->lat.running)
+		return AUB_ERROR_BUSY;
+	/* Ring holds a byte stream, packet boundaries are not kept */
+	if (adev->cfg.mode == AUB_MODE_PACKET)
+		return AUB_ERROR_NOT_READY;
+
+	memset(pf, 0, sizeof(struct aub_prefetch));
+	pf->adev = adev;
+	if (cfg) {
+		pf->cfg = *cfg;
+	} else {
+		pf->cfg.ring_size = PREFETCH_RING_SIZE;
+		pf->cfg.transfer_size = STREAM_TRANSFER_SIZE;
+		pf->cfg.transfer_count = STREAM_TRANSFER_COUNT;
+		pf->cfg.timeout = STREAM_TIMEOUT;
+	}
+	if ((pf->cfg.transfer_count == 0) || (pf->cfg.transfer_size == 0) || (pf->cfg.transfer_size % adev->wmaxpacketsize))
+		return AUB_ERROR_INVALID_PARAM;
+	size = (pf->cfg.ring_size + pf->cfg.transfer_size - 1) / pf->cfg.transfer_size * pf->cfg.transfer_size;
+	if (pf->cfg.huge_pages)
+		size = (size + PREFETCH_HUGE_SIZE - 1) / PREFETCH_HUGE_SIZE * PREFETCH_HUGE_SIZE;
+	pf->nslots = size / pf->cfg.transfer_size;
+	if (pf->nslots < 2 * (uint64_t)pf->cfg.transfer_count)
+		return AUB_ERROR_INVALID_PARAM;
+
+	pf->ring_size = size;
+	pf->ring = (unsigned char *)ring_alloc(size, pf->cfg.huge_pages, &huge);
+	pf->stats.huge_pages = huge;
+	pf->slot_len = (unsigned int *)calloc(pf->nslots, sizeof(unsigned int));
+	pf->scratch = (unsigned char *)buf_alloc(pf->cfg.transfer_size);
+	pf->xfers = (struct aub_prefetch_xfer *)calloc(pf->cfg.transfer_count, sizeof(struct aub_prefetch_xfer));
+	if (!pf->ring || !pf->slot_len || !pf->scratch || !pf->xfers)
+		goto err_alloc;
+	for (unsigned int i = 0; i < pf->cfg.transfer_count; i++) {
+		px = &pf->xfers[i];
+		px->pf = pf;
+		px->xfer = libusb_alloc_transfer(0);
+		if (!px->xfer)
+			goto err_alloc;
+	}
+	lock_init(&pf->lock);
+	pf->running = 1;
+
+	lock_get(&pf->lock);
+	for (unsigned int i = 0; (i < pf->cfg.transfer_count) && !pf->error; i++)
+		prefetch_submit(pf, &pf->xfers[i]);
+	lock_put(&pf->lock);
+	if (pf->error || thread_create(&pf->thread, prefetch_thread, pf)) {
+		/* Nobody handles events yet: cancel and reap in place */
+		lock_get(&pf->lock);
+		pf->running = 0;
+		for (unsigned int i = 0; i < pf->cfg.transfer_count; i++) {
+			if (pf->xfers[i].active)
+				libusb_cancel_transfer(pf->xfers[i].xfer);
+		}
+		lock_put(&pf->lock);
+		while (ring_load(&pf->inflight) && !stream_pump(STREAM_TIMEOUT))
+			;
+		lock_destroy(&pf->lock);
+		goto err_alloc;
+	}
+	return AUB_SUCCESS;
+
+err_alloc:
+	for (unsigned int i = 0; pf->xfers && (i < pf->cfg.transfer_count); i++) {
+		if (pf->xfers[i].xfer)
+			libusb_free_transfer(pf->xfers[i].xfer);
+	}
+	free(pf->xfers);
+	free(pf->slot_len);
+	buf_free(pf->scratch);
+	if (pf->ring)
+		ring_free(pf->ring, pf->ring_size, huge);
+	memset(pf, 0, sizeof(struct aub_prefetch));
+	return AUB_ERROR_LOWLEVEL;
+}
+
+void AUB_CALL aub_prefetch_stop(aub_device_t dev)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_prefetch *pf;
+
+	if (!adev)
+		return;
+	pf = &adev->pf;
+	if (!pf->running)
+		return;
+
+	lock_get(&pf->lock);
+	pf->running = 0;
+	for (unsigned int i = 0; i < pf->cfg.transfer_count; i++) {
+		if (pf->xfers[i].active)
+			libusb_cancel_transfer(pf->xfers[i].xfer);
+	}
+	lock_put(&pf->lock);
+	/* Thread exits once last cancelled transfer is reaped */
+	thread_join(pf->thread);
+
+	for (unsigned int i = 0; i < pf->cfg.transfer_count; i++)
+		libusb_free_transfer(pf->xfers[i].xfer);
+	free(pf->xfers);
+	free(pf->slot_len);
+	buf_free(pf->scratch);
+	ring_free(pf->ring, pf->ring_size, pf->stats.huge_pages);
+	lock_destroy(&pf->lock);
+	pf->xfers = NULL;
+	pf->slot_len = NULL;
+	pf->scratch = NULL;
+	pf->ring = NULL;
+}
+
+int AUB_CALL aub_prefetch_peek(aub_device_t dev, void **data, int timeout)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_prefetch *pf;
+	unsigned char *ptr;
+	uint64_t deadline = 0;
+	int len;
+
+	if (!adev || !data)
+		return AUB_ERROR_NOT_INITIALIZED;
+	pf = &adev->pf;
+	if (!pf->running)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (timeout > 0)
+		deadline = time_ms() + timeout;
+
+	for (;;) {
+		len = prefetch_avail(pf, &ptr);
+		if (len > 0) {
+			*data = ptr;
+			return len;
+		}
+		if (ring_load(&pf->error))
+			return AUB_ERROR_IO;
+		if ((timeout == 0) || ((timeout > 0) && (time_ms() >= deadline)))
+			return AUB_ERROR_TIMEOUT;
+		prefetch_sleep();
+	}
+}
+
+int AUB_CALL aub_prefetch_consume(aub_device_t dev, int length)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_prefetch *pf;
+	unsigned char *ptr;
+
+	if (!adev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	pf = &adev->pf;
+	if (!pf->running)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if ((length < 0) || (length > prefetch_avail(pf, &ptr)))
+		return AUB_ERROR_INVALID_PARAM;
+	prefetch_release(pf, length);
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_prefetch_get_stats(aub_device_t dev, struct aub_prefetch_stats *stats)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_prefetch *pf;
+
+	if (!adev || !stats)
+		return AUB_ERROR_NOT_INITIALIZED;
+	pf = &adev->pf;
+	if (!pf->running)
+		return AUB_ERROR_NOT_INITIALIZED;
+	lock_get(&pf->lock);
+	*stats = pf->stats;
+	lock_put(&pf->lock);
+	stats->fill = stats->bytes - ring_load(&pf->bytes_out);
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_latency_start(aub_device_t dev, const struct aub_latency_config *cfg)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_latency *lat;
+	struct aub_latency_xfer *lx;
+	unsigned int count;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	lat = &adev->lat;
+	if (lat->running || adev->stream[AUB_CHAN_IN].running || adev->stream[AUB_CHAN_OUT].running || adev->pf.running)
+		return AUB_ERROR_BUSY;
+	/* Packet mode needs a TLR write per OUT message and a length read per IN message */
+	if ((adev->cfg.mode == AUB_MODE_PACKET) || adev->compress)
+		return AUB_ERROR_NOT_READY;
+
+	memset(lat, 0, sizeof(struct aub_latency));
+	lat->adev = adev;
+	if (cfg) {
+		lat->cfg = *cfg;
+	} else {
+		lat->cfg.transfer_size = adev->wmaxpacketsize;
+		lat->cfg.transfer_count = LATENCY_TRANSFER_COUNT;
+	}
+	count = lat->cfg.transfer_count;
+	if ((count == 0) || (lat->cfg.transfer_size == 0) || (lat->cfg.transfer_size % adev->wmaxpacketsize))
+		return AUB_ERROR_INVALID_PARAM;
+
+	/* Everything the data path touches is allocated and locked up front */
+	lat->buf_size = 2 * (size_t)count * lat->cfg.transfer_size;
+	lat->buf = (unsigned char *)buf_alloc(lat->buf_size);
+	lat->xfers = (struct aub_latency_xfer *)calloc(2 * count, sizeof(struct aub_latency_xfer));
+	if (!lat->buf || !lat->xfers)
+		goto err_alloc;
+	memset(lat->buf, 0, lat->buf_size);
+	lat->stats.locked = !buf_lock(lat->buf, lat->buf_size);
+	lat->stats.locked &= !buf_lock(lat->xfers, 2 * count * sizeof(struct aub_latency_xfer));
+	for (unsigned int i = 0; i < 2 * count; i++) {
+		lx = &lat->xfers[i];
+		lx->lat = lat;
+		lx->data = lat->buf + (size_t)i * lat->cfg.transfer_size;
+		lx->xfer = libusb_alloc_transfer(0);
+		if (!lx->xfer)
+			goto err_alloc;
+		/* IN waits for data as long as it takes, OUT is free until first used */
+		libusb_fill_bulk_transfer(lx->xfer, adev->hdev, (i < count) ? BULK_ENDPOINT_IN : BULK_ENDPOINT_OUT, lx->data, lat->cfg.transfer_size, latency_callback, lx, 0);
+		lx->done = (i >= count);
+	}
+	lock_init(&lat->lock);
+	lat->running = 1;
+
+	lock_get(&lat->lock);
+	for (unsigned int i = 0; i < count; i++) {
+		if (latency_submit(lat, &lat->xfers[i]))
+			break;
+	}
+	lock_put(&lat->lock);
+	if (lat->stats.errors || (lat->cfg.thread && thread_create(&lat->thread, latency_thread, lat))) {
+		/* Nobody handles events yet: cancel and reap in place */
+		lock_get(&lat->lock);
+		lat->running = 0;
+		for (unsigned int i = 0; i < count; i++) {
+			if (lat->xfers[i].active)
+				libusb_cancel_transfer(lat->xfers[i].xfer);
+		}
+		lock_put(&lat->lock);
+		while (ring_load(&lat->inflight) && !stream_pump(STREAM_TIMEOUT))
+			;
+		lock_destroy(&lat->lock);
+		goto err_alloc;
+	}
+	if (lat->cfg.thread)
+		latency_sched(lat);
+	return AUB_SUCCESS;
+
+err_alloc:
+	for (unsigned int i = 0; lat->xfers && (i < 2 * count); i++) {
+		if (lat->xfers[i].xfer)
+			libusb_free_transfer(lat->xfers[i].xfer);
+	}
+	if (lat->buf)
+		buf_unlock(lat->buf, lat->buf_size);
+	if (lat->xfers)
+		buf_unlock(lat->xfers, 2 * count * sizeof(struct aub_latency_xfer));
+	free(lat->xfers);
+	buf_free(lat->buf);
+	memset(lat, 0, sizeof(struct aub_latency));
+	return AUB_ERROR_LOWLEVEL;
+}
+
+void AUB_CALL aub_latency_stop(aub_device_t dev)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_latency *lat;
+	unsigned int count;
+
+	if (!adev)
+		return;
+	lat = &adev->lat;
+	if (!lat->running)
+		return;
+	count = lat->cfg.transfer_count;
+
+	lock_get(&lat->lock);
+	ring_store(&lat->running, 0);
+	for (unsigned int i = 0; i < 2 * count; i++) {
+		if (lat->xfers[i].active)
+			libusb_cancel_transfer(lat->xfers[i].xfer);
+	}
+	lock_put(&lat->lock);
+	/* Thread exits once last cancelled transfer is reaped, otherwise reap here */
+	if (lat->cfg.thread) {
+		thread_join(lat->thread);
+	} else {
+		while (ring_load(&lat->inflight) && !stream_pump(STREAM_TIMEOUT))
+			;
+	}
+	for (int chan = 0; chan < 2; chan++) {
+		if (lat->halted & (1 << chan))
+			ep_recover(adev, chan);
+	}
+
+	for (unsigned int i = 0; i < 2 * count; i++)
+		libusb_free_transfer(lat->xfers[i].xfer);
+	buf_unlock(lat->buf, lat->buf_size);
+	buf_unlock(lat->xfers, 2 * count * sizeof(struct aub_latency_xfer));
+	free(lat->xfers);
+	buf_free(lat->buf);
+	lock_destroy(&lat->lock);
+	lat->xfers = NULL;
+	lat->buf = NULL;
+}
+
+int AUB_CALL aub_latency_send(aub_device_t dev, const void *data, int length, int timeout)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_latency *lat;
+	struct aub_latency_xfer *lx;
+	int res;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	lat = &adev->lat;
+	if (!lat->running)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!data || (length < 0) || ((unsigned int)length * adev->width_k[AUB_CHAN_OUT] > lat->cfg.transfer_size))
+		return AUB_ERROR_INVALID_PARAM;
+	if (latency_recover(lat, AUB_CHAN_OUT))
+		return AUB_ERROR_IO;
+
+	/* OUT transfers are reused in turn, the oldest one must have completed */
+	lx = &lat->xfers[lat->cfg.transfer_count + lat->out_next % lat->cfg.transfer_count];
+	res = latency_wait(lat, lx, latency_deadline(timeout));
+	if (res)
+		return res;
+	/* Failed earlier message is reported once, by the call that reuses its transfer; this one is not sent */
+	if (lx->xfer->status != LIBUSB_TRANSFER_COMPLETED) {
+		lx->xfer->status = LIBUSB_TRANSFER_COMPLETED;
+		return AUB_ERROR_IO;
+	}
+	memcpy(lx->data, data, length * adev->width_k[AUB_CHAN_OUT]);
+	lx->xfer->length = length * adev->width_k[AUB_CHAN_OUT];
+	lock_get(&lat->lock);
+	res = lat->running ? latency_submit(lat, lx) : AUB_ERROR_NOT_INITIALIZED;
+	lock_put(&lat->lock);
+	if (res)
+		return res;
+	lat->out_next++;
+	return length;
+}
+
+int AUB_CALL aub_latency_recv(aub_device_t dev, void *data, int length, int timeout)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_latency *lat;
+	struct aub_latency_xfer *lx;
+	int res, len;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	lat = &adev->lat;
+	if (!lat->running)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!data || (length < 0))
+		return AUB_ERROR_INVALID_PARAM;
+
+	/* Transfers complete in submission order, so messages are taken in that order too */
+	lx = &lat->xfers[lat->in_next % lat->cfg.transfer_count];
+	res = latency_wait(lat, lx, latency_deadline(timeout));
+	if (res)
+		return res;
+	if (lx->xfer->status == LIBUSB_TRANSFER_COMPLETED) {
+		len = lx->xfer->actual_length;
+		if (len > length * adev->width_k[AUB_CHAN_IN])
+			return AUB_ERROR_OVERFLOW;
+		memcpy(data, lx->data, len);
+	} else {
+		/* Message is lost: clear a halt and put the transfer back, so the next call takes the next one */
+		if (latency_recover(lat, AUB_CHAN_IN))
+			return AUB_ERROR_IO;
+		len = AUB_ERROR_IO;
+	}
+	lat->in_next++;
+	lock_get(&lat->lock);
+	res = lat->running ? latency_submit(lat, lx) : AUB_SUCCESS;
+	lock_put(&lat->lock);
+	if (res)
+		return res;
+	return (len < 0) ? len : len / adev->width_k[AUB_CHAN_IN];
+}
+
+int AUB_CALL aub_latency_get_stats(aub_device_t dev, struct aub_latency_stats *stats)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_latency *lat;
+
+	if (!adev || !stats)
+		return AUB_ERROR_NOT_INITIALIZED;
+	lat = &adev->lat;
+	if (!lat->running)
+		return AUB_ERROR_NOT_INITIALIZED;
+	lock_get(&lat->lock);
+	*stats = lat->stats;
+	lock_put(&lat->lock);
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_try_send(aub_device_t dev, const void *data, int length)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_stream *s;
+	struct aub_stream_xfer *sx = NULL;
+	unsigned int size;
+	int res, width_k;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	/* Packet length is written to TLR by aub_send() only */
+	if (adev->cfg.mode == AUB_MODE_PACKET)
+		return AUB_ERROR_NOT_READY;
+	s = &adev->stream[AUB_CHAN_OUT];
+	if (!s->running) {
+		res = aub_stream_start(dev, AUB_CHAN_OUT, NULL);
+		if (res)
+			return res;
+	}
+	width_k = adev->width_k[AUB_CHAN_OUT];
+	length *= width_k;
+	if (length == 0 || length < 0)
+		return 0;
+	size = s->cfg.transfer_size ? s->cfg.transfer_size : STREAM_TRANSFER_SIZE;
+	if ((unsigned int)length > size)
+		length = size / width_k * width_k;
+
+	for (int i = 0; i < 2; i++) {
+		if (stream_recover(s))
+			return AUB_ERROR_IO;
+		lock_get(&s->lock);
+		if (s->error) {
+			lock_put(&s->lock);
+			return AUB_ERROR_IO;
+		}
+		if (!list_empty(&s->xfer_idle) && !s->halted) {
+			sx = list_entry(s->xfer_idle.next, struct aub_stream_xfer, list);
+			list_del(&sx->list);
+		}
+		lock_put(&s->lock);
+		if (sx || i)
+			break;
+		if (stream_pump(0))
+			return AUB_ERROR_LOWLEVEL;
+	}
+	if (!sx)
+		return AUB_ERROR_NOT_READY;
+
+	if (!sx->bounce)
+		sx->bounce = (unsigned char *)buf_alloc(size);
+	lock_get(&s->lock);
+	if (!sx->bounce) {
+		list_add_tail(&sx->list, &s->xfer_idle);
+		lock_put(&s->lock);
+		return AUB_ERROR_LOWLEVEL;
+	}
+	memcpy(sx->bounce, data, length);
+	libusb_fill_bulk_transfer(sx->xfer, adev->hdev, BULK_ENDPOINT_OUT, sx->bounce, length, stream_callback, sx, 0);
+	sx->seq = s->seq++;
+	sx->submit_ns = trace_begin();
+	if (libusb_submit_transfer(sx->xfer)) {
+		list_add_tail(&sx->list, &s->xfer_idle);
+		s->stats.errors++;
+		lock_put(&s->lock);
+		return AUB_ERROR_IO;
+	}
+	sx->active = 1;
+	s->stats.inflight++;
+	lock_put(&s->lock);
+	return length / width_k;
+}
+
+int AUB_CALL aub_try_recv(aub_device_t dev, void *data, int length)
+{
+	unsigned char *pdata = (unsigned char *)data;
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_stream *s;
+	struct aub_stream_buf *buf;
+	int res, width_k, recv_len, cur_len, empty;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	/* Starting a stream here would turn off the packet length queue */
+	if (adev->cfg.mode == AUB_MODE_PACKET)
+		return AUB_ERROR_NOT_READY;
+	if (adev->compress) {
+		width_k = adev->width_k[AUB_CHAN_IN];
+		length *= width_k;
+		if (length == 0 || length < 0)
+			return 0;
+		return compress_try(adev, pdata, length);
+	}
+	if (adev->pf.running) {
+		width_k = adev->width_k[AUB_CHAN_IN];
+		length *= width_k;
+		if (length == 0 || length < 0)
+			return 0;
+		res = prefetch_recv(adev, pdata, length, NULL);
+		return res ? res : AUB_ERROR_NOT_READY;
+	}
+	s = &adev->stream[AUB_CHAN_IN];
+	if (!s->running) {
+		res = aub_stream_start(dev, AUB_CHAN_IN, NULL);
+		if (res)
+			return res;
+	}
+	width_k = adev->width_k[AUB_CHAN_IN];
+	length *= width_k;
+	if (length == 0 || length < 0)
+		return 0;
+
+	if (stream_recover(s))
+		return AUB_ERROR_IO;
+	lock_get(&s->lock);
+	empty = !s->cur && list_empty(&s->buf_ready);
+	lock_put(&s->lock);
+	if (empty && stream_pump(0))
+		return AUB_ERROR_LOWLEVEL;
+
+	cur_len = residue_take(adev, pdata, length);
+	while (cur_len < length) {
+		if (!s->cur) {
+			lock_get(&s->lock);
+			if (list_empty(&s->buf_ready)) {
+				lock_put(&s->lock);
+				break;
+			}
+			s->cur = list_entry(s->buf_ready.next, struct aub_stream_buf, list);
+			list_del(&s->cur->list);
+			s->stats.ready--;
+			s->cur_off = 0;
+			lock_put(&s->lock);
+		}
+		recv_len = s->cur->length - s->cur_off;
+		if (recv_len > length - cur_len)
+			recv_len = length - cur_len;
+		memcpy(pdata + cur_len, s->cur->data + s->cur_off, recv_len);
+		s->cur_off += recv_len;
+		cur_len += recv_len;
+		if (s->cur_off == s->cur->length) {
+			buf = s->cur;
+			s->cur = NULL;
+			res = stream_release_in(s, buf);
+			if (res)
+				return res;
+		}
+	}
+
+	cur_len = residue_keep(adev, pdata, cur_len, width_k);
+	if (cur_len == 0) {
+		lock_get(&s->lock);
+		res = s->error;
+		lock_put(&s->lock);
+		return res ? AUB_ERROR_IO : AUB_ERROR_NOT_READY;
+	}
+	return cur_len / width_k;
+}
+
+int AUB_CALL aub_replay_file(aub_device_t dev, const char *path, const struct aub_replay_config *cfg, aub_replay_cb_t cb, void *user)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_replay_config rcfg;
+	struct aub_stream_config scfg;
+	struct aub_stream_stats stats;
+	unsigned char *map;
+	uint64_t size, offset, hinted, dropped, pass_base, sent, done;
+	uint64_t t_start, t_report, t_due;
+	unsigned int pass;
+	int res, len;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (cfg) {
+		rcfg = *cfg;
+	} else {
+		memset(&rcfg, 0, sizeof(rcfg));
+		rcfg.loops = 1;
+	}
+	if (rcfg.transfer_size == 0)
+		rcfg.transfer_size = REPLAY_TRANSFER_SIZE;
+	if (rcfg.transfer_count == 0)
+		rcfg.transfer_count = REPLAY_TRANSFER_COUNT;
+	if (rcfg.readahead == 0)
+		rcfg.readahead = REPLAY_READAHEAD;
+	if (rcfg.transfer_size % BUF_ALIGN)
+		return AUB_ERROR_INVALID_PARAM;
+
+	map = (unsigned char *)file_map(path, &size);
+	if (!map)
+		return AUB_ERROR_FILE;
+	if (size == 0) {
+		file_unmap(map, size);
+		return AUB_SUCCESS;
+	}
+
+	memset(&scfg, 0, sizeof(scfg));
+	scfg.transfer_count = rcfg.transfer_count;
+	res = aub_stream_start(dev, AUB_CHAN_OUT, &scfg);
+	if (res) {
+		file_unmap(map, size);
+		return res;
+	}
+
+	sent = 0;
+	t_start = time_ms();
+	t_report = t_start;
+	for (pass = 0; (rcfg.loops == 0) || (pass < rcfg.loops); pass++) {
+		pass_base = sent;
+		hinted = 0;
+		dropped = 0;
+		for (offset = 0; offset < size; offset += len) {
+			len = (size - offset > (uint64_t)rcfg.transfer_size) ? (int)rcfg.transfer_size : (int)(size - offset);
+			/* Read-ahead */
+			if ((hinted < size) && (hinted < offset + rcfg.readahead)) {
+				uint64_t hint_len = (offset + 2ULL * rcfg.readahead) - hinted;
+				if (hint_len > size - hinted)
+					hint_len = size - hinted;
+				file_advise(map + hinted, hint_len, 1);
+				hinted += hint_len;
+			}
+			/* Pacing */
+			if (rcfg.rate) {
+				t_due = t_start + (sent * 1000) / rcfg.rate;
+				while (time_ms() < t_due)
+					stream_pump((int)(t_due - time_ms()));
+			}
+			res = aub_stream_submit(dev, map + offset, len, -1);
+			if (res)
+				goto out;
+			sent += len;
+			/* Release completed pages of current pass */
+			aub_stream_get_stats(dev, AUB_CHAN_OUT, &stats);
+			done = (stats.bytes > pass_base) ? stats.bytes - pass_base : 0;
+			if (done >= dropped + REPLAY_DROP_SIZE) {
+				done -= done % BUF_ALIGN;
+				file_advise(map + dropped, done - dropped, 0);
+				dropped = done;
+			}
+			if (cb && (time_ms() - t_report >= REPLAY_REPORT)) {
+				t_report = time_ms();
+				if (cb(user, &stats)) {
+					res = aub_stream_flush(dev, -1);
+					goto out;
+				}
+			}
+		}
+	}
+	res = aub_stream_flush(dev, -1);
+	if (cb) {
+		aub_stream_get_stats(dev, AUB_CHAN_OUT, &stats);
+		cb(user, &stats);
+	}
+
+out:
+	aub_stream_stop(dev, AUB_CHAN_OUT);
+	file_unmap(map, size);
+	return res;
+}
+
+int AUB_CALL aub_get_frame_counter(aub_device_t dev, struct aub_timestamp *ts)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	return timestamp_read(adev, REG_SFL, ts);
+}
+
+int AUB_CALL aub_get_packet_timestamp(aub_device_t dev, struct aub_timestamp *ts)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+
+	struct aub_packet_timestamp pts;
+	int res;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!adev->tsq)
+		return timestamp_read(adev, REG_PTL, ts);
+	res = aub_get_packet_timestamps(dev, &pts, 1);
+	if (res < 0)
+		return res;
+	if (res == 0)
+		return AUB_ERROR_NOT_READY;
+	*ts = pts.ts;
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_set_timestamp_queue(aub_device_t dev, int enable)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	uint32_t mcr;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!adev->cfg.tsq || (adev->cfg.mode != AUB_MODE_PACKET))
+		return AUB_ERROR_NOT_READY;
+	/* Clearing the bit empties the queue and restarts the packet sequence */
+	if (reg_read(adev, REG_MCR, &mcr, 1))
+		return AUB_ERROR_IO;
+	mcr &= ~REG_MCR_BIT_TSQ;
+	if (reg_write(adev, REG_MCR, &mcr, 1))
+		return AUB_ERROR_IO;
+	adev->tsq = 0;
+	adev->tsq_seq = 0;
+	if (!enable)
+		return AUB_SUCCESS;
+	mcr |= REG_MCR_BIT_TSQ;
+	if (reg_write(adev, REG_MCR, &mcr, 1))
+		return AUB_ERROR_IO;
+	adev->tsq = 1;
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_get_packet_timestamps(aub_device_t dev, struct aub_packet_timestamp *ts, int count)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	uint32_t regs[1 + 2 * TSQ_WINDOW];
+	uint16_t seq;
+	int n;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!ts || (count <= 0))
+		return AUB_ERROR_INVALID_PARAM;
+	if (!adev->tsq)
+		return AUB_ERROR_NOT_READY;
+	if (count > TSQ_WINDOW)
+		count = TSQ_WINDOW;
+	/* Block read from TQC pops the entries it covers */
+	if (reg_read(adev, REG_TQC, regs, 1 + 2 * count))
+		return AUB_ERROR_IO;
+	n = (regs[0] > (uint32_t)count) ? count : (int)regs[0];
+	for (int i = 0; i < n; i++) {
+		/* Device sequence is 16-bit, packets dropped while the queue was full show up as a gap */
+		seq = (uint16_t)(regs[2 + 2 * i] >> 16);
+		ts[i].packet = adev->tsq_seq + (uint16_t)(seq - (uint16_t)adev->tsq_seq);
+		ts[i].ts.frame = regs[1 + 2 * i];
+		ts[i].ts.phase = regs[2 + 2 * i] & 0xFFFF;
+		adev->tsq_seq = ts[i].packet + 1;
+	}
+	return n;
+}
+
+int AUB_CALL aub_sync_clock(aub_device_t dev)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_clock *clk;
+	struct aub_timestamp ts = {0, 0};
+	uint64_t t0, rtt, best_rtt = UINT64_MAX, best_ns = 0, frame;
+	uint32_t v[3];
+	int n;
+	double ticks;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!adev->cfg.tstamp)
+		return AUB_ERROR_NOT_READY;
+	clk = &adev->clk;
+	/* Block request reads SFL, SFH and SFP in one round trip */
+	n = adev->cfg.block ? 3 : 1;
+
+	/* Device latches counter at SETUP of SFL read: keep sample with shortest round trip */
+	for (int i = 0; i < CLOCK_SYNC_TRIES; i++) {
+		t0 = time_ns();
+		if (reg_read(adev, REG_SFL, v, n))
+			return AUB_ERROR_IO;
+		rtt = time_ns() - t0;
+		if (rtt < best_rtt) {
+			if ((n == 1) && reg_read(adev, REG_SFH, &v[1], 2))
+				return AUB_ERROR_IO;
+			best_rtt = rtt;
+			best_ns = t0 + rtt / 2;
+			ts.frame = (v[1] << 16) | (v[0] & 0xFFFF);
+			ts.phase = v[2];
+		}
+	}
+
+	if (!clk->valid) {
+		clk->tick_ns = PHASE_NS;
+		clk->frame_ticks = (adev->cfg.speed ? FRAME_NS_HS : FRAME_NS_FS) / PHASE_NS;
+		clk->last_frame = ts.frame;
+		clk->last_ticks = (double)ts.frame * clk->frame_ticks + ts.phase;
+		clk->last_ns = best_ns;
+		clk->ref_ticks = clk->last_ticks;
+		clk->ref_ns = best_ns;
+		clk->valid = 1;
+		return AUB_SUCCESS;
+	}
+
+	frame = clk->last_frame + (int32_t)(ts.frame - (uint32_t)clk->last_frame);
+	ticks = (double)frame * clk->frame_ticks + ts.phase;
+	if ((best_ns - clk->ref_ns >= CLOCK_DRIFT_MIN) && (ticks > clk->ref_ticks))
+		clk->tick_ns = (double)(best_ns - clk->ref_ns) / (ticks - clk->ref_ticks);
+	clk->last_frame = frame;
+	clk->last_ticks = ticks;
+	clk->last_ns = best_ns;
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_timestamp_to_host(aub_device_t dev, const struct aub_timestamp *ts, unsigned long long *ns)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	struct aub_clock *clk;
+	uint64_t frame;
+	double ticks;
+
+	if (!adev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	clk = &adev->clk;
+	if (!clk->valid)
+		return AUB_ERROR_NOT_READY;
+
+	frame = clk->last_frame + (int32_t)(ts->frame - (uint32_t)clk->last_frame);
+	ticks = (double)frame * clk->frame_ticks + ts->phase;
+	*ns = (unsigned long long)((double)clk->last_ns + (ticks - clk->last_ticks) * clk->tick_ns);
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_test_set(aub_device_t dev, int mode, int pattern)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	uint16_t tcr;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!adev->cfg.test)
+		return AUB_ERROR_NOT_READY;
+	if ((mode < AUB_TEST_OFF) || (mode > AUB_TEST_LOOPBACK) || (pattern < AUB_PATTERN_PRBS31) || (pattern > AUB_PATTERN_COUNTER))
+		return AUB_ERROR_INVALID_PARAM;
+	tcr = (mode & REG_TCR_BIT_MODE) | ((pattern == AUB_PATTERN_COUNTER) ? REG_TCR_BIT_PATTERN : 0);
+	if (request_reg_write(adev, REG_TCR, tcr))
+		return AUB_ERROR_IO;
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_test_get_errors(aub_device_t dev, unsigned int *errors, int *locked)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	uint32_t v[3];
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!adev->cfg.test)
+		return AUB_ERROR_NOT_READY;
+	/* TCR, TEL, TEH: TEL read latches whole counter */
+	if (reg_read(adev, REG_TCR, v, 3))
+		return AUB_ERROR_IO;
+	if (errors)
+		*errors = (v[2] << 16) | (v[1] & 0xFFFF);
+	if (locked)
+		*locked = (v[0] & REG_TCR_BIT_LOCKED) ? 1 : 0;
+	return AUB_SUCCESS;
+}
+
+void AUB_CALL aub_verify_init(struct aub_verify *v, int pattern)
+{
+	memset(v, 0, sizeof(struct aub_verify));
+	v->pattern = pattern;
+	v->history = 0xFFFFFFFF;
+}
+
+unsigned int AUB_CALL aub_verify(struct aub_verify *v, const void *data, unsigned int length)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	unsigned int i = 0, errors = 0;
+	uint64_t word;
+	uint32_t diff;
+
+	/* Bytewise until four bytes of history are inside the block */
+	for (; (i < length) && (i < 4); i++) {
+		if ((v->fill >= 4) && (p[i] != pattern_next(v->pattern, v->history)))
+			errors++;
+		else if (v->fill < 4)
+			v->fill++;
+		v->history = (v->history << 8) | p[i];
+	}
+
+	if (v->pattern == AUB_PATTERN_PRBS31) {
+		/*
+		 * Four bytes per step: with bytes i-4..i+3 loaded big-endian, every byte of
+		 * (V >> 31) ^ (V >> 28) is the byte PRBS31 predicts at the same position.
+		 */
+		for (; i + 4 <= length; i += 4) {
+			word = load_be64(p + i - 4);
+			diff = (uint32_t)(word ^ (word >> 28) ^ (word >> 31));
+			if (diff)
+				errors += ((diff & 0xFF000000) != 0) + ((diff & 0x00FF0000) != 0) + ((diff & 0x0000FF00) != 0) + ((diff & 0x000000FF) != 0);
+		}
+	} else {
+		for (; i + 4 <= length; i += 4) {
+			for (unsigned int k = 0; k < 4; k++)
+				errors += (uint8_t)(p[i + k - 1] + 1) != p[i + k];
+		}
+	}
+	if (i >= 4)
+		v->history = ((uint32_t)p[i - 4] << 24) | ((uint32_t)p[i - 3] << 16) | ((uint32_t)p[i - 2] << 8) | p[i - 1];
+
+	for (; i < length; i++) {
+		if (p[i] != pattern_next(v->pattern, v->history))
+			errors++;
+		v->history = (v->history << 8) | p[i];
+	}
+
+	v->bytes += length;
+	v->errors += errors;
+	return errors;
+}
+
+void AUB_CALL aub_pattern_fill(struct aub_verify *v, void *data, unsigned int length)
+{
+	uint8_t *p = (uint8_t *)data;
+
+	for (unsigned int i = 0; i < length; i++) {
+		p[i] = pattern_next(v->pattern, v->history);
+		v->history = (v->history << 8) | p[i];
+	}
+	v->fill = 4;
+	v->bytes += length;
+}
+
+int AUB_CALL aub_get_fifo_fill(aub_device_t dev, unsigned int *in_fill, unsigned int *out_fill)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	uint32_t v[2];
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!adev->cfg.fill)
+		return AUB_ERROR_NOT_READY;
+	if (reg_read(adev, REG_FIL, v, 2))
+		return AUB_ERROR_IO;
+	if (in_fill)
+		*in_fill = v[0];
+	if (out_fill)
+		*out_fill = v[1];
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_get_recovery_stats(aub_device_t dev, int chan, struct aub_recovery_stats *stats)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+
+	if (!adev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if ((chan != AUB_CHAN_IN) && (chan != AUB_CHAN_OUT))
+		return AUB_ERROR_INVALID_PARAM;
+	if (!stats)
+		return AUB_ERROR_INVALID_PARAM;
+	*stats = adev->recovery[chan];
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_set_integrity(aub_device_t dev, int enable)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	uint32_t mcr;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!adev->cfg.frame)
+		return AUB_ERROR_NOT_READY;
+	if (reg_read(adev, REG_MCR, &mcr, 1))
+		return AUB_ERROR_IO;
+	mcr = enable ? (mcr | REG_MCR_BIT_FRAME) : (mcr & ~REG_MCR_BIT_FRAME);
+	if (reg_write(adev, REG_MCR, &mcr, 1))
+		return AUB_ERROR_IO;
+	return AUB_SUCCESS;
+}
+
+void AUB_CALL aub_integrity_init(struct aub_integrity *ic, aub_integrity_cb_t cb, void *user)
+{
+	memset(ic, 0, sizeof(struct aub_integrity));
+	ic->cb = cb;
+	ic->user = user;
+	if (!crc32c_update)
+		crc32c_select();
+}
+
+int AUB_CALL aub_integrity_check(struct aub_integrity *ic, const void *data, unsigned int length, void *payload)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	const uint8_t *frame;
+	uint8_t *out = (uint8_t *)payload;
+	unsigned int n;
+	int res, out_len = 0;
+
+	if (!ic || (!data && length))
+		return AUB_ERROR_INVALID_PARAM;
+
+	while (length) {
+		/* Aligned whole frames are checked in place, anything else goes through the carry buffer */
+		if ((ic->fill == 0) && ic->synced && (length >= AUB_FRAME_SIZE)) {
+			frame = p;
+			p += AUB_FRAME_SIZE;
+			length -= AUB_FRAME_SIZE;
+		} else {
+			n = AUB_FRAME_SIZE - ic->fill;
+			if (n > length)
+				n = length;
+			memcpy(ic->frame + ic->fill, p, n);
+			ic->fill += n;
+			p += n;
+			length -= n;
+			if (ic->fill < AUB_FRAME_SIZE)
+				break;
+			frame = ic->frame;
+			ic->fill = 0;
+		}
+		res = integrity_frame(ic, frame, out ? out + out_len : NULL);
+		if (res > 0) {
+			out_len += res;
+		} else if (!ic->synced) {
+			/* Searching: try next byte position */
+			memmove(ic->frame, frame + 1, AUB_FRAME_SIZE - 1);
+			ic->fill = AUB_FRAME_SIZE - 1;
+			ic->skipped++;
+		}
+	}
+	return out_len;
+}
+
+int AUB_CALL aub_unpack_i16(const void *data, short *samples, unsigned int count, unsigned int width, int is_signed)
+{
+	if (!data || !samples || (width < 1) || (width > 16))
+		return AUB_ERROR_INVALID_PARAM;
+	if (!unpack12)
+		unpack_select();
+	unpack((const uint8_t *)data, (int16_t *)samples, count, width, is_signed);
+	return (int)(((uint64_t)count * width + 7) / 8);
+}
+
+int AUB_CALL aub_unpack_float(const void *data, float *samples, unsigned int count, unsigned int width, int is_signed)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	int16_t block[UNPACK_BLOCK];
+	float scale;
+	unsigned int n;
+
+	if (!data || !samples || (width < 1) || (width > 16))
+		return AUB_ERROR_INVALID_PARAM;
+	if (!unpack12)
+		unpack_select();
+	/* Full scale is 1.0: [-1, 1) for signed samples, [0, 1) for unsigned */
+	scale = 1.0f / (float)(1u << (is_signed ? width - 1 : width));
+	for (unsigned int i = 0; i < count; i += n) {
+		n = (count - i < UNPACK_BLOCK) ? count - i : UNPACK_BLOCK;
+		unpack(p + (uint64_t)i * width / 8, block, n, width, is_signed);
+		for (unsigned int k = 0; k < n; k++)
+			samples[i + k] = (float)(is_signed ? block[k] : (uint16_t)block[k]) * scale;
+	}
+	return (int)(((uint64_t)count * width + 7) / 8);
+}
+
+int AUB_CALL aub_set_compression(aub_device_t dev, int enable)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!adev->cfg.compress || (adev->cfg.mode != AUB_MODE_STREAM))
+		return AUB_ERROR_NOT_READY;
+	if (adev->stream[AUB_CHAN_IN].running || adev->pf.running || adev->lat.running)
+		return AUB_ERROR_BUSY;
+	return compress_enable(adev, enable ? 1 : 0);
+}
+
+int AUB_CALL aub_decode_init(struct aub_decoder *dec, unsigned int width, int big_endian)
+{
+	if (!dec || ((width != 8) && (width != 16) && (width != 32)))
+		return AUB_ERROR_INVALID_PARAM;
+	memset(dec, 0, sizeof(struct aub_decoder));
+	dec->width = width / 8;
+	dec->big_endian = big_endian ? 1 : 0;
+	dec->hunting = 1;
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_decode(struct aub_decoder *dec, const void *data, unsigned int length, void *samples, unsigned int count, unsigned int *consumed)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	uint8_t *out = (uint8_t *)samples;
+	uint32_t values[AUB_COMPRESS_BLOCK];
+	unsigned int n, used = 0, done = 0;
+	int size;
+
+	if (!dec || !dec->width || (!data && length) || (!samples && count))
+		return AUB_ERROR_INVALID_PARAM;
+	if (dec->failed) {
+		dec->failed = 0;
+		if (consumed)
+			*consumed = 0;
+		return AUB_ERROR_IO;
+	}
+
+	/* Rest of a block that did not fit last time */
+	n = (dec->pend_len < count) ? dec->pend_len : count;
+	decode_store(dec, dec->pend + dec->pend_pos, n, out);
+	dec->pend_pos += n;
+	dec->pend_len -= n;
+	done = n;
+
+	while (done < count) {
+		if (dec->hunting) {
+			/* Marker bytes differ from its first byte, so a mismatch restarts the match at this byte */
+			while ((used < length) && (dec->sync < AUB_COMPRESS_SYNC_SIZE)) {
+				dec->sync = (p[used] == decode_sync[dec->sync]) ? dec->sync + 1 : (p[used] == decode_sync[0]);
+				dec->skipped++;
+				used++;
+			}
+			if (dec->sync < AUB_COMPRESS_SYNC_SIZE)
+				break;
+			/* Device restarted: delta chain starts from zero */
+			dec->hunting = 0;
+			dec->sync = 0;
+			dec->prev = 0;
+			dec->restarts++;
+			continue;
+		}
+		if (dec->fill) {
+			/* Partial block from previous call is completed in the carry buffer */
+			n = AUB_DECODE_BLOCK_MAX - dec->fill;
+			if (n > length - used)
+				n = length - used;
+			memcpy(dec->block + dec->fill, p + used, n);
+			size = decode_block(dec, dec->block, dec->fill + n, values, &n);
+			if (size == 0) {
+				dec->fill += length - used;
+				used = length;
+				break;
+			}
+			if (size > 0) {
+				used += size - dec->fill;
+				dec->fill = 0;
+			}
+		} else {
+			if (used == length)
+				break;
+			if (p[used] == DECODE_SYNC_HEADER) {
+				dec->hunting = 1;
+				continue;
+			}
+			size = decode_block(dec, p + used, length - used, values, &n);
+			if (size == 0) {
+				memcpy(dec->block, p + used, length - used);
+				dec->fill = length - used;
+				used = length;
+				break;
+			}
+			if (size > 0)
+				used += size;
+		}
+		if (size < 0) {
+			/* Block structure lost: nothing can be decoded before the device restarts */
+			dec->fill = 0;
+			dec->hunting = 1;
+			dec->sync = 0;
+			if (done) {
+				dec->failed = 1;
+				break;
+			}
+			dec->in_bytes += used;
+			if (consumed)
+				*consumed = used;
+			return size;
+		}
+		if (n > count - done) {
+			memcpy(dec->pend, values + (count - done), (n - (count - done)) * sizeof(uint32_t));
+			dec->pend_pos = 0;
+			dec->pend_len = n - (count - done);
+			n = count - done;
+		}
+		decode_store(dec, values, n, out + done * dec->width);
+		done += n;
+	}
+
+	dec->in_bytes += used;
+	dec->out_samples += done;
+	if (consumed)
+		*consumed = used;
+	return (int)done;
+}
+
+int AUB_CALL aub_reg_read_block(aub_device_t dev, unsigned int addr, unsigned int *values, int count)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	uint32_t v[REG_BLOCK_MAX];
+	int n;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if ((count < 0) || (count && !values) || (addr + count > 0x10000))
+		return AUB_ERROR_INVALID_PARAM;
+	for (int i = 0; i < count; i += n) {
+		n = (count - i < REG_BLOCK_MAX) ? (count - i) : REG_BLOCK_MAX;
+		if (reg_read(adev, addr + i, v, n))
+			return AUB_ERROR_IO;
+		for (int k = 0; k < n; k++)
+			values[i + k] = v[k];
+	}
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_reg_write_block(aub_device_t dev, unsigned int addr, const unsigned int *values, int count)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	uint32_t v[REG_BLOCK_MAX];
+	int n;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if ((count < 0) || (count && !values) || (addr + count > 0x10000))
+		return AUB_ERROR_INVALID_PARAM;
+	for (int i = 0; i < count; i += n) {
+		n = (count - i < REG_BLOCK_MAX) ? (count - i) : REG_BLOCK_MAX;
+		for (int k = 0; k < n; k++)
+			v[k] = values[i + k];
+		if (reg_write(adev, addr + i, v, n))
+			return AUB_ERROR_IO;
+	}
+	return AUB_SUCCESS;
+}
+
+int AUB_CALL aub_mem_read(aub_device_t dev, unsigned int addr, void *buf, unsigned int len)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	unsigned char *pdata = (unsigned char *)buf;
+	unsigned int sent = 0, done = 0, chunk;
+	int res = AUB_SUCCESS, err;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!adev->cfg.mem)
+		return AUB_ERROR_NOT_READY;
+	if ((addr & 3) || (len & 3) || (len && !buf) || ((uint64_t)addr + len > 0x100000000ULL))
+		return AUB_ERROR_INVALID_PARAM;
+
+	/* Next command waits in device FIFO while current response is read, so bus never idles */
+	while (done < len) {
+		while ((res == AUB_SUCCESS) && (sent < len) && (sent - done < MEM_PIPELINE * MEM_CHUNK_SIZE)) {
+			chunk = (len - sent < MEM_CHUNK_SIZE) ? (len - sent) : MEM_CHUNK_SIZE;
+			if (mem_command(adev, MEM_OPCODE_READ, addr + sent, chunk))
+				return AUB_ERROR_IO;
+			sent += chunk;
+		}
+		if (done == sent)
+			break;
+		chunk = (sent - done < MEM_CHUNK_SIZE) ? (sent - done) : MEM_CHUNK_SIZE;
+		err = mem_response(adev, pdata + done, chunk);
+		if ((err == AUB_ERROR_IO) || (err == AUB_ERROR_TIMEOUT))
+			return err;
+		if (res == AUB_SUCCESS)
+			res = err;
+		done += chunk;
+	}
+	return res;
+}
+
+int AUB_CALL aub_mem_write(aub_device_t dev, unsigned int addr, const void *buf, unsigned int len)
+{
+	struct aub_device *adev = (struct aub_device *)dev;
+	const unsigned char *pdata = (const unsigned char *)buf;
+	unsigned int done = 0, chunk;
+	int pending = 0;
+	int res = AUB_SUCCESS, err;
+
+	if (!adev || !adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (!adev->cfg.mem)
+		return AUB_ERROR_NOT_READY;
+	if ((addr & 3) || (len & 3) || (len && !buf) || ((uint64_t)addr + len > 0x100000000ULL))
+		return AUB_ERROR_INVALID_PARAM;
+
+	/* Status of previous chunk is collected after next one is sent */
+	while ((done < len) || pending) {
+		if ((res == AUB_SUCCESS) && (done < len)) {
+			chunk = (len - done < MEM_CHUNK_SIZE) ? (len - done) : MEM_CHUNK_SIZE;
+			if (mem_command(adev, MEM_OPCODE_WRITE, addr + done, chunk) || mem_send(adev, pdata + done, chunk))
+				return AUB_ERROR_IO;
+			done += chunk;
+			pending++;
+			if (pending < MEM_PIPELINE)
+				continue;
+		} else if (!pending) {
+			break;
+		}
+		err = mem_response(adev, NULL, 0);
+		if ((err == AUB_ERROR_IO) || (err == AUB_ERROR_TIMEOUT))
+			return err;
+		if (res == AUB_SUCCESS)
+			res = err;
+		pending--;
+	}
+	return res;
+}
+
+int AUB_CALL aub_get_pollfds(struct aub_pollfd *fds, int count)
+{
+	const struct libusb_pollfd **list;
+	int n;
+
+	if (!usb_ctx)
+		return AUB_ERROR_NOT_INITIALIZED;
+	list = libusb_get_pollfds(usb_ctx);
+	if (!list)
+		return AUB_ERROR_LOWLEVEL;
+	for (n = 0; list[n]; n++) {
+		if (n < count) {
+			fds[n].fd = list[n]->fd;
+			fds[n].events = list[n]->events;
+		}
+	}
+	libusb_free_pollfds(list);
+	return n;
+}
+
+void AUB_CALL aub_set_pollfd_notifier(aub_pollfd_cb_t cb, void *user)
+{
+	if (!usb_ctx)
+		return;
+	pollfd_cb = cb;
+	pollfd_user = user;
+	if (cb)
+		libusb_set_pollfd_notifiers(usb_ctx, pollfd_added, pollfd_removed, NULL);
+	else
+		libusb_set_pollfd_notifiers(usb_ctx, NULL, NULL, NULL);
+}
+
+int AUB_CALL aub_get_next_timeout(int *timeout)
+{
+	struct timeval tv;
+	int res;
+
+	if (!usb_ctx)
+		return AUB_ERROR_NOT_INITIALIZED;
+	res = libusb_get_next_timeout(usb_ctx, &tv);
+	if (res < 0)
+		return AUB_ERROR_LOWLEVEL;
+	if (res == 0)
+		return 0;
+	*timeout = (int)(tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+	return 1;
+}
+
+int AUB_CALL aub_handle_events(int timeout)
+{
+	if (!usb_ctx)
+		return AUB_ERROR_NOT_INITIALIZED;
+	return stream_pump(timeout);
+}
+
+int AUB_CALL aub_trace_start(unsigned int size)
+{
+	uint64_t n = 1;
+
+	if (!trace.ring) {
+		if (!size)
+			size = TRACE_SIZE;
+		while (n < size)
+			n <<= 1;
+		trace.ring = (struct aub_trace_slot *)calloc(n, sizeof(struct aub_trace_slot));
+		if (!trace.ring)
+			return AUB_ERROR_LOWLEVEL;
+		trace.mask = n - 1;
+	}
+	__atomic_store_n(&trace.enabled, 1, __ATOMIC_RELEASE);
+	return AUB_SUCCESS;
+}
+
+void AUB_CALL aub_trace_stop(void)
+{
+	__atomic_store_n(&trace.enabled, 0, __ATOMIC_RELEASE);
+}
+
+int AUB_CALL aub_trace_read(struct aub_trace_event *events, int count, unsigned long long *lost)
+{
+	struct aub_trace_slot *slot;
+	uint64_t head, seq;
+	unsigned long long skipped = 0;
+	int n = 0;
+
+	if (!events || (count < 0))
+		return AUB_ERROR_INVALID_PARAM;
+	if (!trace.ring)
+		return AUB_ERROR_NOT_INITIALIZED;
+
+	head = __atomic_load_n(&trace.head, __ATOMIC_ACQUIRE);
+	if (head - trace.tail > trace.mask + 1) {
+		skipped += head - trace.tail - (trace.mask + 1);
+		trace.tail = head - (trace.mask + 1);
+	}
+	while ((n < count) && (trace.tail != head)) {
+		slot = &trace.ring[trace.tail & trace.mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if ((seq == 0) || (seq < trace.tail + 1)) {
+			/* Being written: by a newer lap if head has moved past it, otherwise by its own producer */
+			if (__atomic_load_n(&trace.head, __ATOMIC_ACQUIRE) - trace.tail <= trace.mask + 1)
+				break;
+			skipped++;
+		} else if (seq == trace.tail + 1) {
+			events[n] = slot->ev;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+				n++;
+			else
+				skipped++;
+		} else {
+			skipped++;
+		}
+		trace.tail++;
+	}
+	if (lost)
+		*lost = skipped;
+	return n;
+}
+
+int AUB_CALL aub_trace_export(const char *path)
+{
+	struct aub_trace_event ev[TRACE_READ_CHUNK];
+	uint64_t id = 0;
+	FILE *f;
+	int n;
+
+	if (!path)
+		return AUB_ERROR_INVALID_PARAM;
+	if (!trace.ring)
+		return AUB_ERROR_NOT_INITIALIZED;
+	f = fopen(path, "w");
+	if (!f)
+		return AUB_ERROR_FILE;
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	while ((n = aub_trace_read(ev, TRACE_READ_CHUNK, NULL)) > 0) {
+		for (int i = 0; i < n; i++, id++)
+			trace_write_json(f, &ev[i], id, id == 0);
+	}
+	fprintf(f, "\n]}\n");
+	if (fclose(f))
+		return AUB_ERROR_FILE;
+	return (int)id;
+}
+
+static int create_device_list(void)
+{
+	struct libusb_device_descriptor desc;
+	libusb_device **dev_list;
+	struct aub_device *adev;
+	libusb_device *dev;
+	ssize_t dev_count;
+
+	device_count = 0;
+	device_list = (struct aub_device *)malloc(sizeof(struct aub_device));
+	if (!device_list)
+		return AUB_ERROR_LOWLEVEL;
+	device_list->dev = NULL;
+	device_list->hdev = NULL;
+	INIT_LIST_HEAD(&device_list->list);
+
+	dev_count = libusb_get_device_list(usb_ctx, &dev_list);
+	if (dev_count < 0)
+		return AUB_ERROR_LOWLEVEL;
+
+	for (int i = 0; i < dev_count; i++) {
+		if ((dev = dev_list[i]) == NULL)
+			break;
+		if (libusb_get_device_descriptor(dev, &desc) < 0)
+			continue;
+		if ((desc.idVendor == VENDOR_ID) && (desc.idProduct == PRODUCT_ID)) {
+			adev = (struct aub_device *)malloc(sizeof(struct aub_device));
+			if (!adev) {
+				libusb_free_device_list(dev_list, 1);
+				return AUB_ERROR_LOWLEVEL;
+			}
+			memset(adev, 0, sizeof(struct aub_device));
+			adev->dev = dev;
+			adev->hdev = NULL;
+			adev->devnum = device_count++;
+			adev->busnum = libusb_get_bus_number(dev);
+			adev->devaddr = libusb_get_device_address(dev);
+			open_device(adev);
+			close_device(adev);
+			list_add_tail(&adev->list, &device_list->list);
+		}
+	}
+	libusb_free_device_list(dev_list, 0);
+	return AUB_SUCCESS;
+}
+
+static void destroy_device_list(void)
+{
+	struct list_head *pos, *q;
+	struct aub_device *adev;
+
+	if (!device_list)
+		return;
+	list_for_each_safe(pos, q, &device_list->list) {
+		adev = list_entry(pos, struct aub_device, list);
+		list_del(pos);
+		close_device(adev);
+		free(adev);
+	}
+	device_count = 0;
+	free(device_list);
+}
+
+static int open_device(struct aub_device *adev)
+{
+	if (adev->hdev)
+		return AUB_ERROR_NOT_INITIALIZED;
+	if (libusb_open(adev->dev, &adev->hdev)) {
+		return AUB_ERROR_LOWLEVEL;
+	} else {
+		libusb_reset_device(adev->hdev);
+		libusb_get_device_descriptor(adev->dev, &adev->desc);
+		libusb_get_string_descriptor_ascii(adev->hdev, adev->desc.iManufacturer, adev->info.manufacturer, INFO_SIZE);
+		libusb_get_string_descriptor_ascii(adev->hdev, adev->desc.iProduct, adev->info.product, INFO_SIZE);
+		libusb_get_string_descriptor_ascii(adev->hdev, adev->desc.iSerialNumber, adev->info.serial, INFO_SIZE);
+		libusb_claim_interface(adev->hdev, 0);
+		if (request_cfg_get(adev)) {
+			close_device(adev);
+			return AUB_ERROR_IO;
+		}
+		for (int i = 0; i < 2; i++) {
+			switch (adev->cfg.chan[i].width) {
+			case DATA_WIDTH_NONE:
+				adev->width_k[i] = 0;
+				break;
+			case DATA_WIDTH_8:
+				adev->width_k[i] = 1;
+				break;
+			case DATA_WIDTH_16:
+				adev->width_k[i] = 2;
+				break;
+			case DATA_WIDTH_32:
+				adev->width_k[i] = 4;
+				break;
+			}
+		}
+		adev->wmaxpacketsize = adev->cfg.speed ? PACKETSIZE_HS : PACKETSIZE_FS;
+		adev->residue_len = 0;
+		io_defaults(adev, &adev->io[AUB_CHAN_IN]);
+		io_defaults(adev, &adev->io[AUB_CHAN_OUT]);
+		adev->clk.valid = 0;
+		memset(adev->recovery, 0, sizeof(adev->recovery));
+		if (plq_enable(adev, 1) || compress_enable(adev, 0)) {
+			close_device(adev);
+			return AUB_ERROR_IO;
+		}
+	}
+	return AUB_SUCCESS;
+}
+
+static void close_device(struct aub_device *adev)
+{
+	if (adev->hdev) {
+		libusb_release_interface(adev->hdev, 0);
+		libusb_close(adev->hdev);
+		adev->hdev = NULL;
+	}
+}
+
+static inline int bulk_send(struct aub_device *adev, const unsigned char *data, int length, int *act_len, int timeout)
+{
+	uint64_t t0 = trace_begin();
+	int res;
+
+	*act_len = 0;
+	res = libusb_bulk_transfer(adev->hdev, BULK_ENDPOINT_OUT, (unsigned char *)data, length, act_len, timeout);
+	trace_end(adev, t0, AUB_TRACE_BULK, BULK_ENDPOINT_OUT, 0, 0, length, *act_len, res);
+	return res;
+}
+
+static inline int bulk_recv(struct aub_device *adev, unsigned char *data, int length, int *act_len, int timeout)
+{
+	uint64_t t0 = trace_begin();
+	int res;
+
+	*act_len = 0;
+	res = libusb_bulk_transfer(adev->hdev, BULK_ENDPOINT_IN, data, length, act_len, timeout);
+	trace_end(adev, t0, AUB_TRACE_BULK, BULK_ENDPOINT_IN, 0, 0, length, *act_len, res);
+	return res;
+}
+
+static inline int request_reg_read(struct aub_device *adev, uint16_t regaddr, uint16_t *regval)
+{
+	uint64_t t0 = trace_begin();
+	int res = libusb_control_transfer(adev->hdev, REQUEST_TYPE_IN, REQUEST_REG_OPER, regaddr, 0, (uint8_t *)regval, sizeof(uint16_t), TIMEOUT);
+	trace_end(adev, t0, AUB_TRACE_CONTROL, LIBUSB_ENDPOINT_IN, REQUEST_REG_OPER, regaddr, sizeof(uint16_t), res, res);
+	if (res == sizeof(uint16_t))
+		return AUB_SUCCESS;
+	else
+		return AUB_ERROR_IO;
 }
 
 static inline int request_reg_write(struct aub_device *adev, uint16_t regaddr, uint16_t regval)
 {
-	int res = libusb_control_transfer(adev->hdev, REQUEST_TYPE_OUT, REQUEST_REG_OPER, regaddr, 0, (uint8_t *)&regval, sizeof(uint16_t), TIMEOUT);
-	if (res == sizeof(uint16_t))
+	uint64_t t0 = trace_begin();
+	int res = libusb_control_transfer(adev->hdev, REQUEST_TYPE_OUT, REQUEST_REG_OPER, regaddr, 0, (uint8_t *)&regval, sizeof(uint16_t), TIMEOUT);
+	trace_end(adev, t0, AUB_TRACE_CONTROL, LIBUSB_ENDPOINT_OUT, REQUEST_REG_OPER, regaddr, sizeof(uint16_t), res, res);
+	if (res == sizeof(uint16_t))
+		return AUB_SUCCESS;
+	else
+		return AUB_ERROR_IO;
+}
+
+static int request_reg_block(struct aub_device *adev, uint8_t type, uint16_t regaddr, uint8_t *data, int count)
+{
+	uint64_t t0 = trace_begin();
+	int res = libusb_control_transfer(adev->hdev, type, REQUEST_REG_BLOCK, regaddr, 0, data, count * sizeof(uint32_t), TIMEOUT);
+	trace_end(adev, t0, AUB_TRACE_CONTROL, type & LIBUSB_ENDPOINT_IN, REQUEST_REG_BLOCK, regaddr, count * sizeof(uint32_t), res, res);
+	if (res == (int)(count * sizeof(uint32_t)))
+		return AUB_SUCCESS;
+	else
+		return AUB_ERROR_IO;
+}
+
+static inline int request_cfg_get(struct aub_device *adev)
+{
+	uint64_t t0 = trace_begin();
+	int res = libusb_control_transfer(adev->hdev, REQUEST_TYPE_IN, REQUEST_CFG_GET, 0, 0, (uint8_t *)&adev->cfg, sizeof(struct aub_config), TIMEOUT);
+	trace_end(adev, t0, AUB_TRACE_CONTROL, LIBUSB_ENDPOINT_IN, REQUEST_CFG_GET, 0, sizeof(struct aub_config), res, res);
+	if (res == sizeof(struct aub_config))
+		return AUB_SUCCESS;
+	else
+		return AUB_ERROR_IO;
+}
+
+static uint64_t time_ms(void)
+{
+#ifdef _WIN32
+	return GetTickCount64();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+static uint64_t time_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER cnt, freq;
+
+	QueryPerformanceCounter(&cnt);
+	QueryPerformanceFrequency(&freq);
+	return (uint64_t)((double)cnt.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static int timestamp_read(struct aub_device *adev, uint16_t regaddr, struct aub_timestamp *ts)
+{
+	uint32_t v[3];
+
+	if (!adev->cfg.tstamp)
+		return AUB_ERROR_NOT_READY;
+	/* Low register read latches high half and phase */
+	if (reg_read(adev, regaddr, v, 3))
+		return AUB_ERROR_IO;
+	ts->frame = (v[1] << 16) | (v[0] & 0xFFFF);
+	ts->phase = v[2];
+	return AUB_SUCCESS;
+}
+
+/* Byte expected after history (latest byte in LSB) */
+static inline uint8_t pattern_next(unsigned int pattern, uint32_t history)
+{
+	if (pattern == AUB_PATTERN_COUNTER)
+		return (uint8_t)(history + 1);
+	return (uint8_t)((history >> 23) ^ (history >> 20));
+}
+
+static inline uint32_t load_le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t load_le64(const uint8_t *p)
+{
+	return (uint64_t)load_le32(p) | ((uint64_t)load_le32(p + 4) << 32);
+}
+
+static inline uint64_t load_be64(const uint8_t *p)
+{
+	return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+		   ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+}
+
+static void *buf_alloc(size_t size)
+{
+#ifdef _WIN32
+	return _aligned_malloc(size, BUF_ALIGN);
+#else
+	void *buf;
+
+	if (posix_memalign(&buf, BUF_ALIGN, size))
+		return NULL;
+	return buf;
+#endif
+}
+
+static void buf_free(void *buf)
+{
+#ifdef _WIN32
+	_aligned_free(buf);
+#else
+	free(buf);
+#endif
+}
+
+static int buf_lock(void *buf, size_t size)
+{
+#ifdef _WIN32
+	return VirtualLock(buf, size) ? 0 : -1;
+#else
+	return mlock(buf, size);
+#endif
+}
+
+static void buf_unlock(void *buf, size_t size)
+{
+#ifdef _WIN32
+	VirtualUnlock(buf, size);
+#else
+	munlock(buf, size);
+#endif
+}
+
+static int stream_pump(int timeout)
+{
+	struct timeval tv;
+
+	if (timeout < 0)
+		timeout = 0;
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+	if (libusb_handle_events_timeout_completed(usb_ctx, &tv, NULL))
+		return AUB_ERROR_LOWLEVEL;
+	return AUB_SUCCESS;
+}
+
+/* Must be called with stream lock held */
+static int stream_submit_in(struct aub_stream *s, struct aub_stream_xfer *sx)
+{
+	libusb_fill_bulk_transfer(sx->xfer, s->adev->hdev, BULK_ENDPOINT_IN, sx->buf->data, s->cfg.transfer_size, stream_callback, sx, s->cfg.timeout);
+	sx->submit_ns = trace_begin();
+	if (libusb_submit_transfer(sx->xfer)) {
+		list_add_tail(&sx->buf->list, &s->buf_free);
+		sx->buf = NULL;
+		list_add_tail(&sx->list, &s->xfer_idle);
+		s->stats.errors++;
+		s->error = 1;
+		return AUB_ERROR_IO;
+	}
+	sx->active = 1;
+	s->stats.inflight++;
+	return AUB_SUCCESS;
+}
+
+/* Returns drained IN buffer to pool or resubmits it straight away */
+static int stream_release_in(struct aub_stream *s, struct aub_stream_buf *buf)
+{
+	struct aub_stream_xfer *sx;
+	int res = AUB_SUCCESS;
+
+	lock_get(&s->lock);
+	if (!list_empty(&s->xfer_idle) && !s->error && !s->halted) {
+		sx = list_entry(s->xfer_idle.next, struct aub_stream_xfer, list);
+		list_del(&sx->list);
+		sx->buf = buf;
+		res = stream_submit_in(s, sx);
+	} else {
+		list_add_tail(&buf->list, &s->buf_free);
+	}
+	lock_put(&s->lock);
+	return res;
+}
+
+static void LIBUSB_CALL stream_callback(struct libusb_transfer *xfer)
+{
+	struct aub_stream_xfer *sx = (struct aub_stream_xfer *)xfer->user_data;
+	struct aub_stream *s = sx->stream;
+
+	trace_end(s->adev, sx->submit_ns, AUB_TRACE_ASYNC, xfer->endpoint, 0, 0, xfer->length, xfer->actual_length, trace_status(xfer->status));
+	lock_get(&s->lock);
+	sx->active = 0;
+	s->stats.inflight--;
+	if (s->stats.inflight < s->stats.inflight_min)
+		s->stats.inflight_min = s->stats.inflight;
+
+	switch (xfer->status) {
+	case LIBUSB_TRANSFER_STALL:
+		/* Bytes moved before the halt are kept */
+		stream_halt(s, sx);
+		/* fall through */
+	case LIBUSB_TRANSFER_COMPLETED:
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		if (xfer->actual_length > 0) {
+			s->stats.bytes += xfer->actual_length;
+			s->stats.transfers++;
+			if (s->chan == AUB_CHAN_IN) {
+				sx->buf->length = xfer->actual_length;
+				list_add_tail(&sx->buf->list, &s->buf_ready);
+				sx->buf = NULL;
+				if (++s->stats.ready > s->stats.ready_max)
+					s->stats.ready_max = s->stats.ready;
+			}
+		}
+		break;
+	case LIBUSB_TRANSFER_CANCELLED:
+		if (s->halted && (s->chan == AUB_CHAN_OUT) && (xfer->actual_length > 0)) {
+			s->stats.bytes += xfer->actual_length;
+			s->stats.transfers++;
+		}
+		break;
+	default:
+		s->stats.errors++;
+		s->error = 1;
+		break;
+	}
+
+	/* OUT cancelled or halted by a halt: unsent tail is resubmitted in order once halt is cleared */
+	if ((s->chan == AUB_CHAN_OUT) && s->halted && s->running && !s->error &&
+		((xfer->status == LIBUSB_TRANSFER_STALL) || (xfer->status == LIBUSB_TRANSFER_CANCELLED)) &&
+		(xfer->actual_length < xfer->length)) {
+		struct list_head *pos = s->xfer_halted.prev;
+
+		xfer->buffer += xfer->actual_length;
+		xfer->length -= xfer->actual_length;
+		while ((pos != &s->xfer_halted) && (list_entry(pos, struct aub_stream_xfer, list)->seq > sx->seq))
+			pos = pos->prev;
+		list_add(&sx->list, pos);
+		lock_put(&s->lock);
+		return;
+	}
+
+	if ((s->chan == AUB_CHAN_IN) && s->running && !s->error && !s->halted) {
+		if (!sx->buf && !list_empty(&s->buf_free)) {
+			sx->buf = list_entry(s->buf_free.next, struct aub_stream_buf, list);
+			list_del(&sx->buf->list);
+		}
+		if (sx->buf) {
+			stream_submit_in(s, sx);
+			lock_put(&s->lock);
+			return;
+		}
+		s->stats.overruns++;
+	}
+	if (sx->buf) {
+		list_add_tail(&sx->buf->list, &s->buf_free);
+		sx->buf = NULL;
+	}
+	list_add_tail(&sx->list, &s->xfer_idle);
+	lock_put(&s->lock);
+}
+
+static void *file_map(const char *path, uint64_t *size)
+{
+#ifdef _WIN32
+	HANDLE file, mapping;
+	LARGE_INTEGER fsize;
+	void *addr;
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	if (!GetFileSizeEx(file, &fsize)) {
+		CloseHandle(file);
+		return NULL;
+	}
+	*size = (uint64_t)fsize.QuadPart;
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping)
+		return NULL;
+	addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	return addr;
+#else
+	struct stat st;
+	void *addr;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+	*size = (uint64_t)st.st_size;
+	addr = mmap(NULL, st.st_size ? st.st_size : 1, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return NULL;
+	posix_madvise(addr, st.st_size, POSIX_MADV_SEQUENTIAL);
+	return addr;
+#endif
+}
+
+static void file_unmap(void *addr, uint64_t size)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(addr);
+#else
+	munmap(addr, size ? size : 1);
+#endif
+}
+
+/* willneed: 1 - start read-ahead, 0 - pages are no longer needed */
+static void file_advise(void *addr, uint64_t size, int willneed)
+{
+#ifndef _WIN32
+	uintptr_t start = (uintptr_t)addr & ~(uintptr_t)(BUF_ALIGN - 1);
+
+	size += (uintptr_t)addr - start;
+	if (willneed)
+		posix_madvise((void *)start, size, POSIX_MADV_WILLNEED);
+	else
+		madvise((void *)start, size, MADV_DONTNEED);
+#endif
+}
+
+static void io_defaults(struct aub_device *adev, struct aub_io_params *params)
+{
+	/* Stream mode returns what arrived once the link goes idle, packet mode waits for whole packet */
+	params->min_length = 0;
+	params->deadline = -1;
+	params->gap = (adev->cfg.mode == AUB_MODE_STREAM) ? IO_GAP_STREAM : -1;
+}
+
+static int io_wait(uint64_t deadline_at, uint64_t gap_at)
+{
+	uint64_t now = time_ms(), end = 0;
+
+	if (deadline_at)
+		end = deadline_at;
+	if (gap_at && (!end || (gap_at < end)))
+		end = gap_at;
+	if (!end)
+		return IO_WAIT_MAX;
+	if (now >= end)
+		return 0;
+	return (end - now > IO_WAIT_MAX) ? IO_WAIT_MAX : (int)(end - now);
+}
+
+static int residue_take(struct aub_device *adev, unsigned char *pdata, int length)
+{
+	int len = (adev->residue_len < length) ? adev->residue_len : length;
+
+	memcpy(pdata, adev->residue, len);
+	adev->residue_len -= len;
+	memmove(adev->residue, adev->residue + len, adev->residue_len);
+	return len;
+}
+
+/* Put incomplete trailing element back in front of residue, returns whole element bytes */
+static int residue_keep(struct aub_device *adev, unsigned char *pdata, int length, int width_k)
+{
+	int rem = length % width_k;
+
+	if (rem) {
+		length -= rem;
+		memmove(adev->residue + rem, adev->residue, adev->residue_len);
+		memcpy(adev->residue, pdata + length, rem);
+		adev->residue_len += rem;
+	}
+	return length;
+}
+
+static int recv_packet(struct aub_device *adev, unsigned char *pdata, int length, const struct aub_io_params *params)
+{
+	uint64_t deadline_at = 0, gap_at = 0;
+	uint32_t lengths[PLQ_WINDOW];
+	uint16_t reg_data = 0;
+	int res, act_len, timeout, cur_len = 0, halts = 0;
+
+	if (params->deadline >= 0)
+		deadline_at = time_ms() + params->deadline + 1;
+	if (params->gap >= 0)
+		gap_at = time_ms() + params->gap + 1;
+
+	/* Length queue: packet is received with exact size, a packet longer than array stays queued */
+	if (adev->plq) {
+		res = plq_wait(adev, lengths, deadline_at, gap_at);
+		if (res < 0)
+			return res;
+		if (lengths[0] > (uint32_t)length)
+			return AUB_ERROR_OVERFLOW;
+		res = plq_recv(adev, pdata, lengths, 1);
+		return res ? res : (int)(lengths[0] / adev->width_k[AUB_CHAN_IN]);
+	}
+
+	if (request_reg_write(adev, REG_RSR, 0))
+		return AUB_ERROR_IO;
+
+	/* Timeouts only apply before the first packet, a started packet is always completed */
+	do {
+		if (cur_len == 0) {
+			timeout = io_wait(deadline_at, gap_at);
+			if (timeout == 0)
+				return AUB_ERROR_TIMEOUT;
+		} else {
+			timeout = IO_WAIT_MAX;
+		}
+		if (length - cur_len >= adev->wmaxpacketsize) {
+			res = bulk_recv(adev, pdata + cur_len, adev->wmaxpacketsize, &act_len, timeout);
+		} else {
+			res = bulk_recv(adev, adev->residue, adev->wmaxpacketsize, &act_len, timeout);
+			if (act_len > length - cur_len)
+				return AUB_ERROR_OVERFLOW;
+			memcpy(pdata + cur_len, adev->residue, act_len);
+		}
+		if (res < 0) {
+			if ((res != LIBUSB_ERROR_PIPE) && (res != LIBUSB_ERROR_TIMEOUT))
+				return AUB_ERROR_IO;
+			if (res == LIBUSB_ERROR_PIPE) {
+				halts = (act_len > 0) ? 0 : halts + 1;
+				if ((halts > IO_RECOVERY_MAX) || ep_recover(adev, AUB_CHAN_IN))
+					return AUB_ERROR_IO;
+			}
+			if (act_len == 0)
+				continue;
+		}
+		cur_len += act_len;
+		if (request_reg_read(adev, REG_RSR, &reg_data))
+			return AUB_ERROR_IO;
+		if (reg_data & REG_RSR_BIT_LST)
+			return cur_len / adev->width_k[AUB_CHAN_IN];
+	} while (cur_len < length);
+
+	return AUB_ERROR_OVERFLOW;
+}
+
+static void LIBUSB_CALL pollfd_added(int fd, short events, void *user)
+{
+	(void)user;
+	if (pollfd_cb)
+		pollfd_cb(fd, events, pollfd_user);
+}
+
+static void LIBUSB_CALL pollfd_removed(int fd, void *user)
+{
+	(void)user;
+	if (pollfd_cb)
+		pollfd_cb(fd, 0, pollfd_user);
+}
+
+static int mem_command(struct aub_device *adev, uint8_t opcode, uint32_t addr, uint32_t length)
+{
+	unsigned char cmd[MEM_CMD_SIZE];
+
+	memset(cmd, 0, sizeof(cmd));
+	cmd[0] = opcode;
+	for (int i = 0; i < 4; i++) {
+		cmd[4 + i] = (addr >> (8 * i)) & 0xFF;
+		cmd[8 + i] = (length >> (8 * i)) & 0xFF;
+	}
+	return mem_send(adev, cmd, sizeof(cmd));
+}
+
+static int mem_send(struct aub_device *adev, const unsigned char *data, unsigned int length)
+{
+	uint64_t t0 = trace_begin();
+	int res, act_len = 0;
+
+	res = libusb_bulk_transfer(adev->hdev, BULK_ENDPOINT_MEM_OUT, (unsigned char *)data, (int)length, &act_len, MEM_TIMEOUT);
+	trace_end(adev, t0, AUB_TRACE_BULK, BULK_ENDPOINT_MEM_OUT, 0, 0, length, act_len, res);
+	if (res || (act_len != (int)length))
+		return AUB_ERROR_IO;
+	return AUB_SUCCESS;
+}
+
+static int mem_recv(struct aub_device *adev, unsigned char *data, unsigned int length)
+{
+	unsigned int got = 0;
+	uint64_t t0;
+	int res, act_len;
+
+	/* Short and zero-length packets do not end response, keep reading until it is complete */
+	while (got < length) {
+		act_len = 0;
+		t0 = trace_begin();
+		res = libusb_bulk_transfer(adev->hdev, BULK_ENDPOINT_MEM_IN, data + got, (int)(length - got), &act_len, MEM_TIMEOUT);
+		trace_end(adev, t0, AUB_TRACE_BULK, BULK_ENDPOINT_MEM_IN, 0, 0, length - got, act_len, res);
+		if (res == LIBUSB_ERROR_TIMEOUT)
+			return AUB_ERROR_TIMEOUT;
+		if (res)
+			return AUB_ERROR_IO;
+		got += act_len;
+	}
+	return AUB_SUCCESS;
+}
+
+static int mem_response(struct aub_device *adev, unsigned char *data, unsigned int length)
+{
+	unsigned char tail[2 * PACKETSIZE_HS];
+	unsigned int head = length - length % adev->wmaxpacketsize;
+	unsigned int rest = length - head;
+	int res;
+
+	/* Whole packets go straight to caller, last one also carries status */
+	if (head && (res = mem_recv(adev, data, head)))
+		return res;
+	if ((res = mem_recv(adev, tail, rest + MEM_STATUS_SIZE)))
+		return res;
+	if (rest)
+		memcpy(data + head, tail, rest);
+	switch (tail[rest]) {
+	case MEM_STATUS_OKAY:
+		return AUB_SUCCESS;
+	case MEM_STATUS_SLVERR:
+	case MEM_STATUS_DECERR:
+		return AUB_ERROR_BUS;
+	default:
+		return AUB_ERROR_IO;
+	}
+}
+
+static int reg_read(struct aub_device *adev, uint16_t regaddr, uint32_t *values, int count)
+{
+	uint8_t data[REG_BLOCK_MAX * sizeof(uint32_t)];
+	uint16_t regval;
+
+	/* Older bitstreams: one 16-bit transfer per register */
+	if (!adev->cfg.block) {
+		for (int i = 0; i < count; i++) {
+			if (request_reg_read(adev, regaddr + i, &regval))
+				return AUB_ERROR_IO;
+			values[i] = regval;
+		}
+		return AUB_SUCCESS;
+	}
+	if (request_reg_block(adev, REQUEST_TYPE_IN, regaddr, data, count))
+		return AUB_ERROR_IO;
+	for (int i = 0; i < count; i++)
+		values[i] = (uint32_t)data[4 * i] | ((uint32_t)data[4 * i + 1] << 8) | ((uint32_t)data[4 * i + 2] << 16) | ((uint32_t)data[4 * i + 3] << 24);
+	return AUB_SUCCESS;
+}
+
+static int reg_write(struct aub_device *adev, uint16_t regaddr, const uint32_t *values, int count)
+{
+	uint8_t data[REG_BLOCK_MAX * sizeof(uint32_t)];
+
+	if (!adev->cfg.block) {
+		for (int i = 0; i < count; i++) {
+			if (request_reg_write(adev, regaddr + i, (uint16_t)values[i]))
+				return AUB_ERROR_IO;
+		}
+		return AUB_SUCCESS;
+	}
+	for (int i = 0; i < count; i++) {
+		for (int k = 0; k < 4; k++)
+			data[4 * i + k] = (values[i] >> (8 * k)) & 0xFF;
+	}
+	return request_reg_block(adev, REQUEST_TYPE_OUT, regaddr, data, count);
+}
+
+static void *ring_alloc(uint64_t size, int huge, int *is_huge)
+{
+	void *ring;
+
+	*is_huge = 0;
+#ifdef _WIN32
+	if (huge && GetLargePageMinimum() && !(size % GetLargePageMinimum())) {
+		ring = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (ring) {
+			*is_huge = 1;
+			return ring;
+		}
+	}
+	return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_POPULATE
+	/* Fault pages in now, not in the receive path */
+	flags |= MAP_POPULATE;
+#endif
+#ifdef MAP_HUGETLB
+	if (huge) {
+		ring = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+		if (ring != MAP_FAILED) {
+			*is_huge = 1;
+			return ring;
+		}
+	}
+#endif
+	ring = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (ring == MAP_FAILED)
+		return NULL;
+#ifdef MADV_HUGEPAGE
+	/* No reserved huge pages: let transparent huge pages back the ring */
+	if (huge)
+		madvise(ring, size, MADV_HUGEPAGE);
+#endif
+	return ring;
+#endif
+}
+
+static void ring_free(void *ring, uint64_t size, int is_huge)
+{
+	(void)is_huge;
+#ifdef _WIN32
+	(void)size;
+	VirtualFree(ring, 0, MEM_RELEASE);
+#else
+	munmap(ring, size);
+#endif
+}
+
+/* Must be called with prefetch lock held */
+static int prefetch_submit(struct aub_prefetch *pf, struct aub_prefetch_xfer *px)
+{
+	unsigned char *data;
+
+	/* Ring full: keep draining the device into scratch so the gap is visible in stats, not as FPGA backpressure */
+	if (pf->submit - ring_load(&pf->tail) < pf->nslots) {
+		px->slot = pf->submit++;
+		data = pf->ring + (px->slot % pf->nslots) * pf->cfg.transfer_size;
+	} else {
+		px->slot = -1;
+		data = pf->scratch;
+	}
+	libusb_fill_bulk_transfer(px->xfer, pf->adev->hdev, BULK_ENDPOINT_IN, data, pf->cfg.transfer_size, prefetch_callback, px, pf->cfg.timeout);
+	px->submit_ns = trace_begin();
+	if (libusb_submit_transfer(px->xfer)) {
+		if (px->slot >= 0)
+			pf->submit--;
+		pf->stats.errors++;
+		ring_store(&pf->error, 1);
+		return AUB_ERROR_IO;
+	}
+	px->active = 1;
+	ring_store(&pf->inflight, pf->inflight + 1);
+	return AUB_SUCCESS;
+}
+
+/* Consumer: contiguous unread bytes at oldest filled slot, empty slots are released */
+static int prefetch_avail(struct aub_prefetch *pf, unsigned char **data)
+{
+	uint64_t head = ring_load(&pf->head);
+	uint64_t idx;
+
+	while (pf->tail < head) {
+		idx = pf->tail % pf->nslots;
+		if (pf->tail_off < pf->slot_len[idx]) {
+			*data = pf->ring + idx * pf->cfg.transfer_size + pf->tail_off;
+			return pf->slot_len[idx] - pf->tail_off;
+		}
+		pf->tail_off = 0;
+		ring_store(&pf->tail, pf->tail + 1);
+	}
+	return 0;
+}
+
+static void prefetch_release(struct aub_prefetch *pf, unsigned int length)
+{
+	pf->tail_off += length;
+	ring_store(&pf->bytes_out, pf->bytes_out + length);
+	if (pf->tail_off == pf->slot_len[pf->tail % pf->nslots]) {
+		pf->tail_off = 0;
+		ring_store(&pf->tail, pf->tail + 1);
+	}
+}
+
+static int prefetch_recv(struct aub_device *adev, unsigned char *pdata, int length, const struct aub_io_params *params)
+{
+	struct aub_prefetch *pf = &adev->pf;
+	int width_k = adev->width_k[AUB_CHAN_IN];
+	uint64_t deadline_at = 0, gap_at = 0, fill, fill_prev = 0;
+	unsigned char *ptr;
+	int min_len, cur_len, len;
+
+	cur_len = residue_take(adev, pdata, length);
+	/* No params: take what is there */
+	if (params) {
+		min_len = (params->min_length > 0) ? params->min_length * width_k : length;
+		if (min_len > length)
+			min_len = length;
+		if (params->deadline >= 0)
+			deadline_at = time_ms() + params->deadline + 1;
+		if (params->gap >= 0)
+			gap_at = time_ms() + params->gap + 1;
+		for (;;) {
+			fill = ring_load(&pf->bytes_in) - pf->bytes_out;
+			if ((cur_len + fill >= (uint64_t)min_len) || ring_load(&pf->error))
+				break;
+			if ((fill != fill_prev) && (params->gap >= 0))
+				gap_at = time_ms() + params->gap + 1;
+			fill_prev = fill;
+			if (io_wait(deadline_at, gap_at) == 0)
+				break;
+			prefetch_sleep();
+		}
+	}
+
+	while (cur_len < length) {
+		len = prefetch_avail(pf, &ptr);
+		if (len == 0)
+			break;
+		if (len > length - cur_len)
+			len = length - cur_len;
+		memcpy(pdata + cur_len, ptr, len);
+		prefetch_release(pf, len);
+		cur_len += len;
+	}
+
+	cur_len = residue_keep(adev, pdata, cur_len, width_k);
+	if ((cur_len == 0) && ring_load(&pf->error))
+		return AUB_ERROR_IO;
+	return cur_len / width_k;
+}
+
+static void prefetch_sleep(void)
+{
+#ifdef _WIN32
+	Sleep(1);
+#else
+	struct timespec ts = {0, PREFETCH_POLL_US * 1000};
+
+	nanosleep(&ts, NULL);
+#endif
+}
+
+/*
+ * CLEAR_FEATURE(ENDPOINT_HALT) restarts host and device data toggles at DATA0, so the endpoint
+ * resumes without re-enumeration. At most the packet in flight at the halt is lost (IN) or
+ * sent twice (OUT).
+ */
+static int ep_recover(struct aub_device *adev, int chan)
+{
+	struct aub_recovery_stats *rs = &adev->recovery[chan];
+	uint64_t start = time_ns();
+
+	__atomic_fetch_add(&rs->halts, 1, __ATOMIC_RELAXED);
+	if (libusb_clear_halt(adev->hdev, (chan == AUB_CHAN_IN) ? BULK_ENDPOINT_IN : BULK_ENDPOINT_OUT)) {
+		__atomic_fetch_add(&rs->failures, 1, __ATOMIC_RELAXED);
+		return AUB_ERROR_IO;
+	}
+	__atomic_fetch_add(&rs->recoveries, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&rs->lost_max, adev->wmaxpacketsize, __ATOMIC_RELAXED);
+	__atomic_store_n(&rs->last_duration_ns, time_ns() - start, __ATOMIC_RELAXED);
+	return AUB_SUCCESS;
+}
+
+/* Callback context, lock held: OUT transfers behind the halted one are cancelled so nothing overtakes its tail */
+static void stream_halt(struct aub_stream *s, struct aub_stream_xfer *sx)
+{
+	if (s->halted)
+		return;
+	s->halted = 1;
+	if (s->chan != AUB_CHAN_OUT)
+		return;
+	for (unsigned int i = 0; i < s->cfg.transfer_count; i++) {
+		if (s->xfers[i].active && (&s->xfers[i] != sx))
+			libusb_cancel_transfer(s->xfers[i].xfer);
+	}
+}
+
+/* User thread: once every transfer of a halted stream is back, clear the halt and requeue */
+static int stream_recover(struct aub_stream *s)
+{
+	struct aub_stream_xfer *sx;
+	int res;
+
+	lock_get(&s->lock);
+	res = s->halted && (s->stats.inflight == 0) && !s->error;
+	lock_put(&s->lock);
+	if (!res)
+		return AUB_SUCCESS;
+
+	res = ep_recover(s->adev, s->chan);
+	lock_get(&s->lock);
+	s->halted = 0;
+	if (res)
+		s->error = 1;
+	if (s->chan == AUB_CHAN_IN) {
+		while (s->running && !s->error && !list_empty(&s->xfer_idle) && !list_empty(&s->buf_free)) {
+			sx = list_entry(s->xfer_idle.next, struct aub_stream_xfer, list);
+			list_del(&sx->list);
+			sx->buf = list_entry(s->buf_free.next, struct aub_stream_buf, list);
+			list_del(&sx->buf->list);
+			stream_submit_in(s, sx);
+		}
+	} else {
+		/* Tails keep their buffer and length, only the unsent part is left */
+		while (!list_empty(&s->xfer_halted)) {
+			sx = list_entry(s->xfer_halted.next, struct aub_stream_xfer, list);
+			list_del(&sx->list);
+			sx->submit_ns = trace_begin();
+			if (s->error || libusb_submit_transfer(sx->xfer)) {
+				if (!s->error)
+					s->stats.errors++;
+				s->error = 1;
+				list_add_tail(&sx->list, &s->xfer_idle);
+				continue;
+			}
+			sx->active = 1;
+			s->stats.inflight++;
+		}
+	}
+	res = s->error ? AUB_ERROR_IO : AUB_SUCCESS;
+	lock_put(&s->lock);
+	return res;
+}
+
+/* Prefetch thread: returns non-zero if transfers were restarted after a cleared halt */
+static int prefetch_recover(struct aub_prefetch *pf)
+{
+	int res;
+
+	lock_get(&pf->lock);
+	res = pf->halted && pf->running && !pf->error;
+	lock_put(&pf->lock);
+	if (!res)
+		return 0;
+
+	res = ep_recover(pf->adev, AUB_CHAN_IN);
+	lock_get(&pf->lock);
+	pf->halted = 0;
+	if (res)
+		ring_store(&pf->error, 1);
+	for (unsigned int i = 0; (i < pf->cfg.transfer_count) && pf->running && !pf->error; i++)
+		prefetch_submit(pf, &pf->xfers[i]);
+	res = (ring_load(&pf->inflight) != 0);
+	lock_put(&pf->lock);
+	return res;
+}
+
+/* Producer thread: only handles events, transfers are requeued from callback */
+static THREAD_FN prefetch_thread(void *arg)
+{
+	struct aub_prefetch *pf = (struct aub_prefetch *)arg;
+
+	do {
+		while (ring_load(&pf->inflight))
+			stream_pump(PREFETCH_EVENT_TIMEOUT);
+	} while (prefetch_recover(pf));
+	return THREAD_EXIT;
+}
+
+static void LIBUSB_CALL prefetch_callback(struct libusb_transfer *xfer)
+{
+	struct aub_prefetch_xfer *px = (struct aub_prefetch_xfer *)xfer->user_data;
+	struct aub_prefetch *pf = px->pf;
+	uint64_t fill;
+	int len = 0;
+
+	trace_end(pf->adev, px->submit_ns, AUB_TRACE_ASYNC, xfer->endpoint, 0, 0, xfer->length, xfer->actual_length, trace_status(xfer->status));
+	lock_get(&pf->lock);
+	px->active = 0;
+
+	switch (xfer->status) {
+	case LIBUSB_TRANSFER_STALL:
+		/* Thread clears the halt once all transfers are back */
+		pf->halted = 1;
+		/* fall through */
+	case LIBUSB_TRANSFER_COMPLETED:
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		len = xfer->actual_length;
+		break;
+	case LIBUSB_TRANSFER_CANCELLED:
+		break;
+	default:
+		pf->stats.errors++;
+		ring_store(&pf->error, 1);
+		break;
+	}
+
+	/* Transfers complete in submission order, so slots are published in order too */
+	if (px->slot >= 0) {
+		pf->slot_len[px->slot % pf->nslots] = len;
+		ring_store(&pf->head, pf->head + 1);
+		ring_store(&pf->bytes_in, pf->bytes_in + len);
+		if (len > 0) {
+			pf->gap = 0;
+			pf->stats.bytes += len;
+			fill = pf->stats.bytes - ring_load(&pf->bytes_out);
+			if (fill > pf->stats.fill_max)
+				pf->stats.fill_max = fill;
+		}
+	} else if (len > 0) {
+		if (!pf->gap) {
+			pf->gap = 1;
+			pf->stats.overruns++;
+			pf->stats.overrun_offset = pf->stats.bytes;
+			pf->stats.overrun_ns = time_ns();
+		}
+		pf->stats.dropped += len;
+	}
+
+	/* Requeue first so the thread never sees zero in flight while running */
+	if (pf->running && !pf->error && !pf->halted)
+		prefetch_submit(pf, px);
+	ring_store(&pf->inflight, pf->inflight - 1);
+	lock_put(&pf->lock);
+}
+
+/* Must be called with latency lock held */
+static int latency_submit(struct aub_latency *lat, struct aub_latency_xfer *lx)
+{
+	ring_store(&lx->done, 0);
+	lx->submit_ns = trace_begin();
+	if (libusb_submit_transfer(lx->xfer)) {
+		lat->stats.errors++;
+		return AUB_ERROR_IO;
+	}
+	lx->active = 1;
+	ring_store(&lat->inflight, lat->inflight + 1);
+	return AUB_SUCCESS;
+}
+
+/* Without event thread the waiting caller handles events and wakes up right at completion */
+static int latency_wait(struct aub_latency *lat, struct aub_latency_xfer *lx, uint64_t deadline_ns)
+{
+	struct timeval tv;
+	uint64_t now, left;
+
+	while (!ring_load(&lx->done)) {
+		now = time_ns();
+		if (!lat->cfg.thread) {
+			left = (now < deadline_ns) ? deadline_ns - now : 0;
+			if (lat->cfg.busy_poll)
+				left = 0;
+			else if (left > LATENCY_EVENT_TIMEOUT * 1000000ULL)
+				left = LATENCY_EVENT_TIMEOUT * 1000000ULL;
+			tv.tv_sec = (long)(left / 1000000000ULL);
+			tv.tv_usec = (long)(left % 1000000000ULL / 1000);
+			if (libusb_handle_events_timeout_completed(usb_ctx, &tv, &lx->done))
+				return AUB_ERROR_LOWLEVEL;
+			if (ring_load(&lx->done))
+				break;
+			now = time_ns();
+		} else if (!lat->cfg.busy_poll && (now < deadline_ns)) {
+			latency_sleep();
+			now = time_ns();
+		}
+		if (now >= deadline_ns)
+			return AUB_ERROR_TIMEOUT;
+	}
+	return AUB_SUCCESS;
+}
+
+static uint64_t latency_deadline(int timeout)
+{
+	if (timeout < 0)
+		return UINT64_MAX;
+	return time_ns() + (uint64_t)timeout * 1000;
+}
+
+static void latency_sleep(void)
+{
+#ifdef _WIN32
+	Sleep(0);
+#else
+	struct timespec ts = {0, LATENCY_POLL_US * 1000};
+
+	nanosleep(&ts, NULL);
+#endif
+}
+
+/* Scheduling is best effort: without privileges the thread keeps normal priority (stats.realtime) */
+static void latency_sched(struct aub_latency *lat)
+{
+#ifdef _WIN32
+	if ((lat->cfg.priority > 0) && SetThreadPriority(lat->thread, THREAD_PRIORITY_TIME_CRITICAL))
+		lat->stats.realtime = 1;
+	if (lat->cfg.cpu_mask)
+		SetThreadAffinityMask(lat->thread, (DWORD_PTR)lat->cfg.cpu_mask);
+#else
+	struct sched_param sp;
+
+	if (lat->cfg.priority > 0) {
+		memset(&sp, 0, sizeof(sp));
+		sp.sched_priority = lat->cfg.priority;
+		if (!pthread_setschedparam(lat->thread, SCHED_FIFO, &sp))
+			lat->stats.realtime = 1;
+	}
+#ifdef __linux__
+	if (lat->cfg.cpu_mask) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		for (int i = 0; i < 64; i++) {
+			if ((lat->cfg.cpu_mask >> i) & 1)
+				CPU_SET(i, &set);
+		}
+		pthread_setaffinity_np(lat->thread, sizeof(set), &set);
+	}
+#endif
+#endif
+}
+
+/* Event thread: only handles events, transfers are submitted by the API calls */
+static THREAD_FN latency_thread(void *arg)
+{
+	struct aub_latency *lat = (struct aub_latency *)arg;
+	struct timeval tv = {0, 0};
+
+	while (ring_load(&lat->running) || ring_load(&lat->inflight)) {
+		if (lat->cfg.busy_poll)
+			libusb_handle_events_timeout_completed(usb_ctx, &tv, NULL);
+		else
+			stream_pump(LATENCY_EVENT_TIMEOUT);
+	}
+	return THREAD_EXIT;
+}
+
+/* Halted endpoint is cleared before its transfers are submitted again */
+static int latency_recover(struct aub_latency *lat, int chan)
+{
+	if (!(ring_load(&lat->halted) & (1 << chan)))
 		return AUB_SUCCESS;
+	if (ep_recover(lat->adev, chan))
+		return AUB_ERROR_IO;
+	lock_get(&lat->lock);
+	ring_store(&lat->halted, lat->halted & ~(1 << chan));
+	lock_put(&lat->lock);
+	return AUB_SUCCESS;
+}
+
+static void LIBUSB_CALL latency_callback(struct libusb_transfer *xfer)
+{
+	struct aub_latency_xfer *lx = (struct aub_latency_xfer *)xfer->user_data;
+	struct aub_latency *lat = lx->lat;
+	int chan = (xfer->endpoint & LIBUSB_ENDPOINT_IN) ? AUB_CHAN_IN : AUB_CHAN_OUT;
+
+	trace_end(lat->adev, lx->submit_ns, AUB_TRACE_ASYNC, xfer->endpoint, 0, 0, xfer->length, xfer->actual_length, trace_status(xfer->status));
+	lock_get(&lat->lock);
+	lx->active = 0;
+	switch (xfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		if (chan == AUB_CHAN_IN) {
+			lat->stats.messages_in++;
+			lat->stats.bytes_in += xfer->actual_length;
+		} else {
+			lat->stats.messages_out++;
+			lat->stats.bytes_out += xfer->actual_length;
+		}
+		break;
+	case LIBUSB_TRANSFER_CANCELLED:
+		break;
+	case LIBUSB_TRANSFER_STALL:
+		/* Halt is cleared by aub_latency_send()/aub_latency_recv() or aub_latency_stop() */
+		ring_store(&lat->halted, lat->halted | (1 << chan));
+		/* fall through */
+	default:
+		lat->stats.errors++;
+		break;
+	}
+	ring_store(&lx->done, 1);
+	ring_store(&lat->inflight, lat->inflight - 1);
+	lock_put(&lat->lock);
+}
+
+/* Tracing off costs one relaxed load per transfer */
+static inline uint64_t trace_begin(void)
+{
+#ifdef AUB_USDT
+	return time_ns();
+#else
+	return __atomic_load_n(&trace.enabled, __ATOMIC_RELAXED) ? time_ns() : 0;
+#endif
+}
+
+static inline void trace_end(struct aub_device *adev, uint64_t submit_ns, int kind, int endpoint, int request, int value, int length, int actual, int status)
+{
+	if (submit_ns)
+		trace_record(adev, submit_ns, kind, endpoint, request, value, length, actual, status);
+}
+
+static void trace_record(struct aub_device *adev, uint64_t submit_ns, int kind, int endpoint, int request, int value, int length, int actual, int status)
+{
+	struct aub_trace_slot *slot;
+	struct aub_trace_event ev;
+	uint64_t idx;
+
+	ev.submit_ns = submit_ns;
+	ev.complete_ns = time_ns();
+	ev.length = (length > 0) ? length : 0;
+	ev.actual = (actual > 0) ? actual : 0;
+	ev.status = (status < 0) ? status : 0;
+	ev.thread = trace_thread();
+	ev.devnum = adev->devnum;
+	ev.kind = kind;
+	ev.endpoint = endpoint;
+	ev.request = request;
+	ev.value = value;
+	if (ev.status == LIBUSB_ERROR_TIMEOUT)
+		ev.reason = AUB_TRACE_REASON_TIMEOUT;
+	else if (ev.status == LIBUSB_ERROR_PIPE)
+		ev.reason = AUB_TRACE_REASON_STALL;
+	else if (ev.status)
+		ev.reason = AUB_TRACE_REASON_ERROR;
+	else if (ev.actual < ev.length)
+		ev.reason = AUB_TRACE_REASON_SHORT;
+	else
+		ev.reason = AUB_TRACE_REASON_NONE;
+#ifdef AUB_USDT
+	DTRACE_PROBE8(aub, transfer, ev.devnum, ev.kind, ev.endpoint, ev.length, ev.actual, ev.status, ev.submit_ns, ev.complete_ns);
+#endif
+	if (!__atomic_load_n(&trace.enabled, __ATOMIC_ACQUIRE))
+		return;
+
+	idx = __atomic_fetch_add(&trace.head, 1, __ATOMIC_RELAXED);
+	slot = &trace.ring[idx & trace.mask];
+	__atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->ev = ev;
+	__atomic_store_n(&slot->seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+static int trace_status(enum libusb_transfer_status status)
+{
+	switch (status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		return 0;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		return LIBUSB_ERROR_TIMEOUT;
+	case LIBUSB_TRANSFER_CANCELLED:
+		return LIBUSB_ERROR_INTERRUPTED;
+	case LIBUSB_TRANSFER_STALL:
+		return LIBUSB_ERROR_PIPE;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		return LIBUSB_ERROR_NO_DEVICE;
+	case LIBUSB_TRANSFER_OVERFLOW:
+		return LIBUSB_ERROR_OVERFLOW;
+	default:
+		return LIBUSB_ERROR_IO;
+	}
+}
+
+static unsigned int trace_thread(void)
+{
+#if defined(_WIN32)
+	return (unsigned int)GetCurrentThreadId();
+#elif defined(__linux__)
+	return (unsigned int)syscall(SYS_gettid);
+#else
+	return (unsigned int)(uintptr_t)pthread_self();
+#endif
+}
+
+/* Synchronous transfers are complete events on their thread, asynchronous ones are async slices per endpoint */
+static void trace_write_json(FILE *f, const struct aub_trace_event *ev, uint64_t id, int first)
+{
+	static const char *const reasons[] = {"", "timeout", "short", "stall", "error"};
+	static const char *const requests[] = {"CFG_GET", "REG_OPER", "REG_BLOCK"};
+	const char *dir = (ev->endpoint & LIBUSB_ENDPOINT_IN) ? "IN" : "OUT";
+	char name[32], args[160];
+
+	if (ev->kind == AUB_TRACE_CONTROL)
+		snprintf(name, sizeof(name), "%s %s", (ev->request < 3) ? requests[ev->request] : "REQUEST", dir);
 	else
+		snprintf(name, sizeof(name), "%s 0x%02X", dir, ev->endpoint);
+	snprintf(args, sizeof(args), "{\"length\":%u,\"actual\":%u,\"status\":%d,\"reason\":\"%s\",\"value\":%u}",
+			 ev->length, ev->actual, ev->status, (ev->reason < 5) ? reasons[ev->reason] : "", ev->value);
+
+	if (ev->kind == AUB_TRACE_ASYNC) {
+		fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"async\",\"ph\":\"b\",\"id\":%llu,\"ts\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":%s},\n",
+				first ? "" : ",\n", name, (unsigned long long)id, ev->submit_ns / 1000.0, ev->devnum, ev->thread, args);
+		fprintf(f, "{\"name\":\"%s\",\"cat\":\"async\",\"ph\":\"e\",\"id\":%llu,\"ts\":%.3f,\"pid\":%u,\"tid\":%u}",
+				name, (unsigned long long)id, ev->complete_ns / 1000.0, ev->devnum, ev->thread);
+	} else {
+		fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":%s}",
+				first ? "" : ",\n", name, (ev->kind == AUB_TRACE_CONTROL) ? "control" : "bulk",
+				ev->submit_ns / 1000.0, (ev->complete_ns - ev->submit_ns) / 1000.0, ev->devnum, ev->thread, args);
+	}
+}
+
+#ifdef CRC32C_X86
+static CRC32C_TARGET uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t len)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	uint64_t c = crc, word;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&word, p, 8);
+		c = _mm_crc32_u64(c, word);
+	}
+	crc = (uint32_t)c;
+#endif
+	for (; len; p++, len--)
+		crc = _mm_crc32_u8(crc, *p);
+	return crc;
+}
+#elif defined(CRC32C_ARM)
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t len)
+{
+	uint64_t word;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&word, p, 8);
+		crc = __crc32cd(crc, word);
+	}
+	for (; len; p++, len--)
+		crc = __crc32cb(crc, *p);
+	return crc;
+}
+#endif
+
+/* Hardware CRC32C instruction if CPU has one, slicing-by-8 tables otherwise */
+static void crc32c_select(void)
+{
+	uint32_t c;
+	int hw = 0;
+
+	for (unsigned int i = 0; i < 256; i++) {
+		c = i;
+		for (int k = 0; k < 8; k++)
+			c = (c & 1) ? ((c >> 1) ^ 0x82F63B78) : (c >> 1);
+		crc32c_table[0][i] = c;
+	}
+	for (unsigned int i = 0; i < 256; i++) {
+		for (int t = 1; t < 8; t++)
+			crc32c_table[t][i] = (crc32c_table[t - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[t - 1][i] & 0xFF];
+	}
+#if defined(CRC32C_X86) && defined(_MSC_VER)
+	{
+		int info[4];
+
+		__cpuid(info, 1);
+		hw = (info[2] >> 20) & 1;
+	}
+#elif defined(CRC32C_X86)
+	hw = __builtin_cpu_supports("sse4.2");
+#elif defined(CRC32C_ARM)
+	hw = 1;
+#endif
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+	crc32c_update = hw ? crc32c_hw : crc32c_sw;
+#else
+	(void)hw;
+	crc32c_update = crc32c_sw;
+#endif
+}
+
+static uint32_t crc32c(const uint8_t *p, size_t len)
+{
+	return ~crc32c_update(0xFFFFFFFF, p, len);
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
+{
+	uint32_t lo, hi;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		lo = crc ^ load_le32(p);
+		hi = load_le32(p + 4);
+		crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+			  crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+			  crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^
+			  crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+	}
+	for (; len; p++, len--)
+		crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p) & 0xFF];
+	return crc;
+}
+
+/* Returns payload length for a valid frame, 0 for a rejected one */
+static int integrity_frame(struct aub_integrity *ic, const uint8_t *frame, uint8_t *out)
+{
+	uint32_t seq = load_le32(frame);
+
+	if (crc32c(frame, AUB_FRAME_SIZE - 4) != load_le32(frame + AUB_FRAME_SIZE - 4)) {
+		if (!ic->synced)
+			return 0;
+		ic->crc_errors++;
+		if (ic->cb)
+			ic->cb(ic->user, AUB_INTEGRITY_CRC, ic->seq, ic->seq);
+		/* One bad frame is corruption in place, two in a row mean alignment is lost */
+		if (++ic->bad < 2) {
+			ic->seq++;
+			return 0;
+		}
+		ic->synced = 0;
+		ic->resyncs++;
+		if (ic->cb)
+			ic->cb(ic->user, AUB_INTEGRITY_RESYNC, ic->seq, ic->seq);
+		return 0;
+	}
+
+	ic->bad = 0;
+	if (ic->synced && (seq != ic->seq)) {
+		ic->gaps++;
+		if ((int32_t)(seq - ic->seq) > 0)
+			ic->lost += seq - ic->seq;
+		if (ic->cb)
+			ic->cb(ic->user, ((int32_t)(seq - ic->seq) > 0) ? AUB_INTEGRITY_GAP : AUB_INTEGRITY_REPEAT, ic->seq, seq);
+	}
+	ic->synced = 1;
+	ic->seq = seq + 1;
+	ic->frames++;
+	ic->bytes += AUB_FRAME_PAYLOAD;
+	if (out)
+		memcpy(out, frame + 4, AUB_FRAME_PAYLOAD);
+	return AUB_FRAME_PAYLOAD;
+}
+
+/* Bytes that can be sent now, limit - bytes an empty FIFO would take */
+static int send_credit(struct aub_device *adev, int *limit)
+{
+	int64_t size = (int64_t)1 << adev->cfg.chan[AUB_CHAN_OUT].fifo_depth;
+	int width_k = adev->width_k[AUB_CHAN_OUT];
+	int64_t margin;
+	uint32_t fill;
+
+	if (reg_read(adev, REG_FOL, &fill, 1))
 		return AUB_ERROR_IO;
+	/* Small FIFOs keep most of their space usable */
+	margin = (IO_CREDIT_MARGIN + width_k - 1) / width_k;
+	if (margin > size / IO_CREDIT_MARGIN_DIV)
+		margin = size / IO_CREDIT_MARGIN_DIV;
+	*limit = credit_bytes(adev, size - margin);
+	return credit_bytes(adev, size - margin - fill);
 }
 
-static inline int request_cfg_get(struct aub_device *adev)
+/* Whole elements, rounded down to whole packets once at least one packet fits */
+static int credit_bytes(struct aub_device *adev, int64_t elements)
 {
-	int res = libusb_control_transfer(adev->hdev, REQUEST_TYPE_IN, REQUEST_CFG_GET, 0, 0, (uint8_t *)&adev->cfg, sizeof(struct aub_config), TIMEOUT);
-	if (res == sizeof(struct aub_config))
+	int64_t room = elements * adev->width_k[AUB_CHAN_OUT];
+
+	if (room <= 0)
+		return 0;
+	if (room > INT32_MAX)
+		room = INT32_MAX;
+	if (room >= adev->wmaxpacketsize)
+		return (int)(room / adev->wmaxpacketsize * adev->wmaxpacketsize);
+	return (int)room;
+}
+
+static void credit_sleep(void)
+{
+#ifdef _WIN32
+	Sleep(1);
+#else
+	struct timespec ts = {0, IO_CREDIT_POLL_US * 1000};
+
+	nanosleep(&ts, NULL);
+#endif
+}
+
+/* Packet length queue is used in packet mode only, streaming IN turns it off until next aub_set_mode() */
+static int plq_enable(struct aub_device *adev, int enable)
+{
+	uint32_t mcr;
+
+	adev->plq = 0;
+	if (!adev->cfg.plq || (adev->cfg.mode != AUB_MODE_PACKET))
+		return AUB_SUCCESS;
+	if (reg_read(adev, REG_MCR, &mcr, 1))
+		return AUB_ERROR_IO;
+	mcr = enable ? (mcr | REG_MCR_BIT_PLQ) : (mcr & ~REG_MCR_BIT_PLQ);
+	if (reg_write(adev, REG_MCR, &mcr, 1))
+		return AUB_ERROR_IO;
+	adev->plq = enable;
+	return AUB_SUCCESS;
+}
+
+/* Poll queue until a whole packet is waiting, returns number of queued lengths (bytes) */
+static int plq_wait(struct aub_device *adev, uint32_t *lengths, uint64_t deadline_at, uint64_t gap_at)
+{
+	uint32_t regs[1 + PLQ_WINDOW];
+	int count;
+
+	for (;;) {
+		if (reg_read(adev, REG_PQC, regs, 1 + PLQ_WINDOW))
+			return AUB_ERROR_IO;
+		count = (regs[0] > PLQ_WINDOW) ? PLQ_WINDOW : (int)regs[0];
+		if (count > 0) {
+			memcpy(lengths, regs + 1, count * sizeof(uint32_t));
+			return count;
+		}
+		if (io_wait(deadline_at, gap_at) == 0)
+			return AUB_ERROR_TIMEOUT;
+		credit_sleep();
+	}
+}
+
+/*
+ * Receive queued packets back to back and pop them. The whole batch is requested at once:
+ * packets of whole max-size packets share a transfer with the next one, a short packet
+ * ends the transfer and the rest is requested again, so no transfer reaches past the batch.
+ */
+static int plq_recv(struct aub_device *adev, unsigned char *pdata, const uint32_t *lengths, int count)
+{
+	int res, act_len, recv_len, len = 0, cur_len = 0, idle = 0;
+
+	for (int i = 0; i < count; i++)
+		len += (int)lengths[i];
+	while (cur_len < len) {
+		recv_len = len - cur_len;
+		if (recv_len > IO_CHUNK_PACKETS * adev->wmaxpacketsize)
+			recv_len = IO_CHUNK_PACKETS * adev->wmaxpacketsize;
+		res = bulk_recv(adev, pdata + cur_len, recv_len, &act_len, IO_WAIT_MAX);
+		cur_len += act_len;
+		/* Queued data is already in the device FIFO, give up after a few tries without progress */
+		idle = (act_len > 0) ? 0 : idle + 1;
+		if (res < 0) {
+			if ((res != LIBUSB_ERROR_PIPE) && (res != LIBUSB_ERROR_TIMEOUT))
+				return AUB_ERROR_IO;
+			if ((idle > IO_RECOVERY_MAX) || ((res == LIBUSB_ERROR_PIPE) && ep_recover(adev, AUB_CHAN_IN)))
+				return AUB_ERROR_IO;
+		}
+	}
+	if (request_reg_write(adev, REG_PQC, (uint16_t)count))
+		return AUB_ERROR_IO;
+	return AUB_SUCCESS;
+}
+
+/*
+ * Device compressor restarts its delta chain and sends a restart marker when (re)enabled, the decoder
+ * skips everything before the marker. Enabling clears the bit first, so it also restarts a running compressor.
+ */
+static int compress_enable(struct aub_device *adev, int enable)
+{
+	uint32_t mcr;
+
+	adev->compress = 0;
+	adev->zlen = 0;
+	adev->residue_len = 0;
+	aub_decode_init(&adev->dec, 8 * adev->width_k[AUB_CHAN_IN], adev->cfg.chan[AUB_CHAN_IN].endianess);
+	if (!adev->cfg.compress)
 		return AUB_SUCCESS;
+	if (reg_read(adev, REG_MCR, &mcr, 1))
+		return AUB_ERROR_IO;
+	mcr &= ~REG_MCR_BIT_COMPRESS;
+	if (reg_write(adev, REG_MCR, &mcr, 1))
+		return AUB_ERROR_IO;
+	if (enable) {
+		mcr |= REG_MCR_BIT_COMPRESS;
+		if (reg_write(adev, REG_MCR, &mcr, 1))
+			return AUB_ERROR_IO;
+	}
+	adev->compress = enable && (adev->cfg.mode == AUB_MODE_STREAM);
+	return AUB_SUCCESS;
+}
+
+/*
+ * Compressed stream: bytes are staged in zbuf and decoded straight into caller array. Staged bytes
+ * are only left over once the array is full, so a transfer is issued with an empty staging buffer.
+ * Size of compressed data is unknown up front, request what the samples would take uncompressed.
+ */
+static int compress_recv(struct aub_device *adev, unsigned char *pdata, int length, const struct aub_io_params *params)
+{
+	struct aub_prefetch *pf = &adev->pf;
+	int width_k = adev->width_k[AUB_CHAN_IN];
+	int count = length / width_k, max_len = IO_CHUNK_PACKETS * adev->wmaxpacketsize;
+	uint64_t deadline_at = 0, gap_at = 0;
+	unsigned char *ptr;
+	unsigned int used;
+	int res, act_len, recv_len, timeout, min_count, cur = 0, halts = 0;
+
+	min_count = (params->min_length > 0) ? params->min_length : count;
+	if (min_count > count)
+		min_count = count;
+	if (params->deadline >= 0)
+		deadline_at = time_ms() + params->deadline + 1;
+	if (params->gap >= 0)
+		gap_at = time_ms() + params->gap + 1;
+
+	for (;;) {
+		res = aub_decode(&adev->dec, adev->zbuf + adev->zpos, adev->zlen, pdata + cur * width_k, count - cur, &used);
+		adev->zpos += used;
+		adev->zlen -= used;
+		if (res < 0) {
+			/* Restart device so the decoder finds a marker instead of waiting for one forever */
+			if (compress_enable(adev, 1))
+				return AUB_ERROR_IO;
+			return cur ? cur : AUB_ERROR_IO;
+		}
+		cur += res;
+		if (cur >= min_count)
+			break;
+		timeout = io_wait(deadline_at, gap_at);
+		if (timeout == 0)
+			break;
+		adev->zpos = 0;
+		if (pf->running) {
+			act_len = prefetch_avail(pf, &ptr);
+			if (act_len > max_len)
+				act_len = max_len;
+			if (act_len > 0) {
+				memcpy(adev->zbuf, ptr, act_len);
+				prefetch_release(pf, act_len);
+			}
+			res = 0;
+			if (act_len == 0) {
+				if (ring_load(&pf->error))
+					return cur ? cur : AUB_ERROR_IO;
+				prefetch_sleep();
+			}
+		} else {
+			recv_len = (min_count - cur) * width_k;
+			recv_len = (recv_len + adev->wmaxpacketsize - 1) / adev->wmaxpacketsize * adev->wmaxpacketsize;
+			if (recv_len > max_len)
+				recv_len = max_len;
+			res = bulk_recv(adev, adev->zbuf, recv_len, &act_len, timeout);
+		}
+		adev->zlen = act_len;
+		if (act_len > 0)
+			halts = 0;
+		if ((act_len > 0) && (params->gap >= 0))
+			gap_at = time_ms() + params->gap + 1;
+		if (res < 0) {
+			if (res == LIBUSB_ERROR_PIPE) {
+				/* Recovery may lose a packet, block structure cannot be trusted after it */
+				if ((++halts > IO_RECOVERY_MAX) || ep_recover(adev, AUB_CHAN_IN) || compress_enable(adev, 1))
+					break;
+			} else if (res != LIBUSB_ERROR_TIMEOUT) {
+				return AUB_ERROR_IO;
+			}
+		}
+	}
+
+	return cur;
+}
+
+/* Non-blocking variant: decodes staged bytes and what the prefetch ring already holds */
+static int compress_try(struct aub_device *adev, unsigned char *pdata, int length)
+{
+	struct aub_prefetch *pf = &adev->pf;
+	int width_k = adev->width_k[AUB_CHAN_IN];
+	int count = length / width_k, max_len = IO_CHUNK_PACKETS * adev->wmaxpacketsize;
+	unsigned char *ptr;
+	unsigned int used;
+	int res, act_len, cur = 0;
+
+	for (;;) {
+		res = aub_decode(&adev->dec, adev->zbuf + adev->zpos, adev->zlen, pdata + cur * width_k, count - cur, &used);
+		adev->zpos += used;
+		adev->zlen -= used;
+		if (res < 0) {
+			if (compress_enable(adev, 1))
+				return AUB_ERROR_IO;
+			return cur ? cur : AUB_ERROR_IO;
+		}
+		cur += res;
+		if ((cur >= count) || adev->zlen || !pf->running)
+			break;
+		act_len = prefetch_avail(pf, &ptr);
+		if (act_len == 0)
+			break;
+		if (act_len > max_len)
+			act_len = max_len;
+		memcpy(adev->zbuf, ptr, act_len);
+		prefetch_release(pf, act_len);
+		adev->zpos = 0;
+		adev->zlen = act_len;
+	}
+
+	if (cur)
+		return cur;
+	return (pf->running && ring_load(&pf->error)) ? AUB_ERROR_IO : AUB_ERROR_NOT_READY;
+}
+
+#ifdef UNPACK_X86
+/* 12-bit: bytes 3k..3k+2 hold samples 2k (low 12 bits) and 2k+1 (high 12 bits) */
+static UNPACK_SSSE3_TARGET void unpack12_ssse3(const uint8_t *p, int16_t *out, unsigned int count, int is_signed)
+{
+	const __m128i shuf = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+	const __m128i lo = _mm_set1_epi32(0x00000FFF);
+	const __m128i hi = _mm_set1_epi32(0x0FFF0000);
+	uint64_t bytes = ((uint64_t)count * 12 + 7) / 8;
+	unsigned int i = 0;
+	__m128i v;
+
+	/* 8 samples from 12 bytes, 16-byte load must stay inside packed data */
+	for (; (i + 8 <= count) && ((uint64_t)i / 2 * 3 + 16 <= bytes); i += 8) {
+		v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + i / 2 * 3)), shuf);
+		v = _mm_or_si128(_mm_and_si128(v, lo), _mm_and_si128(_mm_srli_epi16(v, 4), hi));
+		if (is_signed)
+			v = _mm_srai_epi16(_mm_slli_epi16(v, 4), 4);
+		_mm_storeu_si128((__m128i *)(out + i), v);
+	}
+	unpack_sw(p + i / 2 * 3, out + i, count - i, 12, is_signed);
+}
+
+static UNPACK_AVX2_TARGET void unpack12_avx2(const uint8_t *p, int16_t *out, unsigned int count, int is_signed)
+{
+	const __m256i shuf = _mm256_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+										  0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+	const __m256i lo = _mm256_set1_epi32(0x00000FFF);
+	const __m256i hi = _mm256_set1_epi32(0x0FFF0000);
+	uint64_t bytes = ((uint64_t)count * 12 + 7) / 8;
+	unsigned int i = 0;
+	__m256i v;
+
+	/* 16 samples from 24 bytes, shuffle works per 128-bit lane so each lane gets its own 12 bytes */
+	for (; (i + 16 <= count) && ((uint64_t)i / 2 * 3 + 28 <= bytes); i += 16) {
+		v = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p + i / 2 * 3)));
+		v = _mm256_inserti128_si256(v, _mm_loadu_si128((const __m128i *)(p + i / 2 * 3 + 12)), 1);
+		v = _mm256_shuffle_epi8(v, shuf);
+		v = _mm256_or_si256(_mm256_and_si256(v, lo), _mm256_and_si256(_mm256_srli_epi16(v, 4), hi));
+		if (is_signed)
+			v = _mm256_srai_epi16(_mm256_slli_epi16(v, 4), 4);
+		_mm256_storeu_si256((__m256i *)(out + i), v);
+	}
+	unpack12_ssse3(p + i / 2 * 3, out + i, count - i, is_signed);
+}
+#endif
+
+/* Widest 12-bit kernel the CPU runs, other widths always use the scalar loop */
+static void unpack_select(void)
+{
+	void (*fn)(const uint8_t *p, int16_t *out, unsigned int count, int is_signed) = unpack12_sw;
+
+#if defined(UNPACK_X86) && defined(_MSC_VER)
+	{
+		int info[4];
+
+		__cpuid(info, 1);
+		if ((info[2] >> 9) & 1)
+			fn = unpack12_ssse3;
+		if (((info[2] >> 27) & 1) && ((_xgetbv(0) & 6) == 6)) {
+			__cpuidex(info, 7, 0);
+			if ((info[1] >> 5) & 1)
+				fn = unpack12_avx2;
+		}
+	}
+#elif defined(UNPACK_X86)
+	if (__builtin_cpu_supports("ssse3"))
+		fn = unpack12_ssse3;
+	if (__builtin_cpu_supports("avx2"))
+		fn = unpack12_avx2;
+#endif
+	unpack12 = fn;
+}
+
+static void unpack(const uint8_t *p, int16_t *out, unsigned int count, unsigned int width, int is_signed)
+{
+	if (width == 12)
+		unpack12(p, out, count, is_signed);
 	else
+		unpack_sw(p, out, count, width, is_signed);
+}
+
+/* Samples are packed LSB first: sample i starts at bit i * width of the byte stream */
+static void unpack_sw(const uint8_t *p, int16_t *out, unsigned int count, unsigned int width, int is_signed)
+{
+	uint32_t mask = (1u << width) - 1, sign = is_signed ? (1u << (width - 1)) : 0;
+	uint32_t acc = 0, v;
+	unsigned int bits = 0;
+
+	for (unsigned int i = 0; i < count; i++) {
+		while (bits < width) {
+			acc |= (uint32_t)*p++ << bits;
+			bits += 8;
+		}
+		v = acc & mask;
+		acc >>= width;
+		bits -= width;
+		out[i] = (int16_t)(uint16_t)((v ^ sign) - sign);
+	}
+}
+
+static void unpack12_sw(const uint8_t *p, int16_t *out, unsigned int count, int is_signed)
+{
+	unpack_sw(p, out, count, 12, is_signed);
+}
+
+/* Block: header {short, raw, width[5:0]}, count byte (short block only), values of width bits LSB first */
+static int decode_block(struct aub_decoder *dec, const uint8_t *p, unsigned int length, uint32_t *values, unsigned int *count)
+{
+	uint8_t buf[AUB_DECODE_BLOCK_MAX + 8];
+	unsigned int hdr, head, n, width, size, pos;
+	uint64_t mask;
+
+	if (length < 1)
+		return 0;
+	hdr = p[0];
+	head = (hdr & 0x80) ? 2 : 1;
+	if (length < head)
+		return 0;
+	n = (head == 2) ? p[1] : AUB_COMPRESS_BLOCK;
+	width = hdr & 0x3F;
+	if ((n == 0) || (n > AUB_COMPRESS_BLOCK) || (width > 8 * dec->width) || ((hdr & 0x40) && (width != 8 * dec->width)))
 		return AUB_ERROR_IO;
+	size = head + (n * width + 7) / 8;
+	if (length < size)
+		return 0;
+	/* Values are read 8 bytes at a time, block at the end of input is copied and padded */
+	if (length < size + 8) {
+		memcpy(buf, p, size);
+		memset(buf + size, 0, 8);
+		p = buf;
+	}
+	p += head;
+	mask = ((uint64_t)1 << width) - 1;
+	for (unsigned int i = 0; i < n; i++) {
+		pos = i * width;
+		values[i] = (uint32_t)((load_le64(p + pos / 8) >> (pos % 8)) & mask);
+	}
+	if (hdr & 0x40) {
+		dec->prev = values[n - 1];
+		dec->raw++;
+	} else {
+		decode_delta(values, n, &dec->prev);
+	}
+	dec->blocks++;
+	*count = n;
+	return (int)size;
+}
+
+/* Zigzag deltas to samples, arithmetic is modulo 2^32 and stores keep the low sample bits */
+static void decode_delta(uint32_t *values, unsigned int count, uint32_t *prev)
+{
+	uint32_t x = *prev;
+	unsigned int i = 0;
+
+#ifdef DECODE_SSE2
+	/* Running sum of 4 lanes in two shifted adds, carry is the last lane of previous group */
+	__m128i carry = _mm_set1_epi32((int)x), one = _mm_set1_epi32(1), v;
+
+	for (; i + 4 <= count; i += 4) {
+		v = _mm_loadu_si128((const __m128i *)(values + i));
+		v = _mm_xor_si128(_mm_srli_epi32(v, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(v, one)));
+		v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+		v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+		v = _mm_add_epi32(v, carry);
+		_mm_storeu_si128((__m128i *)(values + i), v);
+		carry = _mm_shuffle_epi32(v, 0xFF);
+	}
+	if (i)
+		x = values[i - 1];
+#endif
+	for (; i < count; i++) {
+		x += (values[i] >> 1) ^ (0 - (values[i] & 1));
+		values[i] = x;
+	}
+	*prev = x;
+}
+
+static void decode_store(struct aub_decoder *dec, const uint32_t *values, unsigned int count, uint8_t *out)
+{
+	unsigned int w = dec->width;
+
+	if (w == 1) {
+		for (unsigned int i = 0; i < count; i++)
+			out[i] = (uint8_t)values[i];
+	} else if (!dec->big_endian) {
+		for (unsigned int i = 0; i < count; i++) {
+			for (unsigned int k = 0; k < w; k++)
+				out[w * i + k] = (uint8_t)(values[i] >> (8 * k));
+		}
+	} else {
+		for (unsigned int i = 0; i < count; i++) {
+			for (unsigned int k = 0; k < w; k++)
+				out[w * i + k] = (uint8_t)(values[i] >> (8 * (w - 1 - k)));
+		}
+	}
 }
@@ -5,7 +5,7 @@
 // 
 // Create Date: 18.03.2021 19:32:35
 // Design Name: 
-// Module Name: arch_cdc_array, arch_cdc_reset, arch_fifo_axis, arch_fifo_async
+// Module Name: arch_cdc_array, arch_cdc_gray, arch_cdc_reset, arch_fifo_axis, arch_fifo_async
 // Project Name: axis_usbd
 // Target Devices:
 // Tool Versions:
@@ -72,6 +72,41 @@ end endgenerate
 
 endmodule
 
+//
+// CDC Gray (counters changing by at most one per source clock)
+//
+module arch_cdc_gray #(
+	parameter FPGA_VENDOR = "xilinx",
+	parameter FPGA_FAMILY = "7series",
+	parameter WIDTH = 2
+)
+(
+	input wire src_clk,
+	input wire [WIDTH-1:0]src_data,
+	input wire dst_clk,
+	output wire [WIDTH-1:0]dst_data
+);
+
+generate if ((FPGA_VENDOR == "xilinx") && (FPGA_FAMILY == "7series")) begin
+	xpm_cdc_gray #(
+		.DEST_SYNC_FF(3),
+		.INIT_SYNC_FF(0),
+		.REG_OUTPUT(1),
+		.SIM_ASSERT_CHK(0),
+		.SIM_LOSSLESS_GRAY_CHK(0),
+		.WIDTH(WIDTH)
+	) xpm_cdc_gray_inst (
+		.dest_out_bin(dst_data),
+		.dest_clk(dst_clk),
+		.src_clk(src_clk),
+		.src_in_bin(src_data)
+	);
+end else begin
+	initial $error("Unsupported FPGA Vendor or Family!");
+end endgenerate
+
+endmodule
+
 //
 // CDC Reset
 //
@@ -123,13 +158,22 @@ module arch_fifo_axis #(
 	input wire m_axis_tready,
 	output wire [7:0]m_axis_tdata,
 	output wire m_axis_tlast,
-	output wire axis_prog_full
+	output wire axis_prog_full,
+	output wire [31:0]axis_wr_data_count,
+	output wire [31:0]axis_rd_data_count
 );
 
 generate if ((FPGA_VENDOR == "xilinx") && (FPGA_FAMILY == "7series")) begin
 	localparam CLOCKING_MODE = (CLOCK_MODE == "ASYNC") ? "independent_clock" : "common_clock";
 	localparam PACKET_FIFO = (FIFO_PACKET == 0) ? "false" : "true";
-	localparam USE_ADV_FEATURES = (PROG_FULL_THRESHOLD != 0)? "1002" : "1000";
+	localparam USE_ADV_FEATURES = (PROG_FULL_THRESHOLD != 0)? "1406" : "1404";
+	localparam COUNT_WIDTH = $clog2(FIFO_DEPTH) + 1;
+
+	wire [COUNT_WIDTH-1:0]wr_data_count;
+	wire [COUNT_WIDTH-1:0]rd_data_count;
+
+	assign axis_wr_data_count = wr_data_count;
+	assign axis_rd_data_count = rd_data_count;
 
 	xpm_fifo_axis #(
 		.CDC_SYNC_STAGES(2),
@@ -140,14 +184,14 @@ generate if ((FPGA_VENDOR == "xilinx") && (FPGA_FAMILY == "7series")) begin
 		.PACKET_FIFO(PACKET_FIFO),
 		.PROG_EMPTY_THRESH(10),
 		.PROG_FULL_THRESH(PROG_FULL_THRESHOLD),
-		.RD_DATA_COUNT_WIDTH(1),
+		.RD_DATA_COUNT_WIDTH(COUNT_WIDTH),
 		.RELATED_CLOCKS(0),
 		.TDATA_WIDTH(DATA_WIDTH),
 		.TDEST_WIDTH(1),
 		.TID_WIDTH(1),
 		.TUSER_WIDTH(1),
 		.USE_ADV_FEATURES(USE_ADV_FEATURES),
-		.WR_DATA_COUNT_WIDTH(1)
+		.WR_DATA_COUNT_WIDTH(COUNT_WIDTH)
 	) xpm_fifo_axis_inst (
 		.almost_empty_axis(),
 		.almost_full_axis(),
@@ -162,10 +206,10 @@ generate if ((FPGA_VENDOR == "xilinx") && (FPGA_FAMILY == "7series")) begin
 		.m_axis_tvalid(m_axis_tvalid),
 		.prog_empty_axis(),
 		.prog_full_axis(axis_prog_full),
-		.rd_data_count_axis(),
+		.rd_data_count_axis(rd_data_count),
 		.s_axis_tready(s_axis_tready),
 		.sbiterr_axis(),
-		.wr_data_count_axis(),
+		.wr_data_count_axis(wr_data_count),
 		.injectdbiterr_axis(),
 		.injectsbiterr_axis(),
 		.m_aclk(m_aclk),
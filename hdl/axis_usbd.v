@@ -45,8 +45,8 @@ module axis_usbd #(
 	parameter [63:0]SERIAL = "AUBR0000",/* Serial NUmber */
 	parameter CHANNEL_IN_ENABLE = 1,	/* 0 - Disable, 1 - Enable */
 	parameter CHANNEL_OUT_ENABLE = 1,	/* 0 - Disable, 1 - Enable */
-	parameter PACKET_MODE = 0,			/* 0 - Stream Mode, 1 - Packet Mode */
-	parameter DATA_IN_WIDTH = 8,		/* 8, 16 or 32 */
+	parameter PACKET_MODE = 0,			/* 0 - Stream Mode, 1 - Packet Mode (after reset, switchable at runtime) */
+	parameter DATA_IN_WIDTH = 8,		/* 8, 16 or 32; 10, 12 or 14 - bit-packed */
 	parameter DATA_OUT_WIDTH = 8,		/* 8, 16 or 32 */
 	parameter DATA_IN_ENDIAN = 0,		/* 0 - Little Endian (LE), 1 - Big Endian (BE) */
 	parameter DATA_OUT_ENDIAN = 0,		/* 0 - Little Endian (LE), 1 - Big Endian (BE) */
@@ -55,7 +55,12 @@ module axis_usbd #(
 	parameter FIFO_IN_DEPTH = 1024,		/* Depth: 16 to 4194304 */
 	parameter FIFO_OUT_ENABLE = 1,		/* 0 - Disable, 1 - Enable */
 	parameter FIFO_OUT_PACKET = 0,		/* 0 - Stream, 1 - Packet */
-	parameter FIFO_OUT_DEPTH = 1024		/* Depth: 16 to 4194304 */
+	parameter FIFO_OUT_DEPTH = 1024,	/* Depth: 16 to 4194304 */
+	parameter FIFO_MERGE = 0,			/* Stream FIFO in EP1 clock-crossing FIFO: 0 - Separate, 1 - Merged */
+	parameter TEST_ENABLE = 0,			/* Link test generator/checker: 0 - Disable, 1 - Enable */
+	parameter MEM_ENABLE = 0,			/* AXI4 memory access on EP2: 0 - Disable, 1 - Enable */
+	parameter FRAME_ENABLE = 0,			/* IN stream sequence/CRC32C framing: 0 - Disable, 1 - Enable */
+	parameter COMPRESS_ENABLE = 0		/* IN stream block delta compression (8, 16 or 32): 0 - Disable, 1 - Enable */
 )
 (
 	/* UTMI Low Pin Interface Ports */
@@ -77,7 +82,33 @@ module axis_usbd #(
 	output wire m_axis_tvalid,
 	input wire m_axis_tready,
 	output wire [DATA_OUT_WIDTH-1:0]m_axis_tdata,
-	output wire m_axis_tlast
+	output wire m_axis_tlast,
+	/* AXI4 Master (aclk, MEM_ENABLE = 1) */
+	output wire [31:0]m_axi_awaddr,
+	output wire [7:0]m_axi_awlen,
+	output wire [2:0]m_axi_awsize,
+	output wire [1:0]m_axi_awburst,
+	output wire m_axi_awvalid,
+	input wire m_axi_awready,
+	output wire [31:0]m_axi_wdata,
+	output wire [3:0]m_axi_wstrb,
+	output wire m_axi_wlast,
+	output wire m_axi_wvalid,
+	input wire m_axi_wready,
+	input wire [1:0]m_axi_bresp,
+	input wire m_axi_bvalid,
+	output wire m_axi_bready,
+	output wire [31:0]m_axi_araddr,
+	output wire [7:0]m_axi_arlen,
+	output wire [2:0]m_axi_arsize,
+	output wire [1:0]m_axi_arburst,
+	output wire m_axi_arvalid,
+	input wire m_axi_arready,
+	input wire [31:0]m_axi_rdata,
+	input wire [1:0]m_axi_rresp,
+	input wire m_axi_rlast,
+	input wire m_axi_rvalid,
+	output wire m_axi_rready
 );
 
 function [15:0]config_channel;
@@ -102,9 +133,16 @@ function [15:0]config_channel;
 	8:  config_channel[2:1] = 2'b01;
 	16: config_channel[2:1] = 2'b10;
 	32: config_channel[2:1] = 2'b11;
+	10, 12, 14: config_channel[2:1] = 2'b01;
 	default: config_channel[2:1] = 2'b00; 
 	endcase
 	
+	/* Bit-packed samples are carried as a byte stream, packed width tells host how to unpack */
+	case (width)
+	10, 12, 14: config_channel[15:11] = width;
+	default: config_channel[15:11] = 5'd0;
+	endcase
+	
 	case (endian)
 	0: config_channel[3] = 1'b0;
 	1: config_channel[3] = 1'b1;
@@ -130,14 +168,23 @@ function [15:0]config_channel;
 endfunction
 
 localparam DATA_WIDTH = 8;
+localparam DATA_IN_PACKED = (DATA_IN_WIDTH == 10) || (DATA_IN_WIDTH == 12) || (DATA_IN_WIDTH == 14);
+localparam FIFO_IN_WIDTH = DATA_IN_PACKED ? 16 : DATA_IN_WIDTH;
+localparam COMPRESS_IN = (COMPRESS_ENABLE == 1) && (CHANNEL_IN_ENABLE == 1) && !DATA_IN_PACKED;
 localparam [15:0]CONFIG_CHAN_IN = config_channel(CHANNEL_IN_ENABLE, DATA_IN_WIDTH, DATA_IN_ENDIAN, FIFO_IN_ENABLE, FIFO_IN_PACKET, FIFO_IN_DEPTH);
 localparam [15:0]CONFIG_CHAN_OUT = config_channel(CHANNEL_OUT_ENABLE, DATA_OUT_WIDTH, DATA_OUT_ENDIAN, FIFO_OUT_ENABLE, FIFO_OUT_PACKET, FIFO_OUT_DEPTH);
+/* Merged FIFO holds bytes, a FIFO above the clock-crossing FIFO depth limit stays separate (same rule in usb_ep1_bridge) */
+localparam FIFO_MERGE_MAX = 4194304;
+localparam FIFO_IN_MERGED = (FIFO_MERGE == 1) && (FIFO_IN_ENABLE == 1) && (FIFO_IN_PACKET == 0) &&
+	((1 << (CONFIG_CHAN_IN[10:6] + CONFIG_CHAN_IN[2:1] - 1)) <= FIFO_MERGE_MAX);
+localparam FIFO_OUT_MERGED = (FIFO_MERGE == 1) && (FIFO_OUT_ENABLE == 1) && (FIFO_OUT_PACKET == 0) &&
+	((1 << (CONFIG_CHAN_OUT[10:6] + CONFIG_CHAN_OUT[2:1] - 1)) <= FIFO_MERGE_MAX);
 
 assign ulpi_data_t = ulpi_dir;
 
 wire m_fifo_tvalid;
 wire m_fifo_tready;
-wire [DATA_IN_WIDTH-1:0]m_fifo_tdata;
+wire [FIFO_IN_WIDTH-1:0]m_fifo_tdata;
 wire m_fifo_tlast;
 
 wire s_fifo_tvalid;
@@ -155,70 +202,193 @@ wire s_awc_tready;
 wire [7:0]s_awc_tdata;
 wire s_awc_tlast;
 
+wire packet_mode;
+wire compress_mode;
+wire [31:0]fifo_in_count;
+wire [31:0]fifo_out_count;
+wire [FIFO_IN_WIDTH-1:0]s_fifo_in_tdata;
+wire s_fifo_in_tlast;
+wire m_fifo_in_tlast;
+wire s_fifo_out_tlast;
+wire m_fifo_out_tlast;
+
+/* Bit-packed widths are zero-extended to a byte multiple in the user FIFO */
+assign s_fifo_in_tdata = s_axis_tdata;
+
 generate if (CHANNEL_IN_ENABLE) begin : CHANNEL_IN
-	if (FIFO_IN_ENABLE) begin : FIFO
+	/* Merged: buffering is provided by the EP1 IN clock-crossing FIFO in the bridge */
+	if (FIFO_IN_ENABLE && !FIFO_IN_MERGED) begin : FIFO
 		usb_blk_fifo #(
 			.FPGA_VENDOR(FPGA_VENDOR),
 			.FPGA_FAMILY(FPGA_FAMILY),
 			.CLOCK_MODE("SYNC"),
-			.FIFO_PACKET(PACKET_MODE & FIFO_IN_PACKET),
+			.FIFO_PACKET(FIFO_IN_PACKET),
 			.FIFO_DEPTH(FIFO_IN_DEPTH),
-			.DATA_WIDTH(DATA_IN_WIDTH),
+			.DATA_WIDTH(FIFO_IN_WIDTH),
 			.PROG_FULL_THRESHOLD(0)
 		) usb_blk_fifo_inst (
 			.s_aclk(aclk),
 			.s_aresetn(aresetn),
 			.s_axis_tvalid(s_axis_tvalid),
 			.s_axis_tready(s_axis_tready),
-			.s_axis_tdata(s_axis_tdata),
-			.s_axis_tlast(s_axis_tlast),
+			.s_axis_tdata(s_fifo_in_tdata),
+			.s_axis_tlast(s_fifo_in_tlast),
 			.m_aclk(aclk),
 			.m_axis_tvalid(m_fifo_tvalid),
 			.m_axis_tready(m_fifo_tready),
 			.m_axis_tdata(m_fifo_tdata),
-			.m_axis_tlast(m_fifo_tlast),
-			.axis_prog_full()
+			.m_axis_tlast(m_fifo_in_tlast),
+			.axis_prog_full(),
+			.axis_wr_data_count(fifo_in_count),
+			.axis_rd_data_count()
 		);
+		/* Packet FIFO in Stream Mode: every beat is a packet, boundaries are not forwarded */
+		if (FIFO_IN_PACKET) begin
+			assign s_fifo_in_tlast = packet_mode ? s_axis_tlast : 1'b1;
+			assign m_fifo_tlast = packet_mode ? m_fifo_in_tlast : 1'b0;
+		end else begin
+			assign s_fifo_in_tlast = s_axis_tlast;
+			assign m_fifo_tlast = m_fifo_in_tlast;
+		end
 	end else begin
 		assign m_fifo_tvalid = s_axis_tvalid;
 		assign s_axis_tready = m_fifo_tready;
-		assign m_fifo_tdata = s_axis_tdata;
+		assign m_fifo_tdata = s_fifo_in_tdata;
 		assign m_fifo_tlast = s_axis_tlast;
+		assign fifo_in_count = 0;
 	end
 	
-	axis_width_converter #(
-		.FPGA_VENDOR(FPGA_VENDOR),
-		.FPGA_FAMILY(FPGA_FAMILY),
-		.BIG_ENDIAN(DATA_IN_ENDIAN),
-		.WIDTH_IN(DATA_IN_WIDTH),
-		.WIDTH_OUT(DATA_WIDTH)
-	) axis_width_converter_inst (
-		.s_axis_aclk(aclk),
-		.s_axis_aresetn(aresetn),
-		.s_axis_tdata(m_fifo_tdata),
-		.s_axis_tvalid(m_fifo_tvalid),
-		.s_axis_tready(m_fifo_tready),
-		.s_axis_tlast(m_fifo_tlast),
-		.m_axis_aclk(aclk),
-		.m_axis_tdata(m_awc_tdata),
-		.m_axis_tvalid(m_awc_tvalid),
-		.m_axis_tready(m_awc_tready),
-		.m_axis_tlast(m_awc_tlast)
-	);
+	if (DATA_IN_PACKED) begin : PACKER
+		/* Samples packed LSB first into bytes, packet end pads the last byte in Packet Mode */
+		axis_bit_packer #(
+			.WIDTH_IN(DATA_IN_WIDTH)
+		) axis_bit_packer_inst (
+			.aclk(aclk),
+			.aresetn(aresetn),
+			.last_enable(packet_mode),
+			.s_axis_tdata(m_fifo_tdata[DATA_IN_WIDTH-1:0]),
+			.s_axis_tvalid(m_fifo_tvalid),
+			.s_axis_tready(m_fifo_tready),
+			.s_axis_tlast(m_fifo_tlast),
+			.m_axis_tdata(m_awc_tdata),
+			.m_axis_tvalid(m_awc_tvalid),
+			.m_axis_tready(m_awc_tready),
+			.m_axis_tlast(m_awc_tlast)
+		);
+	end else begin : CONVERTER
+		wire s_cnv_tvalid;
+		wire s_cnv_tready;
+		wire [7:0]m_cnv_tdata;
+		wire m_cnv_tvalid;
+		wire m_cnv_tready;
+		wire m_cnv_tlast;
+		
+		axis_width_converter #(
+			.FPGA_VENDOR(FPGA_VENDOR),
+			.FPGA_FAMILY(FPGA_FAMILY),
+			.BIG_ENDIAN(DATA_IN_ENDIAN),
+			.WIDTH_IN(DATA_IN_WIDTH),
+			.WIDTH_OUT(DATA_WIDTH)
+		) axis_width_converter_inst (
+			.s_axis_aclk(aclk),
+			.s_axis_aresetn(aresetn),
+			.s_axis_tdata(m_fifo_tdata),
+			.s_axis_tvalid(s_cnv_tvalid),
+			.s_axis_tready(s_cnv_tready),
+			.s_axis_tlast(m_fifo_tlast),
+			.m_axis_aclk(aclk),
+			.m_axis_tdata(m_cnv_tdata),
+			.m_axis_tvalid(m_cnv_tvalid),
+			.m_axis_tready(m_cnv_tready),
+			.m_axis_tlast(m_cnv_tlast)
+		);
+		
+		if (COMPRESS_IN) begin : COMPRESSOR
+			/* Selected at runtime in Stream Mode, held in reset otherwise.
+			 * Switched in once the raw path is quiet, drained (flushed) before switching back */
+			wire s_cmp_tready;
+			wire [7:0]m_cmp_tdata;
+			wire m_cmp_tvalid;
+			wire m_cmp_tlast;
+			wire cmp_idle;
+			reg cmp_sel;
+			reg cmp_stop;
+			reg [4:0]cnv_quiet;
+			
+			always @(posedge aclk) begin
+				if (aresetn == 1'b0) begin
+					cmp_sel <= 1'b0;
+					cmp_stop <= 1'b0;
+					cnv_quiet <= 0;
+				end else begin
+					if (m_cnv_tvalid == 1'b1) begin
+						cnv_quiet <= 0;
+					end else if (cnv_quiet[4] == 1'b0) begin
+						cnv_quiet <= cnv_quiet + 1;
+					end
+					if (cmp_sel == 1'b0) begin
+						if ((compress_mode == 1'b1) && (cnv_quiet[4] == 1'b1)) begin
+							cmp_sel <= 1'b1;
+						end
+					end else if (cmp_stop == 1'b0) begin
+						if (compress_mode == 1'b0) begin
+							cmp_stop <= 1'b1;
+						end
+					end else if (cmp_idle == 1'b1) begin
+						cmp_sel <= 1'b0;
+						cmp_stop <= 1'b0;
+					end
+				end
+			end
+			
+			axis_compressor #(
+				.WIDTH(DATA_IN_WIDTH)
+			) axis_compressor_inst (
+				.aclk(aclk),
+				.aresetn(aresetn & cmp_sel),
+				.flush(cmp_stop),
+				.idle(cmp_idle),
+				.s_axis_tdata(m_fifo_tdata),
+				.s_axis_tvalid(m_fifo_tvalid & cmp_sel & ~cmp_stop),
+				.s_axis_tready(s_cmp_tready),
+				.s_axis_tlast(m_fifo_tlast),
+				.m_axis_tdata(m_cmp_tdata),
+				.m_axis_tvalid(m_cmp_tvalid),
+				.m_axis_tready(m_awc_tready & cmp_sel),
+				.m_axis_tlast(m_cmp_tlast)
+			);
+			
+			assign s_cnv_tvalid = m_fifo_tvalid & ~cmp_sel & ~compress_mode;
+			assign m_fifo_tready = cmp_sel ? (s_cmp_tready & ~cmp_stop) : (s_cnv_tready & ~compress_mode);
+			assign m_cnv_tready = m_awc_tready & ~cmp_sel;
+			assign m_awc_tvalid = cmp_sel ? m_cmp_tvalid : m_cnv_tvalid;
+			assign m_awc_tdata = cmp_sel ? m_cmp_tdata : m_cnv_tdata;
+			assign m_awc_tlast = cmp_sel ? m_cmp_tlast : m_cnv_tlast;
+		end else begin
+			assign s_cnv_tvalid = m_fifo_tvalid;
+			assign m_fifo_tready = s_cnv_tready;
+			assign m_cnv_tready = m_awc_tready;
+			assign m_awc_tvalid = m_cnv_tvalid;
+			assign m_awc_tdata = m_cnv_tdata;
+			assign m_awc_tlast = m_cnv_tlast;
+		end
+	end
 end else begin
 	assign m_awc_tvalid = 1'b0;
 	assign s_axis_tready = 1'b0;
 	assign m_awc_tdata = 0;
 	assign m_awc_tlast = 1'b0;
+	assign fifo_in_count = 0;
 end endgenerate
 
 generate if (CHANNEL_OUT_ENABLE) begin : CHANNEL_OUT
-	if (FIFO_OUT_ENABLE) begin : FIFO
+	/* Merged: buffering is provided by the EP1 OUT clock-crossing FIFO in the bridge */
+	if (FIFO_OUT_ENABLE && !FIFO_OUT_MERGED) begin : FIFO
 		usb_blk_fifo #(
 			.FPGA_VENDOR(FPGA_VENDOR),
 			.FPGA_FAMILY(FPGA_FAMILY),
 			.CLOCK_MODE("SYNC"),
-			.FIFO_PACKET(PACKET_MODE & FIFO_OUT_PACKET),
+			.FIFO_PACKET(FIFO_OUT_PACKET),
 			.FIFO_DEPTH(FIFO_OUT_DEPTH),
 			.DATA_WIDTH(DATA_OUT_WIDTH),
 			.PROG_FULL_THRESHOLD(0)
@@ -228,19 +398,29 @@ generate if (CHANNEL_OUT_ENABLE) begin : CHANNEL_OUT
 			.s_axis_tvalid(s_fifo_tvalid),
 			.s_axis_tready(s_fifo_tready),
 			.s_axis_tdata(s_fifo_tdata),
-			.s_axis_tlast(s_fifo_tlast),
+			.s_axis_tlast(s_fifo_out_tlast),
 			.m_aclk(aclk),
 			.m_axis_tvalid(m_axis_tvalid),
 			.m_axis_tready(m_axis_tready),
 			.m_axis_tdata(m_axis_tdata),
-			.m_axis_tlast(m_axis_tlast),
-			.axis_prog_full()
+			.m_axis_tlast(m_fifo_out_tlast),
+			.axis_prog_full(),
+			.axis_wr_data_count(fifo_out_count),
+			.axis_rd_data_count()
 		);
+		if (FIFO_OUT_PACKET) begin
+			assign s_fifo_out_tlast = packet_mode ? s_fifo_tlast : 1'b1;
+			assign m_axis_tlast = packet_mode ? m_fifo_out_tlast : 1'b0;
+		end else begin
+			assign s_fifo_out_tlast = s_fifo_tlast;
+			assign m_axis_tlast = m_fifo_out_tlast;
+		end
 	end else begin
 		assign  m_axis_tvalid = s_fifo_tvalid;
 		assign s_fifo_tready = m_axis_tready;
 		assign m_axis_tdata = s_fifo_tdata;
 		assign m_axis_tlast = s_fifo_tlast;
+		assign fifo_out_count = 0;
 	end
 
 	axis_width_converter #(
@@ -267,6 +447,7 @@ end else begin
 	assign s_awc_tready = 1'b0;
 	assign m_axis_tdata = 0;
 	assign m_axis_tlast = 1'b0;
+	assign fifo_out_count = 0;
 end endgenerate
 
 usb_ep1_bridge #(
@@ -274,6 +455,11 @@ usb_ep1_bridge #(
 	.FPGA_FAMILY(FPGA_FAMILY),
 	.HIGH_SPEED(HIGH_SPEED),
 	.PACKET_MODE(PACKET_MODE),
+	.TEST_ENABLE(TEST_ENABLE),
+	.MEM_ENABLE(MEM_ENABLE),
+	.FRAME_ENABLE(FRAME_ENABLE),
+	.COMPRESS_ENABLE(COMPRESS_IN ? 1 : 0),
+	.FIFO_MERGE(FIFO_MERGE),
 	.CONFIG_CHAN({CONFIG_CHAN_OUT,CONFIG_CHAN_IN}),
 	.SERIAL(SERIAL)
 ) usb_ep1_bridge_inst (
@@ -292,7 +478,36 @@ usb_ep1_bridge #(
 	.m_axis_tvalid(s_awc_tvalid),
 	.m_axis_tready(s_awc_tready),
 	.m_axis_tdata(s_awc_tdata),
-	.m_axis_tlast(s_awc_tlast)
+	.m_axis_tlast(s_awc_tlast),
+	.packet_mode(packet_mode),
+	.compress_mode(compress_mode),
+	.fifo_in_count(fifo_in_count),
+	.fifo_out_count(fifo_out_count),
+	.m_axi_awaddr(m_axi_awaddr),
+	.m_axi_awlen(m_axi_awlen),
+	.m_axi_awsize(m_axi_awsize),
+	.m_axi_awburst(m_axi_awburst),
+	.m_axi_awvalid(m_axi_awvalid),
+	.m_axi_awready(m_axi_awready),
+	.m_axi_wdata(m_axi_wdata),
+	.m_axi_wstrb(m_axi_wstrb),
+	.m_axi_wlast(m_axi_wlast),
+	.m_axi_wvalid(m_axi_wvalid),
+	.m_axi_wready(m_axi_wready),
+	.m_axi_bresp(m_axi_bresp),
+	.m_axi_bvalid(m_axi_bvalid),
+	.m_axi_bready(m_axi_bready),
+	.m_axi_araddr(m_axi_araddr),
+	.m_axi_arlen(m_axi_arlen),
+	.m_axi_arsize(m_axi_arsize),
+	.m_axi_arburst(m_axi_arburst),
+	.m_axi_arvalid(m_axi_arvalid),
+	.m_axi_arready(m_axi_arready),
+	.m_axi_rdata(m_axi_rdata),
+	.m_axi_rresp(m_axi_rresp),
+	.m_axi_rlast(m_axi_rlast),
+	.m_axi_rvalid(m_axi_rvalid),
+	.m_axi_rready(m_axi_rready)
 );
 
 endmodule
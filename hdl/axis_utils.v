@@ -5,7 +5,7 @@
 // 
 // Create Date: 18.03.2021 18:40:04
 // Design Name: 
-// Module Name: axis_width_converter
+// Module Name: axis_width_converter, axis_bit_packer, axis_compressor
 // Project Name: axis_usbd
 // Target Devices:
 // Tool Versions:
@@ -153,3 +153,371 @@ arch_fifo_async #(
 );
 
 endmodule
+
+module axis_bit_packer #(
+	parameter WIDTH_IN = 12 	// 10,12,14
+)
+(
+	input wire aclk,
+	input wire aresetn,
+	input wire last_enable,		/* 1 - tlast pads last byte and is forwarded, 0 - continuous bit stream */
+	input wire [WIDTH_IN-1:0]s_axis_tdata,
+	input wire s_axis_tvalid,
+	output wire s_axis_tready,
+	input wire s_axis_tlast,
+	output wire [7:0]m_axis_tdata,
+	output wire m_axis_tvalid,
+	input wire m_axis_tready,
+	output wire m_axis_tlast
+);
+
+localparam ACC_WIDTH = WIDTH_IN + 8;
+
+reg [ACC_WIDTH-1:0]acc;
+reg [4:0]bits;
+reg flush;
+reg [ACC_WIDTH-1:0]acc_next;
+reg [4:0]bits_next;
+wire in_fire;
+wire out_fire;
+
+/* Byte out when 8 bits are collected (or packet end is padded), sample in while less than 8 bits will be left */
+assign m_axis_tdata = acc[7:0];
+assign m_axis_tvalid = (bits >= 8) || ((flush == 1'b1) && (bits != 0));
+assign m_axis_tlast = (flush == 1'b1) && (bits <= 8);
+assign s_axis_tready = (flush == 1'b0) && ((bits < 8) || ((bits < 16) && (m_axis_tready == 1'b1)));
+
+assign in_fire = s_axis_tvalid & s_axis_tready;
+assign out_fire = m_axis_tvalid & m_axis_tready;
+
+always @(*) begin
+	if (out_fire == 1'b1) begin
+		acc_next <= acc >> 8;
+		bits_next <= (bits > 8) ? bits - 8 : 0;
+	end else begin
+		acc_next <= acc;
+		bits_next <= bits;
+	end
+end
+
+always @(posedge aclk) begin
+	if (aresetn == 1'b0) begin
+		acc <= 0;
+		bits <= 0;
+		flush <= 1'b0;
+	end else begin
+		if (in_fire == 1'b1) begin
+			acc <= acc_next | (s_axis_tdata << bits_next);
+			bits <= bits_next + WIDTH_IN;
+		end else begin
+			acc <= acc_next;
+			bits <= bits_next;
+		end
+		if ((in_fire == 1'b1) && (s_axis_tlast == 1'b1) && (last_enable == 1'b1)) begin
+			flush <= 1'b1;
+		end else if ((out_fire == 1'b1) && (m_axis_tlast == 1'b1)) begin
+			flush <= 1'b0;
+		end
+	end
+end
+
+endmodule
+
+/*
+ * Block delta compressor: blocks of 16 samples, each sample replaced by zigzag-coded difference
+ * to previous one, packed LSB first with the smallest bit width of the block.
+ * Block: header {short,raw,width[5:0]}, count byte (short block only), 16 * width bits.
+ * width = 0 - constant run (header only), raw - samples stored as is, tlast closes a short block.
+ * A partial block is also closed by flush and after FLUSH_CYCLES without input (0 - never).
+ */
+module axis_compressor #(
+	parameter WIDTH = 16, 	// 8,16,32
+	parameter FLUSH_CYCLES = 4096
+)
+(
+	input wire aclk,
+	input wire aresetn,
+	input wire flush,
+	output wire idle,
+	input wire [WIDTH-1:0]s_axis_tdata,
+	input wire s_axis_tvalid,
+	output wire s_axis_tready,
+	input wire s_axis_tlast,
+	output wire [7:0]m_axis_tdata,
+	output wire m_axis_tvalid,
+	input wire m_axis_tready,
+	output wire m_axis_tlast
+);
+
+localparam BLOCK = 16;
+/* Restart marker 7F 41 55 42 ("\x7FAUB"): header 7F is never a valid block, decoder skips input until it */
+localparam [31:0]SYNC = 32'h4255417F;
+
+localparam [2:0]
+	STATE_IDLE = 0,
+	STATE_HEADER = 1,
+	STATE_COUNT = 2,
+	STATE_DATA = 3,
+	STATE_END = 4,
+	STATE_SYNC = 5;
+
+function [5:0]bit_length;
+	input [WIDTH-1:0]value;
+	integer i;
+	begin
+		bit_length = 0;
+		for (i = 0; i < WIDTH; i = i + 1) begin
+			if (value[i] == 1'b1) begin
+				bit_length = i + 1;
+			end
+		end
+	end
+endfunction
+
+function [WIDTH-1:0]zigzag;
+	input [WIDTH-1:0]delta;
+	begin
+		zigzag = {delta[WIDTH-2:0],1'b0} ^ {WIDTH{delta[WIDTH-1]}};
+	end
+endfunction
+
+/* Two banks: one is filled while the other is sent */
+reg [WIDTH-1:0]mem[0:2*BLOCK-1];
+reg [1:0]bank_full;
+reg [4:0]bank_count[0:1];
+reg [WIDTH-1:0]bank_or[0:1];
+reg [WIDTH-1:0]bank_base[0:1];
+reg [1:0]bank_last;
+
+reg wr_bank;
+reg [3:0]wr_index;
+reg [WIDTH-1:0]wr_prev;
+reg [WIDTH-1:0]wr_base;
+reg [WIDTH-1:0]wr_or;
+wire [WIDTH-1:0]wr_or_next;
+wire wr_close;
+wire wr_flush;
+wire in_fire;
+reg [15:0]idle_count;
+
+reg [2:0]state;
+reg rd_bank;
+reg [4:0]rd_index;
+reg [4:0]rd_count;
+reg [5:0]rd_width;
+reg rd_raw;
+reg [WIDTH-1:0]rd_prev;
+wire [WIDTH-1:0]rd_data;
+wire [5:0]rd_length;
+
+reg [63:0]acc;
+reg [6:0]bits;
+reg [3:0]last_bytes;
+reg [63:0]acc_pop;
+reg [6:0]bits_pop;
+reg [63:0]push_data;
+reg [5:0]push_bits;
+reg push;
+wire out_fire;
+
+assign s_axis_tready = (bank_full[wr_bank] == 1'b0);
+assign in_fire = s_axis_tvalid & s_axis_tready;
+assign wr_or_next = wr_or | zigzag(s_axis_tdata - wr_prev);
+assign wr_close = (in_fire == 1'b1) && ((wr_index == BLOCK - 1) || (s_axis_tlast == 1'b1));
+assign wr_flush = (in_fire == 1'b0) && (wr_index != 0) && ((flush == 1'b1) || ((FLUSH_CYCLES != 0) && (idle_count == FLUSH_CYCLES - 1)));
+/* Nothing collected, queued or left in the accumulator */
+assign idle = (wr_index == 0) && (bank_full == 2'b00) && (state == STATE_IDLE) && (bits == 0);
+
+assign m_axis_tdata = acc[7:0];
+assign m_axis_tvalid = (bits >= 8);
+assign m_axis_tlast = (last_bytes == 1);
+assign out_fire = m_axis_tvalid & m_axis_tready;
+
+assign rd_data = mem[{rd_bank,rd_index[3:0]}];
+assign rd_length = bit_length(bank_or[rd_bank]);
+
+/* Collector */
+always @(posedge aclk) begin
+	if (aresetn == 1'b0) begin
+		wr_bank <= 1'b0;
+		wr_index <= 0;
+		wr_prev <= 0;
+		wr_base <= 0;
+		wr_or <= 0;
+	end else begin
+		if (in_fire == 1'b1) begin
+			mem[{wr_bank,wr_index}] <= s_axis_tdata;
+			wr_prev <= s_axis_tdata;
+			if (wr_close == 1'b1) begin
+				bank_count[wr_bank] <= wr_index + 1;
+				bank_or[wr_bank] <= wr_or_next;
+				bank_base[wr_bank] <= wr_base;
+				bank_last[wr_bank] <= s_axis_tlast;
+				wr_bank <= ~wr_bank;
+				wr_index <= 0;
+				wr_base <= s_axis_tdata;
+				wr_or <= 0;
+			end else begin
+				wr_index <= wr_index + 1;
+				wr_or <= wr_or_next;
+			end
+		end else if (wr_flush == 1'b1) begin
+			/* Short block without tlast, next block continues the delta chain */
+			bank_count[wr_bank] <= wr_index;
+			bank_or[wr_bank] <= wr_or;
+			bank_base[wr_bank] <= wr_base;
+			bank_last[wr_bank] <= 1'b0;
+			wr_bank <= ~wr_bank;
+			wr_index <= 0;
+			wr_base <= wr_prev;
+			wr_or <= 0;
+		end
+	end
+end
+
+always @(posedge aclk) begin
+	if ((aresetn == 1'b0) || (in_fire == 1'b1) || (wr_index == 0)) begin
+		idle_count <= 0;
+	end else if (idle_count != FLUSH_CYCLES - 1) begin
+		idle_count <= idle_count + 1;
+	end
+end
+
+always @(posedge aclk) begin
+	if (aresetn == 1'b0) begin
+		bank_full <= 2'b00;
+	end else begin
+		if ((wr_close == 1'b1) || (wr_flush == 1'b1)) begin
+			bank_full[wr_bank] <= 1'b1;
+		end
+		if (state == STATE_END) begin
+			bank_full[rd_bank] <= 1'b0;
+		end
+	end
+end
+
+/* Emitter: bit accumulator gives out a byte per clock and takes a field while 32 bits are free */
+always @(*) begin
+	if (out_fire == 1'b1) begin
+		acc_pop <= acc >> 8;
+		bits_pop <= bits - 8;
+	end else begin
+		acc_pop <= acc;
+		bits_pop <= bits;
+	end
+end
+
+always @(*) begin
+	case (state)
+	STATE_SYNC: begin
+		push_data <= {32'h0,SYNC};
+		push_bits <= 32;
+		push <= (bits_pop <= 32);
+	end
+	STATE_HEADER: begin
+		push_data <= {56'h0,(rd_count != BLOCK),rd_raw,rd_width};
+		push_bits <= 8;
+		push <= (bits_pop <= 32);
+	end
+	STATE_COUNT: begin
+		push_data <= {59'h0,rd_count};
+		push_bits <= 8;
+		push <= (bits_pop <= 32);
+	end
+	STATE_DATA: begin
+		push_data <= (rd_raw == 1'b1) ? rd_data : zigzag(rd_data - rd_prev);
+		push_bits <= rd_width;
+		push <= (bits_pop <= 32);
+	end
+	default: begin
+		push_data <= 0;
+		push_bits <= 0;
+		push <= 1'b0;
+	end
+	endcase
+end
+
+/* Every (re)start opens the output with a marker, delta chain starts from zero */
+always @(posedge aclk) begin
+	if (aresetn == 1'b0) begin
+		state <= STATE_SYNC;
+		rd_bank <= 1'b0;
+		rd_index <= 0;
+		rd_count <= 0;
+		rd_width <= 0;
+		rd_raw <= 1'b0;
+		rd_prev <= 0;
+		acc <= 0;
+		bits <= 0;
+		last_bytes <= 0;
+	end else begin
+		if (push == 1'b1) begin
+			acc <= acc_pop | (push_data << bits_pop);
+			bits <= bits_pop + push_bits;
+		end else if (state == STATE_END) begin
+			/* Pad block to whole bytes */
+			acc <= acc_pop;
+			bits <= (bits_pop + 7) & 7'h78;
+		end else begin
+			acc <= acc_pop;
+			bits <= bits_pop;
+		end
+		if ((state == STATE_END) && (bank_last[rd_bank] == 1'b1)) begin
+			last_bytes <= (bits_pop + 7) >> 3;
+		end else if ((out_fire == 1'b1) && (last_bytes != 0)) begin
+			last_bytes <= last_bytes - 1;
+		end
+		case (state)
+		STATE_SYNC: begin
+			if (push == 1'b1) begin
+				state <= STATE_IDLE;
+			end
+		end
+		STATE_IDLE: begin
+			/* Block with tlast is sent out completely before next one starts */
+			if ((bank_full[rd_bank] == 1'b1) && (last_bytes == 0)) begin
+				rd_index <= 0;
+				rd_count <= bank_count[rd_bank];
+				rd_raw <= (rd_length == WIDTH);
+				rd_width <= rd_length;
+				rd_prev <= bank_base[rd_bank];
+				state <= STATE_HEADER;
+			end
+		end
+		STATE_HEADER: begin
+			if (push == 1'b1) begin
+				if (rd_count != BLOCK) begin
+					state <= STATE_COUNT;
+				end else if (rd_width == 0) begin
+					state <= STATE_END;
+				end else begin
+					state <= STATE_DATA;
+				end
+			end
+		end
+		STATE_COUNT: begin
+			if (push == 1'b1) begin
+				state <= (rd_width == 0) ? STATE_END : STATE_DATA;
+			end
+		end
+		STATE_DATA: begin
+			if (push == 1'b1) begin
+				rd_prev <= rd_data;
+				rd_index <= rd_index + 1;
+				if (rd_index == rd_count - 1) begin
+					state <= STATE_END;
+				end
+			end
+		end
+		STATE_END: begin
+			rd_bank <= ~rd_bank;
+			state <= STATE_IDLE;
+		end
+		default: begin
+			state <= STATE_IDLE;
+		end
+		endcase
+	end
+end
+
+endmodule
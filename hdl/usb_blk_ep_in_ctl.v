@@ -41,7 +41,8 @@
 
 module usb_blk_ep_in_ctl #(
 	parameter FPGA_VENDOR = "xilinx",
-	parameter FPGA_FAMILY = "7series"
+	parameter FPGA_FAMILY = "7series",
+	parameter FIFO_DEPTH = 1024		/* Bytes, 1024 or more */
 )
 (
 	input wire rst,
@@ -56,7 +57,8 @@ module usb_blk_ep_in_ctl #(
 	input wire [7:0]axis_tdata,
 	input wire axis_tvalid,
 	output wire axis_tready,
-	input wire axis_tlast
+	input wire axis_tlast,
+	output wire [31:0]fifo_count	/* Bytes stored, usb_clk */
 );
 
 localparam [0:0]
@@ -73,13 +75,17 @@ wire m_axis_tready;
 wire [7:0]m_axis_tdata;
 wire m_axis_tlast;
 wire prog_full;
-wire was_last_usb;
 wire prog_full_usb;
-reg was_last;
+reg [15:0]last_wr_count;
+wire [15:0]last_wr_count_usb;
+reg [15:0]last_rd_count;
+wire has_last;
 reg blk_xfer_in_has_data_out;
 wire axis_rst;
 
 assign blk_xfer_in_has_data = blk_xfer_in_has_data_out;
+/* Packet end still in FIFO: gray count lags FIFO pointer sync, so visible count implies visible data */
+assign has_last = (last_wr_count_usb != last_rd_count) ? 1'b1 : 1'b0;
 
 assign s_axis_tdata = axis_tdata;
 assign s_axis_tvalid = axis_tvalid;
@@ -98,7 +104,7 @@ always @(posedge usb_clk) begin
 	end else begin
 		case (state)
 		STATE_IDLE: begin
-			if ((was_last_usb == 1'b1) || ((prog_full_usb == 1'b1) && (m_axis_tvalid == 1'b1))) begin
+			if (((has_last == 1'b1) || (prog_full_usb == 1'b1)) && (m_axis_tvalid == 1'b1)) begin
 				blk_xfer_in_has_data_out <= 1'b1;
 			end
 			if (blk_in_xfer == 1'b1) begin
@@ -115,14 +121,23 @@ always @(posedge usb_clk) begin
 	end
 end
 
+/* Packet ends written and read: data is offered below PROG_FULL only while an end is queued, no ZLP once drained */
 always @(posedge axis_clk) begin
 	if (axis_rst == 1'b1) begin
-		was_last <= 1'b0;
+		last_wr_count <= 0;
 	end else begin
 		if ((s_axis_tvalid == 1'b1) && (s_axis_tready == 1'b1) && (s_axis_tlast == 1'b1)) begin
-			was_last <= 1'b1;
-		end else if ((s_axis_tvalid == 1'b1) && (s_axis_tready == 1'b1) && (s_axis_tlast == 1'b0)) begin
-			was_last <= 1'b0;
+			last_wr_count <= last_wr_count + 1;
+		end
+	end
+end
+
+always @(posedge usb_clk) begin
+	if (rst == 1'b1) begin
+		last_rd_count <= 0;
+	end else begin
+		if ((m_axis_tvalid == 1'b1) && (m_axis_tready == 1'b1) && (m_axis_tlast == 1'b1)) begin
+			last_rd_count <= last_rd_count + 1;
 		end
 	end
 end
@@ -132,7 +147,7 @@ usb_blk_fifo #(
 	.FPGA_FAMILY(FPGA_FAMILY),
 	.CLOCK_MODE("ASYNC"),
 	.FIFO_PACKET(0),
-	.FIFO_DEPTH(1024),
+	.FIFO_DEPTH(FIFO_DEPTH),
 	.DATA_WIDTH(8),
 	.PROG_FULL_THRESHOLD(512)
 ) usb_blk_in_fifo (
@@ -147,18 +162,31 @@ usb_blk_fifo #(
 	.m_axis_tready(m_axis_tready),
 	.m_axis_tdata(m_axis_tdata),
 	.m_axis_tlast(m_axis_tlast),
-	.axis_prog_full(prog_full)
+	.axis_prog_full(prog_full),
+	.axis_wr_data_count(),
+	.axis_rd_data_count(fifo_count)
 );
 
 arch_cdc_array #(
 	.FPGA_VENDOR(FPGA_VENDOR),
 	.FPGA_FAMILY(FPGA_FAMILY),
-	.WIDTH(2)
+	.WIDTH(1)
 ) arch_cdc_array_inst (
 	.src_clk(axis_clk),
-	.src_data({prog_full,was_last}),
+	.src_data(prog_full),
+	.dst_clk(usb_clk),
+	.dst_data(prog_full_usb)
+);
+
+arch_cdc_gray #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.WIDTH(16)
+) arch_cdc_gray_inst (
+	.src_clk(axis_clk),
+	.src_data(last_wr_count),
 	.dst_clk(usb_clk),
-	.dst_data({prog_full_usb,was_last_usb})
+	.dst_data(last_wr_count_usb)
 );
 
 arch_cdc_reset #(
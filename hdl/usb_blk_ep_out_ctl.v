@@ -41,7 +41,8 @@
 
 module usb_blk_ep_out_ctl #(
 	parameter FPGA_VENDOR = "xilinx",
-	parameter FPGA_FAMILY = "7series"
+	parameter FPGA_FAMILY = "7series",
+	parameter FIFO_DEPTH = 1024		/* Bytes, 1024 or more */
 )
 (
 	input wire rst,
@@ -56,7 +57,8 @@ module usb_blk_ep_out_ctl #(
 	output wire [7:0]axis_tdata,
 	output wire axis_tvalid,
 	input wire axis_tready,
-	output wire axis_tlast
+	output wire axis_tlast,
+	output wire [31:0]fifo_count	/* Bytes stored, usb_clk */
 );
 
 wire s_axis_tvalid;
@@ -77,9 +79,9 @@ usb_blk_fifo #(
 	.FPGA_FAMILY(FPGA_FAMILY),
 	.CLOCK_MODE("ASYNC"),
 	.FIFO_PACKET(0),
-	.FIFO_DEPTH(1024),
+	.FIFO_DEPTH(FIFO_DEPTH),
 	.DATA_WIDTH(8),
-	.PROG_FULL_THRESHOLD(512)
+	.PROG_FULL_THRESHOLD(FIFO_DEPTH - 512)
 ) usb_blk_out_fifo (
 	.m_aclk(axis_clk),
 	.s_aclk(usb_clk),
@@ -92,7 +94,9 @@ usb_blk_fifo #(
     .m_axis_tready(axis_tready),
     .m_axis_tdata(axis_tdata),
     .m_axis_tlast(axis_tlast),
-    .axis_prog_full(prog_full)
+    .axis_prog_full(prog_full),
+    .axis_wr_data_count(fifo_count),
+    .axis_rd_data_count()
 );
 
 endmodule
@@ -59,7 +59,9 @@ module usb_blk_fifo #(
 	input wire m_axis_tready,
 	output wire [7:0]m_axis_tdata,
 	output wire m_axis_tlast,
-	output wire axis_prog_full
+	output wire axis_prog_full,
+	output wire [31:0]axis_wr_data_count,	/* Entries stored, s_aclk */
+	output wire [31:0]axis_rd_data_count	/* Entries stored, m_aclk */
 );
 
 arch_fifo_axis #(
@@ -82,7 +84,9 @@ arch_fifo_axis #(
 	.m_axis_tready(m_axis_tready),
 	.m_axis_tdata(m_axis_tdata),
 	.m_axis_tlast(m_axis_tlast),
-	.axis_prog_full(axis_prog_full)
+	.axis_prog_full(axis_prog_full),
+	.axis_wr_data_count(axis_wr_data_count),
+	.axis_rd_data_count(axis_rd_data_count)
 );
 
 endmodule
@@ -44,6 +44,11 @@ module usb_ep1_bridge #(
 	parameter FPGA_FAMILY = "7series",
 	parameter integer HIGH_SPEED = 1,
 	parameter PACKET_MODE = 1,
+	parameter TEST_ENABLE = 0,
+	parameter MEM_ENABLE = 0,
+	parameter FRAME_ENABLE = 0,
+	parameter COMPRESS_ENABLE = 0,
+	parameter FIFO_MERGE = 0,
 	parameter [31:0]CONFIG_CHAN = 0,
 	parameter [63:0]SERIAL = "AUBR0000"
 )
@@ -65,13 +70,62 @@ module usb_ep1_bridge #(
 	output wire m_axis_tvalid,
 	input wire m_axis_tready,
 	output wire [7:0]m_axis_tdata,
-	output wire m_axis_tlast
+	output wire m_axis_tlast,
+	/* Mode (sys_clk) */
+	output wire packet_mode,
+	output wire compress_mode,
+	/* FIFO Fill (sys_clk) */
+	input wire [31:0]fifo_in_count,
+	input wire [31:0]fifo_out_count,
+	/* AXI4 Master (sys_clk) */
+	output wire [31:0]m_axi_awaddr,
+	output wire [7:0]m_axi_awlen,
+	output wire [2:0]m_axi_awsize,
+	output wire [1:0]m_axi_awburst,
+	output wire m_axi_awvalid,
+	input wire m_axi_awready,
+	output wire [31:0]m_axi_wdata,
+	output wire [3:0]m_axi_wstrb,
+	output wire m_axi_wlast,
+	output wire m_axi_wvalid,
+	input wire m_axi_wready,
+	input wire [1:0]m_axi_bresp,
+	input wire m_axi_bvalid,
+	output wire m_axi_bready,
+	output wire [31:0]m_axi_araddr,
+	output wire [7:0]m_axi_arlen,
+	output wire [2:0]m_axi_arsize,
+	output wire [1:0]m_axi_arburst,
+	output wire m_axi_arvalid,
+	input wire m_axi_arready,
+	input wire [31:0]m_axi_rdata,
+	input wire [1:0]m_axi_rresp,
+	input wire m_axi_rlast,
+	input wire m_axi_rvalid,
+	output wire m_axi_rready
 );
 
+/* Merged FIFO: user stream FIFO is folded into the EP1 clock-crossing FIFO (CONFIG_CHAN: enable, FIFO, not packet),
+ * unless its size in bytes exceeds the FIFO depth limit (4194304) */
+localparam FIFO_MERGE_MAX = 4194304;
+localparam FIFO_IN_SHIFT = (CONFIG_CHAN[2:1] == 2'b00) ? 0 : CONFIG_CHAN[2:1] - 1;
+localparam FIFO_OUT_SHIFT = (CONFIG_CHAN[18:17] == 2'b00) ? 0 : CONFIG_CHAN[18:17] - 1;
+localparam FIFO_IN_BYTES = (1 << (CONFIG_CHAN[10:6] + FIFO_IN_SHIFT));
+localparam FIFO_OUT_BYTES = (1 << (CONFIG_CHAN[26:22] + FIFO_OUT_SHIFT));
+localparam FIFO_IN_MERGED = (FIFO_MERGE == 1) && CONFIG_CHAN[0] && CONFIG_CHAN[4] && !CONFIG_CHAN[5] && (FIFO_IN_BYTES <= FIFO_MERGE_MAX);
+localparam FIFO_OUT_MERGED = (FIFO_MERGE == 1) && CONFIG_CHAN[16] && CONFIG_CHAN[20] && !CONFIG_CHAN[21] && (FIFO_OUT_BYTES <= FIFO_MERGE_MAX);
+localparam EP1_IN_FIFO_DEPTH = (FIFO_IN_MERGED && (FIFO_IN_BYTES > 1024)) ? FIFO_IN_BYTES : 1024;
+localparam EP1_OUT_FIFO_DEPTH = (FIFO_OUT_MERGED && (FIFO_OUT_BYTES > 1024)) ? FIFO_OUT_BYTES : 1024;
+
 localparam CONFIG_DESC_LEN = 9;
 localparam INTERFACE_DESC_LEN = 9;
 localparam EP1_IN_DESC_LEN = 7;
 localparam EP1_OUT_DESC_LEN = 7;
+localparam EP2_IN_DESC_LEN = 7;
+localparam EP2_OUT_DESC_LEN = 7;
+localparam [7:0]NUM_ENDPOINTS = (MEM_ENABLE == 1) ? 4 : 2;
+localparam [15:0]TOTAL_DESC_LEN = CONFIG_DESC_LEN + INTERFACE_DESC_LEN + EP1_IN_DESC_LEN + EP1_OUT_DESC_LEN +
+	((MEM_ENABLE == 1) ? (EP2_IN_DESC_LEN + EP2_OUT_DESC_LEN) : 0);
 
 localparam CONFIG_DESC = {
 	8'h32,			// bMaxPower = 100 mA
@@ -79,7 +133,7 @@ localparam CONFIG_DESC = {
 	8'h00,			// iConfiguration
 	8'h01,			// bConfigurationValue
 	8'h01,			// bNumInterfaces = 1
-	16'h0020,		// wTotalLength = 32
+	TOTAL_DESC_LEN,	// wTotalLength = 32 (46 with EP2)
 	8'h02,			// bDescriptionType = Configuration Descriptor
 	8'h09			// bLength = 9
 };
@@ -89,7 +143,7 @@ localparam INTERFACE_DESC = {
 	8'h00,			// bInterfaceProtocol
 	8'h00,			// bInterfaceSubClass
 	8'h00,			// bInterfaceClass
-	8'h02,			// bNumEndpoints = 2
+	NUM_ENDPOINTS,	// bNumEndpoints = 2 (4 with EP2)
 	8'h00,			// bAlternateSetting
 	8'h00,			// bInterfaceNumber = 0
 	8'h04,			// bDescriptorType = Interface Descriptor
@@ -114,6 +168,28 @@ localparam EP1_OUT_DESC = {
 	8'h07			// bLength = 7
 };
 
+localparam EP2_IN_DESC = {
+	8'h00,			// bInterval
+	16'h0200,		// wMaxPacketSize = 512 bytes
+	8'h02,			// bmAttributes = Bulk
+	8'h82,			// bEndpointAddress = IN2
+	8'h05,			// bDescriptorType = Endpoint Descriptor
+	8'h07			// bLength = 7
+};
+
+localparam EP2_OUT_DESC = {
+	8'h00,			// bInterval
+	16'h0200,		// wMaxPacketSize = 512 bytes
+	8'h02,			// bmAttributes = Bulk
+	8'h02,			// bEndpointAddress = OUT2
+	8'h05,			// bDescriptorType = Endpoint Descriptor
+	8'h07			// bLength = 7
+};
+
+localparam USB_CONFIG_DESC = (MEM_ENABLE == 1) ?
+	{EP2_OUT_DESC,EP2_IN_DESC,EP1_OUT_DESC,EP1_IN_DESC,INTERFACE_DESC,CONFIG_DESC} :
+	{EP1_OUT_DESC,EP1_IN_DESC,INTERFACE_DESC,CONFIG_DESC};
+
 wire usb_clk;
 wire usb_reset;
 
@@ -154,6 +230,30 @@ wire tlp_blk_xfer_out_ready_read;
 wire [7:0]tlp_blk_xfer_out_data;
 wire tlp_blk_xfer_out_data_valid;
 
+/* Bulk endpoint select: EP2 is memory access, anything else goes to EP1 */
+wire ep1_sel;
+wire ep2_sel;
+
+wire ep1_tlp_blk_in_xfer;
+wire ep1_tlp_blk_out_xfer;
+wire ep1_tlp_blk_xfer_in_has_data;
+wire [7:0]ep1_tlp_blk_xfer_in_data;
+wire ep1_tlp_blk_xfer_in_data_valid;
+wire ep1_tlp_blk_xfer_in_data_ready;
+wire ep1_tlp_blk_xfer_in_data_last;
+wire ep1_tlp_blk_xfer_out_ready_read;
+wire ep1_tlp_blk_xfer_out_data_valid;
+
+wire ep2_blk_in_xfer;
+wire ep2_blk_out_xfer;
+wire ep2_blk_xfer_in_has_data;
+wire [7:0]ep2_blk_xfer_in_data;
+wire ep2_blk_xfer_in_data_valid;
+wire ep2_blk_xfer_in_data_ready;
+wire ep2_blk_xfer_in_data_last;
+wire ep2_blk_xfer_out_ready_read;
+wire ep2_blk_xfer_out_data_valid;
+
 wire ep_blk_in_xfer;
 wire ep_blk_xfer_in_has_data;
 wire [7:0]ep_blk_xfer_in_data;
@@ -177,15 +277,173 @@ wire ep1_out_axis_tvalid;
 wire ep1_out_axis_tready;
 wire ep1_out_axis_tlast;
 
-assign ep1_in_axis_tdata = s_axis_tdata;
-assign ep1_in_axis_tvalid = s_axis_tvalid;
-assign s_axis_tready = ep1_in_axis_tready;
-assign ep1_in_axis_tlast = s_axis_tlast;
+wire [7:0]ep1_frm_axis_tdata;
+wire ep1_frm_axis_tvalid;
+wire ep1_frm_axis_tready;
+wire ep1_frm_axis_tlast;
+
+wire packet_mode_usb;
+wire [31:0]fifo_in_count_usb;
+wire [31:0]fifo_out_count_usb;
+wire [31:0]fifo_in_count_cdc;
+wire [31:0]fifo_out_count_cdc;
+wire [31:0]ep1_in_fifo_count;
+wire [31:0]ep1_out_fifo_count;
+wire frame_mode_usb;
+wire plq_mode_usb;
+wire plq_mode;
+wire compress_mode_usb;
+
+wire ep1_in_ctl_tvalid;
+wire ep1_in_ctl_tready;
+
+reg [31:0]plq_length;
+wire plq_rst;
+wire plq_ready;
+wire plq_wr_en;
+wire plq_rd_en;
+wire [31:0]plq_data;
+wire plq_empty;
+wire plq_fifo_empty;
+wire plq_full;
+wire plq_rd_rst_busy;
+wire plq_wr_rst_busy;
+
+wire [3:0]test_ctl;
+wire [31:0]test_errors;
+wire test_locked;
+
+generate if (TEST_ENABLE) begin : TEST
+	usb_ep1_test #(
+		.FPGA_VENDOR(FPGA_VENDOR),
+		.FPGA_FAMILY(FPGA_FAMILY)
+	) usb_ep1_test_inst (
+		.rst(usb_reset),
+		.usb_clk(usb_clk),
+		.axis_clk(sys_clk),
+		.test_ctl(test_ctl),
+		.test_errors(test_errors),
+		.test_locked(test_locked),
+		.s_axis_tvalid(s_axis_tvalid),
+		.s_axis_tready(s_axis_tready),
+		.s_axis_tdata(s_axis_tdata),
+		.s_axis_tlast(s_axis_tlast),
+		.m_axis_tvalid(m_axis_tvalid),
+		.m_axis_tready(m_axis_tready),
+		.m_axis_tdata(m_axis_tdata),
+		.m_axis_tlast(m_axis_tlast),
+		.ep_in_axis_tvalid(ep1_in_axis_tvalid),
+		.ep_in_axis_tready(ep1_in_axis_tready),
+		.ep_in_axis_tdata(ep1_in_axis_tdata),
+		.ep_in_axis_tlast(ep1_in_axis_tlast),
+		.ep_out_axis_tvalid(ep1_out_axis_tvalid),
+		.ep_out_axis_tready(ep1_out_axis_tready),
+		.ep_out_axis_tdata(ep1_out_axis_tdata),
+		.ep_out_axis_tlast(ep1_out_axis_tlast)
+	);
+end else begin
+	assign ep1_in_axis_tdata = s_axis_tdata;
+	assign ep1_in_axis_tvalid = s_axis_tvalid;
+	assign s_axis_tready = ep1_in_axis_tready;
+	assign ep1_in_axis_tlast = s_axis_tlast;
+
+	assign m_axis_tvalid = ep1_out_axis_tvalid;
+	assign ep1_out_axis_tready = m_axis_tready;
+	assign m_axis_tdata = ep1_out_axis_tdata;
+	assign m_axis_tlast = ep1_out_axis_tlast;
+
+	assign test_errors = 0;
+	assign test_locked = 1'b0;
+end endgenerate
+
+generate if (FRAME_ENABLE) begin : FRAME
+	usb_ep1_frame #(
+		.FPGA_VENDOR(FPGA_VENDOR),
+		.FPGA_FAMILY(FPGA_FAMILY)
+	) usb_ep1_frame_inst (
+		.rst(usb_reset),
+		.usb_clk(usb_clk),
+		.axis_clk(sys_clk),
+		.frame_enable(frame_mode_usb & ~packet_mode_usb),
+		.s_axis_tvalid(ep1_in_axis_tvalid),
+		.s_axis_tready(ep1_in_axis_tready),
+		.s_axis_tdata(ep1_in_axis_tdata),
+		.s_axis_tlast(ep1_in_axis_tlast),
+		.m_axis_tvalid(ep1_frm_axis_tvalid),
+		.m_axis_tready(ep1_frm_axis_tready),
+		.m_axis_tdata(ep1_frm_axis_tdata),
+		.m_axis_tlast(ep1_frm_axis_tlast)
+	);
+end else begin
+	assign ep1_frm_axis_tdata = ep1_in_axis_tdata;
+	assign ep1_frm_axis_tvalid = ep1_in_axis_tvalid;
+	assign ep1_in_axis_tready = ep1_frm_axis_tready;
+	assign ep1_frm_axis_tlast = ep1_in_axis_tlast;
+end endgenerate
+
+/* Packet Length Queue: byte length of every packet-mode IN packet is pushed at tlast, IN stream stalls while queue is full */
+assign plq_ready = ~(plq_mode & (plq_full | plq_wr_rst_busy));
+assign plq_wr_en = plq_mode & ep1_frm_axis_tvalid & ep1_frm_axis_tready & ep1_frm_axis_tlast;
+assign plq_empty = plq_fifo_empty | plq_rd_rst_busy;
+assign ep1_in_ctl_tvalid = ep1_frm_axis_tvalid & plq_ready;
+assign ep1_frm_axis_tready = ep1_in_ctl_tready & plq_ready;
+
+always @(posedge sys_clk) begin
+	if ((plq_rst == 1'b1) || (packet_mode == 1'b0)) begin
+		plq_length <= 0;
+	end else begin
+		if ((ep1_frm_axis_tvalid == 1'b1) && (ep1_frm_axis_tready == 1'b1)) begin
+			plq_length <= (ep1_frm_axis_tlast == 1'b1) ? 0 : plq_length + 1;
+		end
+	end
+end
+
+arch_fifo_async #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.RD_DATA_WIDTH(32),
+	.WR_DATA_WIDTH(32)
+) arch_fifo_async_plq_inst (
+	.dout(plq_data),
+	.empty(plq_fifo_empty),
+	.full(plq_full),
+	.rd_rst_busy(plq_rd_rst_busy),
+	.wr_rst_busy(plq_wr_rst_busy),
+	.din(plq_length + 1),
+	.rd_clk(usb_clk),
+	.rd_en(plq_rd_en),
+	.rst(plq_rst | ~plq_mode),
+	.wr_clk(sys_clk),
+	.wr_en(plq_wr_en)
+);
+
+arch_cdc_reset #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY)
+) arch_cdc_reset_plq_inst (
+	.src_rst(usb_reset),
+	.dst_clk(sys_clk),
+	.dst_rst(plq_rst)
+);
+
+assign ep2_sel = (MEM_ENABLE == 1) && (blk_xfer_endpoint == 4'd2);
+assign ep1_sel = ~ep2_sel;
+
+assign ep1_tlp_blk_in_xfer = tlp_blk_in_xfer & ep1_sel;
+assign ep1_tlp_blk_out_xfer = tlp_blk_out_xfer & ep1_sel;
+assign ep1_tlp_blk_xfer_in_data_ready = tlp_blk_xfer_in_data_ready & ep1_sel;
+assign ep1_tlp_blk_xfer_out_data_valid = tlp_blk_xfer_out_data_valid & ep1_sel;
 
-assign m_axis_tvalid = ep1_out_axis_tvalid;
-assign ep1_out_axis_tready = m_axis_tready;
-assign m_axis_tdata = ep1_out_axis_tdata;
-assign m_axis_tlast = ep1_out_axis_tlast;
+assign ep2_blk_in_xfer = tlp_blk_in_xfer & ep2_sel;
+assign ep2_blk_out_xfer = tlp_blk_out_xfer & ep2_sel;
+assign ep2_blk_xfer_in_data_ready = tlp_blk_xfer_in_data_ready & ep2_sel;
+assign ep2_blk_xfer_out_data_valid = tlp_blk_xfer_out_data_valid & ep2_sel;
+
+assign tlp_blk_xfer_in_has_data = ep2_sel ? ep2_blk_xfer_in_has_data : ep1_tlp_blk_xfer_in_has_data;
+assign tlp_blk_xfer_in_data = ep2_sel ? ep2_blk_xfer_in_data : ep1_tlp_blk_xfer_in_data;
+assign tlp_blk_xfer_in_data_valid = ep2_sel ? ep2_blk_xfer_in_data_valid : ep1_tlp_blk_xfer_in_data_valid;
+assign tlp_blk_xfer_in_data_last = ep2_sel ? ep2_blk_xfer_in_data_last : ep1_tlp_blk_xfer_in_data_last;
+assign tlp_blk_xfer_out_ready_read = ep2_sel ? ep2_blk_xfer_out_ready_read : ep1_tlp_blk_xfer_out_ready_read;
 
 usb_tlp #(
 	.VENDOR_ID(16'hFACE),
@@ -196,8 +454,8 @@ usb_tlp #(
 	.PRODUCT("AXIS USB Bridge"),
 	.SERIAL_LEN(8),
 	.SERIAL(SERIAL),
-	.CONFIG_DESC_LEN(CONFIG_DESC_LEN + INTERFACE_DESC_LEN + EP1_IN_DESC_LEN + EP1_OUT_DESC_LEN),
-	.CONFIG_DESC({EP1_OUT_DESC,EP1_IN_DESC,INTERFACE_DESC,CONFIG_DESC}),
+	.CONFIG_DESC_LEN(TOTAL_DESC_LEN),
+	.CONFIG_DESC(USB_CONFIG_DESC),
 	.HIGH_SPEED(HIGH_SPEED)
 ) usb_tlp_inst (
 	.ulpi_data_in(ulpi_data_in),
@@ -245,10 +503,27 @@ usb_tlp #(
 usb_ep1_control #(
 	.HIGH_SPEED(HIGH_SPEED),
 	.PACKET_MODE(PACKET_MODE),
+	.TEST_ENABLE(TEST_ENABLE),
+	.MEM_ENABLE(MEM_ENABLE),
+	.FRAME_ENABLE(FRAME_ENABLE),
+	.COMPRESS_ENABLE(COMPRESS_ENABLE),
 	.CONFIG_CHAN(CONFIG_CHAN)
 ) usb_ep1_control_inst (
 	.clk(usb_clk),
 	.rst(usb_reset),
+	.usb_sof(usb_sof),
+	.packet_mode(packet_mode_usb),
+	.frame_mode(frame_mode_usb),
+	.plq_mode(plq_mode_usb),
+	.compress_mode(compress_mode_usb),
+	.fifo_in_count(fifo_in_count_usb),
+	.fifo_out_count(fifo_out_count_usb),
+	.test_ctl(test_ctl),
+	.test_errors(test_errors),
+	.test_locked(test_locked),
+	.plq_data(plq_data),
+	.plq_empty(plq_empty),
+	.plq_rd_en(plq_rd_en),
 	.ctl_xfer_endpoint(ctl_xfer_endpoint),
 	.ctl_xfer_type(ctl_xfer_type),
 	.ctl_xfer_request(ctl_xfer_request),
@@ -264,22 +539,22 @@ usb_ep1_control #(
 	.ctl_xfer_data_in_valid(ctl_xfer_data_in_valid),
 	.ctl_xfer_data_in_last(ctl_xfer_data_in_last),
 	.ctl_xfer_data_in_ready(ctl_xfer_data_in_ready),
-	.tlp_blk_in_xfer(tlp_blk_in_xfer),
-	.tlp_blk_xfer_in_has_data(tlp_blk_xfer_in_has_data),
-	.tlp_blk_xfer_in_data(tlp_blk_xfer_in_data),
-	.tlp_blk_xfer_in_data_valid(tlp_blk_xfer_in_data_valid),
-	.tlp_blk_xfer_in_data_ready(tlp_blk_xfer_in_data_ready),
-	.tlp_blk_xfer_in_data_last(tlp_blk_xfer_in_data_last),
+	.tlp_blk_in_xfer(ep1_tlp_blk_in_xfer),
+	.tlp_blk_xfer_in_has_data(ep1_tlp_blk_xfer_in_has_data),
+	.tlp_blk_xfer_in_data(ep1_tlp_blk_xfer_in_data),
+	.tlp_blk_xfer_in_data_valid(ep1_tlp_blk_xfer_in_data_valid),
+	.tlp_blk_xfer_in_data_ready(ep1_tlp_blk_xfer_in_data_ready),
+	.tlp_blk_xfer_in_data_last(ep1_tlp_blk_xfer_in_data_last),
 	.ep_blk_in_xfer(ep_blk_in_xfer),
 	.ep_blk_xfer_in_has_data(ep_blk_xfer_in_has_data),
 	.ep_blk_xfer_in_data(ep_blk_xfer_in_data),
 	.ep_blk_xfer_in_data_valid(ep_blk_xfer_in_data_valid),
 	.ep_blk_xfer_in_data_ready(ep_blk_xfer_in_data_ready),
 	.ep_blk_xfer_in_data_last(ep_blk_xfer_in_data_last),
-	.tlp_blk_out_xfer(tlp_blk_out_xfer),
-	.tlp_blk_xfer_out_ready_read(tlp_blk_xfer_out_ready_read),
+	.tlp_blk_out_xfer(ep1_tlp_blk_out_xfer),
+	.tlp_blk_xfer_out_ready_read(ep1_tlp_blk_xfer_out_ready_read),
 	.tlp_blk_xfer_out_data(tlp_blk_xfer_out_data),
-	.tlp_blk_xfer_out_data_valid(tlp_blk_xfer_out_data_valid),
+	.tlp_blk_xfer_out_data_valid(ep1_tlp_blk_xfer_out_data_valid),
 	.ep_blk_out_xfer(ep_blk_out_xfer),
 	.ep_blk_xfer_out_ready_read(ep_blk_xfer_out_ready_read),
 	.ep_blk_xfer_out_data(ep_blk_xfer_out_data),
@@ -290,7 +565,8 @@ usb_ep1_control #(
 
 usb_blk_ep_in_ctl #(
 	.FPGA_VENDOR(FPGA_VENDOR),
-	.FPGA_FAMILY(FPGA_FAMILY)
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.FIFO_DEPTH(EP1_IN_FIFO_DEPTH)
 ) usb_blk_ep_in_ctl_inst (
 	.rst(usb_reset),
 	.usb_clk(usb_clk),
@@ -301,15 +577,17 @@ usb_blk_ep_in_ctl #(
 	.blk_xfer_in_data_valid(ep_blk_xfer_in_data_valid),
 	.blk_xfer_in_data_ready(ep_blk_xfer_in_data_ready),
 	.blk_xfer_in_data_last(ep_blk_xfer_in_data_last),
-	.axis_tdata(ep1_in_axis_tdata),
-	.axis_tvalid(ep1_in_axis_tvalid),
-	.axis_tready(ep1_in_axis_tready),
-	.axis_tlast(ep1_in_axis_tlast)
+	.axis_tdata(ep1_frm_axis_tdata),
+	.axis_tvalid(ep1_in_ctl_tvalid),
+	.axis_tready(ep1_in_ctl_tready),
+	.axis_tlast(ep1_frm_axis_tlast),
+	.fifo_count(ep1_in_fifo_count)
 );
 
 usb_blk_ep_out_ctl #(
 	.FPGA_VENDOR(FPGA_VENDOR),
-	.FPGA_FAMILY(FPGA_FAMILY)
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.FIFO_DEPTH(EP1_OUT_FIFO_DEPTH)
 ) usb_blk_ep_out_ctl_inst (
 	.rst(usb_reset),
 	.usb_clk(usb_clk),
@@ -323,7 +601,188 @@ usb_blk_ep_out_ctl #(
 	.axis_tdata(ep1_out_axis_tdata),
 	.axis_tvalid(ep1_out_axis_tvalid),
 	.axis_tready(ep1_out_axis_tready),
-	.axis_tlast(ep1_out_axis_tlast)
+	.axis_tlast(ep1_out_axis_tlast),
+	.fifo_count(ep1_out_fifo_count)
+);
+
+generate if (MEM_ENABLE) begin : MEM
+	wire [7:0]ep2_out_axis_tdata;
+	wire ep2_out_axis_tvalid;
+	wire ep2_out_axis_tready;
+	wire [7:0]ep2_in_axis_tdata;
+	wire ep2_in_axis_tvalid;
+	wire ep2_in_axis_tready;
+	wire ep2_in_axis_tlast;
+	wire ep2_out_data_ready;
+	wire mem_rst;
+
+	usb_blk_ep_in_ctl #(
+		.FPGA_VENDOR(FPGA_VENDOR),
+		.FPGA_FAMILY(FPGA_FAMILY)
+	) usb_blk_ep2_in_ctl_inst (
+		.rst(usb_reset),
+		.usb_clk(usb_clk),
+		.axis_clk(sys_clk),
+		.blk_in_xfer(ep2_blk_in_xfer),
+		.blk_xfer_in_has_data(ep2_blk_xfer_in_has_data),
+		.blk_xfer_in_data(ep2_blk_xfer_in_data),
+		.blk_xfer_in_data_valid(ep2_blk_xfer_in_data_valid),
+		.blk_xfer_in_data_ready(ep2_blk_xfer_in_data_ready),
+		.blk_xfer_in_data_last(ep2_blk_xfer_in_data_last),
+		.axis_tdata(ep2_in_axis_tdata),
+		.axis_tvalid(ep2_in_axis_tvalid),
+		.axis_tready(ep2_in_axis_tready),
+		.axis_tlast(ep2_in_axis_tlast),
+		.fifo_count()
+	);
+
+	usb_blk_ep_out_ctl #(
+		.FPGA_VENDOR(FPGA_VENDOR),
+		.FPGA_FAMILY(FPGA_FAMILY)
+	) usb_blk_ep2_out_ctl_inst (
+		.rst(usb_reset),
+		.usb_clk(usb_clk),
+		.axis_clk(sys_clk),
+		.blk_out_xfer(ep2_blk_out_xfer),
+		.blk_xfer_out_ready_read(ep2_blk_xfer_out_ready_read),
+		.blk_xfer_out_data(tlp_blk_xfer_out_data),
+		.blk_xfer_out_data_ready(ep2_out_data_ready),
+		.blk_xfer_out_data_valid(ep2_blk_xfer_out_data_valid),
+		.blk_xfer_out_data_last(1'b0),
+		.axis_tdata(ep2_out_axis_tdata),
+		.axis_tvalid(ep2_out_axis_tvalid),
+		.axis_tready(ep2_out_axis_tready),
+		.axis_tlast(),
+		.fifo_count()
+	);
+
+	usb_ep2_mem usb_ep2_mem_inst (
+		.clk(sys_clk),
+		.rst(mem_rst),
+		.s_axis_tvalid(ep2_out_axis_tvalid),
+		.s_axis_tready(ep2_out_axis_tready),
+		.s_axis_tdata(ep2_out_axis_tdata),
+		.m_axis_tvalid(ep2_in_axis_tvalid),
+		.m_axis_tready(ep2_in_axis_tready),
+		.m_axis_tdata(ep2_in_axis_tdata),
+		.m_axis_tlast(ep2_in_axis_tlast),
+		.m_axi_awaddr(m_axi_awaddr),
+		.m_axi_awlen(m_axi_awlen),
+		.m_axi_awsize(m_axi_awsize),
+		.m_axi_awburst(m_axi_awburst),
+		.m_axi_awvalid(m_axi_awvalid),
+		.m_axi_awready(m_axi_awready),
+		.m_axi_wdata(m_axi_wdata),
+		.m_axi_wstrb(m_axi_wstrb),
+		.m_axi_wlast(m_axi_wlast),
+		.m_axi_wvalid(m_axi_wvalid),
+		.m_axi_wready(m_axi_wready),
+		.m_axi_bresp(m_axi_bresp),
+		.m_axi_bvalid(m_axi_bvalid),
+		.m_axi_bready(m_axi_bready),
+		.m_axi_araddr(m_axi_araddr),
+		.m_axi_arlen(m_axi_arlen),
+		.m_axi_arsize(m_axi_arsize),
+		.m_axi_arburst(m_axi_arburst),
+		.m_axi_arvalid(m_axi_arvalid),
+		.m_axi_arready(m_axi_arready),
+		.m_axi_rdata(m_axi_rdata),
+		.m_axi_rresp(m_axi_rresp),
+		.m_axi_rlast(m_axi_rlast),
+		.m_axi_rvalid(m_axi_rvalid),
+		.m_axi_rready(m_axi_rready)
+	);
+
+	arch_cdc_reset #(
+		.FPGA_VENDOR(FPGA_VENDOR),
+		.FPGA_FAMILY(FPGA_FAMILY)
+	) arch_cdc_reset_mem_inst (
+		.src_rst(usb_reset),
+		.dst_clk(sys_clk),
+		.dst_rst(mem_rst)
+	);
+end else begin
+	assign ep2_blk_xfer_in_has_data = 1'b0;
+	assign ep2_blk_xfer_in_data = 0;
+	assign ep2_blk_xfer_in_data_valid = 1'b0;
+	assign ep2_blk_xfer_in_data_last = 1'b0;
+	assign ep2_blk_xfer_out_ready_read = 1'b0;
+
+	assign m_axi_awaddr = 0;
+	assign m_axi_awlen = 0;
+	assign m_axi_awsize = 0;
+	assign m_axi_awburst = 0;
+	assign m_axi_awvalid = 1'b0;
+	assign m_axi_wdata = 0;
+	assign m_axi_wstrb = 0;
+	assign m_axi_wlast = 1'b0;
+	assign m_axi_wvalid = 1'b0;
+	assign m_axi_bready = 1'b0;
+	assign m_axi_araddr = 0;
+	assign m_axi_arlen = 0;
+	assign m_axi_arsize = 0;
+	assign m_axi_arburst = 0;
+	assign m_axi_arvalid = 1'b0;
+	assign m_axi_rready = 1'b0;
+end endgenerate
+
+arch_cdc_array #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.WIDTH(1)
+) arch_cdc_array_mode_inst (
+	.src_clk(usb_clk),
+	.src_data(packet_mode_usb),
+	.dst_clk(sys_clk),
+	.dst_data(packet_mode)
+);
+
+arch_cdc_array #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.WIDTH(1)
+) arch_cdc_array_plq_inst (
+	.src_clk(usb_clk),
+	.src_data(plq_mode_usb),
+	.dst_clk(sys_clk),
+	.dst_data(plq_mode)
+);
+
+arch_cdc_array #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.WIDTH(1)
+) arch_cdc_array_compress_inst (
+	.src_clk(usb_clk),
+	.src_data(compress_mode_usb),
+	.dst_clk(sys_clk),
+	.dst_data(compress_mode)
+);
+
+arch_cdc_gray #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.WIDTH(32)
+) arch_cdc_gray_fifo_in_inst (
+	.src_clk(sys_clk),
+	.src_data(fifo_in_count),
+	.dst_clk(usb_clk),
+	.dst_data(fifo_in_count_cdc)
 );
 
+arch_cdc_gray #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.WIDTH(32)
+) arch_cdc_gray_fifo_out_inst (
+	.src_clk(sys_clk),
+	.src_data(fifo_out_count),
+	.dst_clk(usb_clk),
+	.dst_data(fifo_out_count_cdc)
+);
+
+/* Merged FIFO: fill is read from the EP1 FIFO in usb_clk domain, bytes scaled to user words */
+assign fifo_in_count_usb = FIFO_IN_MERGED ? (ep1_in_fifo_count >> FIFO_IN_SHIFT) : fifo_in_count_cdc;
+assign fifo_out_count_usb = FIFO_OUT_MERGED ? (ep1_out_fifo_count >> FIFO_OUT_SHIFT) : fifo_out_count_cdc;
+
 endmodule
@@ -41,11 +41,32 @@
 module usb_ep1_control #(
 	parameter integer HIGH_SPEED = 1,
 	parameter PACKET_MODE = 1,
+	parameter TEST_ENABLE = 0,
+	parameter MEM_ENABLE = 0,
+	parameter FRAME_ENABLE = 0,
+	parameter COMPRESS_ENABLE = 0,
 	parameter [31:0]CONFIG_CHAN = 0
 )
 (
 	input wire clk,
 	input wire rst,
+	input wire usb_sof,
+	/* Link Test */
+	output wire [3:0]test_ctl,
+	/* Mode */
+	output wire packet_mode,
+	output wire frame_mode,
+	output wire plq_mode,
+	output wire compress_mode,
+	/* FIFO Fill */
+	input wire [31:0]fifo_in_count,
+	input wire [31:0]fifo_out_count,
+	input wire [31:0]test_errors,
+	input wire test_locked,
+
+	input wire [31:0]plq_data,
+	input wire plq_empty,
+	output wire plq_rd_en,
 	/* Control Xfer */
 	input wire [3:0]ctl_xfer_endpoint,
 	input wire [7:0]ctl_xfer_type,
@@ -97,14 +118,41 @@ localparam [2:0]
 	
 localparam [7:0]
 	REQUEST_CFG_GET = 0,
-	REQUEST_REG_OPER = 1;
+	REQUEST_REG_OPER = 1,		/* One 16-bit register, wValue - address */
+	REQUEST_REG_BLOCK = 2;		/* wLength/4 32-bit registers from wValue, little-endian */
 
 localparam [15:0]
 	REGADDR_TSR = 0,
 	REGADDR_TLR = 1,
-	REGADDR_RSR = 2;
+	REGADDR_RSR = 2,
+	REGADDR_SFL = 3,
+	REGADDR_SFH = 4,
+	REGADDR_SFP = 5,
+	REGADDR_PTL = 6,
+	REGADDR_PTH = 7,
+	REGADDR_PTP = 8,
+	REGADDR_TCR = 9,
+	REGADDR_TEL = 10,
+	REGADDR_TEH = 11,
+	REGADDR_MCR = 12,
+	REGADDR_FIL = 13,
+	REGADDR_FOL = 14,
+	REGADDR_PQC = 15,
+	REGADDR_PQ0 = 16,
+	REGADDR_PQ1 = 17,
+	REGADDR_PQ2 = 18,
+	REGADDR_PQ3 = 19,
+	REGADDR_PQ4 = 20,
+	REGADDR_PQ5 = 21,
+	REGADDR_PQ6 = 22,
+	REGADDR_PQ7 = 23,
+	REGADDR_TQC = 24,
+	REGADDR_TQ0 = 25,
+	REGADDR_TQ15 = 40;
+
+localparam integer TSQ_DEPTH = 8;
 
-localparam [47:0]CONFIG = {14'h0000, (PACKET_MODE == 1) ? 1'b1 : 1'b0, (HIGH_SPEED == 1) ? 1'b1 : 1'b0, CONFIG_CHAN};
+wire [47:0]config_data;
 	
 reg [2:0]state;
 
@@ -116,11 +164,16 @@ reg xfer_data_last;
 reg [15:0]reg_addr;
 reg [7:0]request;
 reg [15:0]length;
+reg [15:0]xfer_count;
+reg [1:0]reg_last;
+wire reg_request;
+wire [16:0]reg_setup_end;
 
 reg [15:0]reg_tsr;
 reg [15:0]reg_tlr;
 reg [15:0]reg_rsr;
 
+reg [31:0]reg_rd_data;
 reg [7:0]reg_data_out;
 integer byte_index;
 
@@ -136,6 +189,49 @@ reg rsr_rdy;
 reg rsr_lst;
 reg rsr_flag_clr;
 
+/* Timestamps */
+reg [31:0]sof_counter;
+reg [15:0]sof_phase;
+reg [31:0]pts_counter;
+reg [15:0]pts_phase;
+reg [31:0]sof_counter_latch;
+reg [15:0]sof_phase_latch;
+reg [31:0]pts_counter_latch;
+reg [15:0]pts_phase_latch;
+reg blk_in_xfer_prev;
+
+/* Mode */
+reg [15:0]reg_mcr;
+
+/* Link Test */
+reg [15:0]reg_tcr;
+reg tcr_clear;
+wire [15:0]tcr_status;
+reg [31:0]test_errors_latch;
+wire loopback_mode;
+reg out_hold;
+reg [7:0]out_hold_data;
+
+/* Packet Length Queue */
+reg [255:0]plq_window;
+reg [3:0]plq_count;
+reg [3:0]plq_pop;
+wire plq_pop_write;
+wire plq_fill;
+
+/* Packet Timestamp Queue */
+reg [TSQ_DEPTH*64-1:0]tsq_window;
+reg [3:0]tsq_count;
+reg [3:0]tsq_read;
+reg [15:0]tsq_seq;
+reg tsq_first;
+reg tsq_reading;
+wire tsq_mode;
+wire tsq_push;
+wire tsq_pop;
+wire [3:0]tsq_left;
+wire [15:0]tsq_regs;
+
 task XFER_ACCEPT;
 	begin
 		xfer_accept <= 1'b1;
@@ -159,7 +255,7 @@ endtask
 
 assign ctl_xfer_accept = xfer_accept;
 assign ctl_xfer_done = xfer_done;
-assign ctl_xfer_data_in = (request == REQUEST_REG_OPER) ? reg_data_out : xfer_data;
+assign ctl_xfer_data_in = ((request == REQUEST_REG_OPER) || (request == REQUEST_REG_BLOCK)) ? reg_data_out : xfer_data;
 assign ctl_xfer_data_in_valid = xfer_data_valid;
 assign ctl_xfer_data_in_last = xfer_data_last;
 
@@ -172,9 +268,33 @@ assign ep_blk_xfer_in_data_ready = tlp_blk_xfer_in_data_ready;
 
 assign tlp_blk_xfer_out_ready_read = ep_blk_xfer_out_ready_read;
 assign ep_blk_out_xfer = tlp_blk_out_xfer;
-assign ep_blk_xfer_out_data = tlp_blk_xfer_out_data;
-assign ep_blk_xfer_out_data_valid = tlp_blk_xfer_out_data_valid;
-assign ep_blk_xfer_out_data_last = tx_last;
+assign ep_blk_xfer_out_data = (loopback_mode == 1'b1) ? out_hold_data : tlp_blk_xfer_out_data;
+assign ep_blk_xfer_out_data_valid = (loopback_mode == 1'b1) ? (out_hold & (tlp_blk_xfer_out_data_valid | ~tlp_blk_out_xfer)) : tlp_blk_xfer_out_data_valid;
+assign ep_blk_xfer_out_data_last = (loopback_mode == 1'b1) ? ~tlp_blk_out_xfer : tx_last;
+
+assign packet_mode = reg_mcr[0];
+assign frame_mode = reg_mcr[1];
+assign plq_mode = reg_mcr[0] & reg_mcr[2];
+assign compress_mode = ~reg_mcr[0] & reg_mcr[3];
+assign tsq_mode = reg_mcr[0] & reg_mcr[4];
+assign config_data = {5'h00, 1'b1, (COMPRESS_ENABLE == 1) ? 1'b1 : 1'b0, 1'b1, 1'b1, (FRAME_ENABLE == 1) ? 1'b1 : 1'b0, 1'b1, (MEM_ENABLE == 1) ? 1'b1 : 1'b0, (TEST_ENABLE == 1) ? 1'b1 : 1'b0, 1'b1, packet_mode, (HIGH_SPEED == 1) ? 1'b1 : 1'b0, CONFIG_CHAN};
+
+assign test_ctl = {tcr_clear,reg_tcr[2:0]};
+/* Stream mode loopback: last byte of every bulk OUT packet carries tlast, so the echo is sent back at once */
+assign loopback_mode = (TEST_ENABLE == 1) && (reg_tcr[1:0] == 2'b10) && (packet_mode == 1'b0);
+/* Register read at SETUP: range [wValue, reg_setup_end) is about to be read */
+assign reg_request = (state == STATE_IDLE) && (ctl_xfer == 1'b1) && (ctl_xfer_type[7] == 1'b1) &&
+	((ctl_xfer_request == REQUEST_REG_OPER) || (ctl_xfer_request == REQUEST_REG_BLOCK));
+assign reg_setup_end = ctl_xfer_value + ((ctl_xfer_request == REQUEST_REG_BLOCK) ? ((ctl_xfer_length + 3) >> 2) : 1);
+assign plq_pop_write = (state == STATE_REG_WRITE) && (ctl_xfer_data_out_valid == 1'b1) && (reg_addr == REGADDR_PQC) && (byte_index == 0);
+assign plq_fill = (plq_mode == 1'b1) && (plq_count < 8) && (plq_empty == 1'b0) && (plq_pop == 0) && (plq_pop_write == 1'b0);
+assign plq_rd_en = plq_fill;
+/* Timestamp queue: first byte of every packet-mode IN packet pushes, last byte of a block read from TQC pops what it returned */
+assign tsq_push = (tsq_mode == 1'b1) && (tsq_first == 1'b1) && (ep_blk_xfer_in_data_valid == 1'b1) && (ep_blk_xfer_in_data_ready == 1'b1);
+assign tsq_pop = (tsq_reading == 1'b1) && (state == STATE_REG_READ) && (xfer_data_valid == 1'b1) && (ctl_xfer_data_in_ready == 1'b1) && (xfer_count == (length - 1));
+assign tsq_left = (tsq_pop == 1'b1) ? (tsq_count - tsq_read) : tsq_count;
+assign tsq_regs = (ctl_xfer_length >> 2) - 1;
+assign tcr_status = {7'h00,test_locked,5'h00,reg_tcr[2:0]};
 
 always @(posedge clk) begin
 	if (rst == 1'b1) begin
@@ -186,6 +306,8 @@ always @(posedge clk) begin
 		xfer_data_last <= 1'b0;
 		reg_addr <= 0;
 		byte_index <= 0;
+		xfer_count <= 0;
+		reg_last <= 0;
 	end else begin
 		case (state)
 		STATE_IDLE: begin
@@ -194,6 +316,7 @@ always @(posedge clk) begin
 				xfer_data_last <= 1'b0;
 				request <= ctl_xfer_request;
 				byte_index <= 0;
+				xfer_count <= 0;
 				length <= ctl_xfer_length;
 				case (ctl_xfer_request)
 				REQUEST_CFG_GET: begin
@@ -206,6 +329,8 @@ always @(posedge clk) begin
 				end
 				REQUEST_REG_OPER: begin
 					reg_addr <= ctl_xfer_value;
+					reg_last <= 1;
+					length <= 2;
 					if (ctl_xfer_type[7] == 1'b1) begin
 						state = STATE_REG_READ;
 					end else begin
@@ -213,6 +338,18 @@ always @(posedge clk) begin
 					end
 					XFER_ACCEPT();
 				end
+				REQUEST_REG_BLOCK: begin
+					reg_addr <= ctl_xfer_value;
+					reg_last <= 3;
+					if (ctl_xfer_length == 0) begin
+						state = STATE_WAIT;
+					end else if (ctl_xfer_type[7] == 1'b1) begin
+						state = STATE_REG_READ;
+					end else begin
+						state = STATE_REG_WRITE;
+					end
+					XFER_ACCEPT();
+				end
 				default: begin
 					XFER_REJECT();
 				end			
@@ -223,19 +360,19 @@ always @(posedge clk) begin
 		end
 		STATE_CFG_GET: begin
 			if (xfer_data_valid == 1'b0) begin
-				xfer_data <= CONFIG[(byte_index + 1)*8-1-:8];
+				xfer_data <= config_data[(byte_index + 1)*8-1-:8];
 				xfer_data_valid <= 1'b1;
 				xfer_data_last <= 1'b0;
 			end else begin
 				if (ctl_xfer_data_in_ready == 1'b1) begin
 					if (byte_index == 4) begin
-						xfer_data <= CONFIG[(byte_index + 2)*8-1-:8];
+						xfer_data <= config_data[(byte_index + 2)*8-1-:8];
 						xfer_data_last <= 1'b1;
 					end else if (byte_index == 5) begin
 						xfer_data_valid <= 1'b0;
 						state = STATE_WAIT;
 					end else begin
-						xfer_data <= CONFIG[(byte_index + 2)*8-1-:8];
+						xfer_data <= config_data[(byte_index + 2)*8-1-:8];
 					end
 					byte_index <= byte_index + 1;
 				end
@@ -244,27 +381,39 @@ always @(posedge clk) begin
 		STATE_REG_READ: begin
 			if (xfer_data_valid == 1'b0) begin
 				xfer_data_valid <= 1'b1;
-				xfer_data_last <= 1'b0;
+				xfer_data_last <= (length == 1);
 			end else begin
 				if (ctl_xfer_data_in_ready == 1'b1) begin
-					if (byte_index == 1) begin
+					if (xfer_count == (length - 1)) begin
 						xfer_data_valid <= 1'b0;
 						xfer_data_last <= 1'b0;
 						state = STATE_WAIT;
 					end else begin
 						xfer_data_valid <= 1'b1;
-						xfer_data_last <= 1'b1;
-						byte_index <= byte_index + 1;
+						xfer_data_last <= (xfer_count == (length - 2));
+						xfer_count <= xfer_count + 1;
+						if (byte_index == reg_last) begin
+							byte_index <= 0;
+							reg_addr <= reg_addr + 1;
+						end else begin
+							byte_index <= byte_index + 1;
+						end
 					end
 				end
 			end
 		end
 		STATE_REG_WRITE: begin
 			if (ctl_xfer_data_out_valid == 1'b1) begin
-				if (byte_index == 1) begin
+				if (xfer_count == (length - 1)) begin
 					state <= STATE_WAIT;
 				end else begin
-					byte_index <= byte_index + 1;
+					xfer_count <= xfer_count + 1;
+					if (byte_index == reg_last) begin
+						byte_index <= 0;
+						reg_addr <= reg_addr + 1;
+					end else begin
+						byte_index <= byte_index + 1;
+					end
 				end
 			end
 		end
@@ -281,15 +430,41 @@ always @(posedge clk) begin
 	end
 end
 
-/* Read Reg */
+/* Read Reg: registers are 32-bit, 16-bit request returns low half. L registers hold whole 32-bit value */
+always @(*) begin
+	case (reg_addr)
+	REGADDR_TSR: reg_rd_data <= {16'h0000,reg_tsr};
+	REGADDR_TLR: reg_rd_data <= {16'h0000,reg_tlr};
+	REGADDR_RSR: reg_rd_data <= {16'h0000,reg_rsr};
+	REGADDR_SFL: reg_rd_data <= sof_counter_latch;
+	REGADDR_SFH: reg_rd_data <= {16'h0000,sof_counter_latch[31:16]};
+	REGADDR_SFP: reg_rd_data <= {16'h0000,sof_phase_latch};
+	REGADDR_PTL: reg_rd_data <= pts_counter_latch;
+	REGADDR_PTH: reg_rd_data <= {16'h0000,pts_counter_latch[31:16]};
+	REGADDR_PTP: reg_rd_data <= {16'h0000,pts_phase_latch};
+	REGADDR_TCR: reg_rd_data <= {16'h0000,tcr_status};
+	REGADDR_TEL: reg_rd_data <= test_errors_latch;
+	REGADDR_TEH: reg_rd_data <= {16'h0000,test_errors_latch[31:16]};
+	REGADDR_MCR: reg_rd_data <= {16'h0000,reg_mcr};
+	REGADDR_FIL: reg_rd_data <= fifo_in_count;
+	REGADDR_FOL: reg_rd_data <= fifo_out_count;
+	REGADDR_PQC: reg_rd_data <= {28'h0000000,plq_count};
+	REGADDR_PQ0, REGADDR_PQ1, REGADDR_PQ2, REGADDR_PQ3,
+	REGADDR_PQ4, REGADDR_PQ5, REGADDR_PQ6, REGADDR_PQ7: reg_rd_data <= plq_window[reg_addr[2:0]*32+:32];
+	REGADDR_TQC: reg_rd_data <= {28'h0000000,tsq_read};
+	default: begin
+		if ((reg_addr >= REGADDR_TQ0) && (reg_addr <= REGADDR_TQ15)) begin
+			reg_rd_data <= tsq_window[(reg_addr - REGADDR_TQ0)*32+:32];
+		end else begin
+			reg_rd_data <= 0;
+		end
+	end
+	endcase
+end
+
 always @(*) begin
 	if (state == STATE_REG_READ) begin
-		case (reg_addr)
-		REGADDR_TSR: reg_data_out <= reg_tsr[(byte_index+1)*8-1-:8];
-		REGADDR_TLR: reg_data_out <= reg_tlr[(byte_index+1)*8-1-:8];
-		REGADDR_RSR: reg_data_out <= reg_rsr[(byte_index+1)*8-1-:8];
-		default: reg_data_out <= 0;
-		endcase
+		reg_data_out <= reg_rd_data[(byte_index+1)*8-1-:8];
 	end else begin
 		reg_data_out <= 0;
 	end
@@ -303,7 +478,7 @@ always @(posedge clk) begin
 		reg_rsr <= 0;
 	end else begin
 		if (state == STATE_REG_WRITE) begin
-			if (ctl_xfer_data_out_valid == 1'b1) begin
+			if ((ctl_xfer_data_out_valid == 1'b1) && (byte_index < 2)) begin
 				case (reg_addr)
 				REGADDR_TSR: reg_tsr[(byte_index+1)*8-1-:8] <= ctl_xfer_data_out;
 				REGADDR_TLR: reg_tlr[(byte_index+1)*8-1-:8] <= ctl_xfer_data_out;
@@ -359,7 +534,7 @@ always @(posedge clk) begin
 				tsr_rdy <= 1'b1;
 			end
 			if ((ep_blk_xfer_out_data_valid == 1'b1) && (ep_blk_xfer_out_data_ready == 1'b1) && (ep_blk_xfer_out_data_last == 1'b1)) begin
-				tsr_lst <= (PACKET_MODE == 1) ? 1'b1 : 1'b0;
+				tsr_lst <= packet_mode;
 			end
 		end
 	end
@@ -378,18 +553,182 @@ always @(posedge clk) begin
 				rsr_rdy <= 1'b1;
 			end
 			if ((ep_blk_xfer_in_data_valid == 1'b1) && (ep_blk_xfer_in_data_ready == 1'b1) && (ep_blk_xfer_in_data_last == 1'b1)) begin
-				rsr_lst <= (PACKET_MODE == 1) ? 1'b1 : 1'b0;
+				rsr_lst <= packet_mode;
+			end
+		end
+	end
+end
+
+/* SOF Counter & Phase (usb_clk cycles since SOF) */
+always @(posedge clk) begin
+	if (rst == 1'b1) begin
+		sof_counter <= 0;
+		sof_phase <= 0;
+	end else begin
+		if (usb_sof == 1'b1) begin
+			sof_counter <= sof_counter + 1;
+			sof_phase <= 0;
+		end else if (sof_phase != 16'hFFFF) begin
+			sof_phase <= sof_phase + 1;
+		end
+	end
+end
+
+/* Packet Timestamp: captured at start of each bulk IN packet */
+always @(posedge clk) begin
+	if (rst == 1'b1) begin
+		pts_counter <= 0;
+		pts_phase <= 0;
+		blk_in_xfer_prev <= 1'b0;
+	end else begin
+		blk_in_xfer_prev <= tlp_blk_in_xfer;
+		if ((tlp_blk_in_xfer == 1'b1) && (blk_in_xfer_prev == 1'b0)) begin
+			pts_counter <= sof_counter;
+			pts_phase <= sof_phase;
+		end
+	end
+end
+
+/* Timestamp Latch: any read covering low register latches whole value */
+always @(posedge clk) begin
+	if (rst == 1'b1) begin
+		sof_counter_latch <= 0;
+		sof_phase_latch <= 0;
+		pts_counter_latch <= 0;
+		pts_phase_latch <= 0;
+	end else begin
+		if (reg_request == 1'b1) begin
+			if ((ctl_xfer_value <= REGADDR_SFL) && (reg_setup_end > REGADDR_SFL)) begin
+				sof_counter_latch <= sof_counter;
+				sof_phase_latch <= sof_phase;
+			end
+			if ((ctl_xfer_value <= REGADDR_PTL) && (reg_setup_end > REGADDR_PTL)) begin
+				pts_counter_latch <= pts_counter;
+				pts_phase_latch <= pts_phase;
+			end
+		end
+	end
+end
+
+/* Link Test Control: every TCR write restarts generator and checker */
+always @(posedge clk) begin
+	if (rst == 1'b1) begin
+		reg_tcr <= 0;
+		tcr_clear <= 1'b0;
+	end else begin
+		if ((state == STATE_REG_WRITE) && (ctl_xfer_data_out_valid == 1'b1) && (reg_addr == REGADDR_TCR) && (byte_index < 2)) begin
+			reg_tcr[(byte_index+1)*8-1-:8] <= ctl_xfer_data_out;
+			if (byte_index == 1) begin
+				tcr_clear <= ~tcr_clear;
+			end
+		end
+	end
+end
+
+/* Link Test Errors Latch: any read covering low register latches whole value */
+always @(posedge clk) begin
+	if (rst == 1'b1) begin
+		test_errors_latch <= 0;
+	end else begin
+		if ((reg_request == 1'b1) && (ctl_xfer_value <= REGADDR_TEL) && (reg_setup_end > REGADDR_TEL)) begin
+			test_errors_latch <= test_errors;
+		end
+	end
+end
+
+/* Mode Control: bit 0 selects packet mode (reset value is PACKET_MODE), bit 1 enables IN framing (FRAME_ENABLE), bit 2 enables packet length queue, bit 3 enables IN compression (COMPRESS_ENABLE), bit 4 enables packet timestamp queue */
+always @(posedge clk) begin
+	if (rst == 1'b1) begin
+		reg_mcr <= (PACKET_MODE == 1) ? 16'h0001 : 16'h0000;
+	end else begin
+		if ((state == STATE_REG_WRITE) && (ctl_xfer_data_out_valid == 1'b1) && (reg_addr == REGADDR_MCR) && (byte_index == 0)) begin
+			reg_mcr <= {11'h000,ctl_xfer_data_out[4],ctl_xfer_data_out[3] & (COMPRESS_ENABLE == 1),ctl_xfer_data_out[2],ctl_xfer_data_out[1] & (FRAME_ENABLE == 1),ctl_xfer_data_out[0]};
+		end
+	end
+end
+
+/* Packet Length Queue: PQ0..PQ7 mirror the oldest queued IN packet lengths, writing N to PQC pops N of them */
+always @(posedge clk) begin
+	if ((rst == 1'b1) || (plq_mode == 1'b0)) begin
+		plq_window <= 0;
+		plq_count <= 0;
+		plq_pop <= 0;
+	end else begin
+		if (plq_pop_write == 1'b1) begin
+			plq_pop <= (ctl_xfer_data_out > plq_count) ? plq_count : ctl_xfer_data_out[3:0];
+		end else if (plq_pop != 0) begin
+			plq_window <= plq_window >> (plq_pop*32);
+			plq_count <= plq_count - plq_pop;
+			plq_pop <= 0;
+		end else if (plq_fill == 1'b1) begin
+			plq_window[plq_count*32+:32] <= plq_data;
+			plq_count <= plq_count + 1;
+		end
+	end
+end
+
+/*
+ * Packet Timestamp Queue: every packet-mode IN packet gets {sequence, phase, counter} of the bulk packet carrying its first byte,
+ * TQ0..TQ15 hold the oldest entries as counter/{sequence, phase} pairs. A block read starting at TQC returns the number of
+ * entries it covers (latched at SETUP) and pops them once its last byte is sent. Packets arriving while the queue is full
+ * are not queued but still counted, so the host sees the gap in the sequence.
+ */
+always @(posedge clk) begin
+	if ((rst == 1'b1) || (tsq_mode == 1'b0)) begin
+		tsq_window <= 0;
+		tsq_count <= 0;
+		tsq_read <= 0;
+		tsq_seq <= 0;
+		tsq_first <= 1'b1;
+		tsq_reading <= 1'b0;
+	end else begin
+		if ((reg_request == 1'b1) && (ctl_xfer_request == REQUEST_REG_BLOCK) && (ctl_xfer_value == REGADDR_TQC) && (ctl_xfer_length >= 4)) begin
+			tsq_read <= ((tsq_regs >> 1) < tsq_count) ? (tsq_regs >> 1) : tsq_count;
+			tsq_reading <= 1'b1;
+		end else if ((tsq_pop == 1'b1) || (state == STATE_IDLE)) begin
+			tsq_read <= 0;
+			tsq_reading <= 1'b0;
+		end
+		if (tsq_pop == 1'b1) begin
+			tsq_window <= tsq_window >> (tsq_read*64);
+		end
+		if (tsq_push == 1'b1) begin
+			if (tsq_left < TSQ_DEPTH) begin
+				tsq_window[tsq_left*64+:64] <= {tsq_seq,pts_phase,pts_counter};
 			end
+			tsq_seq <= tsq_seq + 1;
+			tsq_first <= 1'b0;
+		end
+		if ((ep_blk_xfer_in_data_valid == 1'b1) && (ep_blk_xfer_in_data_ready == 1'b1) && (ep_blk_xfer_in_data_last == 1'b1)) begin
+			tsq_first <= 1'b1;
+		end
+		tsq_count <= tsq_left + (((tsq_push == 1'b1) && (tsq_left < TSQ_DEPTH)) ? 1 : 0);
+	end
+end
+
+/* Loopback: OUT bytes are held back by one, the held byte goes out with tlast once the packet ends */
+always @(posedge clk) begin
+	if ((rst == 1'b1) || (loopback_mode == 1'b0)) begin
+		out_hold <= 1'b0;
+		out_hold_data <= 0;
+	end else begin
+		if (tlp_blk_xfer_out_data_valid == 1'b1) begin
+			out_hold <= 1'b1;
+			out_hold_data <= tlp_blk_xfer_out_data;
+		end else if (tlp_blk_out_xfer == 1'b0) begin
+			out_hold <= 1'b0;
 		end
 	end
 end
 
-/* Tx Counter & Last */
+/* Tx Counter & Last: TLR write starts a new packet, so a send aborted by the host cannot shift later boundaries */
 always @(posedge clk) begin
 	if (rst == 1'b1) begin
 		tx_counter <= 0;
 	end else begin
-		if (PACKET_MODE == 1) begin
+		if ((state == STATE_REG_WRITE) && (ctl_xfer_data_out_valid == 1'b1) && (reg_addr == REGADDR_TLR)) begin
+			tx_counter <= 0;
+		end else if (packet_mode == 1'b1) begin
 			if ((ep_blk_xfer_out_data_valid == 1'b1) && (ep_blk_xfer_out_data_ready == 1'b1)) begin
 				if (tx_counter == (reg_tlr - 1)) begin
 					tx_counter <= 0;
@@ -404,7 +743,7 @@ always @(posedge clk) begin
 end
 
 always @(*) begin
-	if (PACKET_MODE == 1) begin
+	if (packet_mode == 1'b1) begin
 		tx_last <= (tx_counter == (reg_tlr - 1));
 	end else begin
 		tx_last <= 1'b0;
@@ -0,0 +1,221 @@
+`timescale 1ns / 1ps
+//////////////////////////////////////////////////////////////////////////////////
+// Company:
+// Engineer: Dmitry Matyunin (https://github.com/mcjtag)
+// 
+// Create Date: 19.10.2026 12:00:00
+// Design Name: 
+// Module Name: usb_ep1_frame
+// Project Name: axis_usbd
+// Target Devices:
+// Tool Versions:
+// Description: IN stream integrity framing: sequence number and CRC32C per 512-byte frame
+// 
+// Dependencies: 
+// 
+// Revision:
+// Revision 0.01 - File Created
+// Additional Comments:
+// License: MIT
+//  Copyright (c) 2021 Dmitry Matyunin
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+// 
+//////////////////////////////////////////////////////////////////////////////////
+
+module usb_ep1_frame #(
+	parameter FPGA_VENDOR = "xilinx",
+	parameter FPGA_FAMILY = "7series"
+)
+(
+	input wire rst,
+	input wire usb_clk,
+	input wire axis_clk,
+	/* Control (usb_clk) */
+	input wire frame_enable,
+	/* Stream AXIS */
+	input wire s_axis_tvalid,
+	output wire s_axis_tready,
+	input wire [7:0]s_axis_tdata,
+	input wire s_axis_tlast,
+	/* Endpoint AXIS */
+	output wire m_axis_tvalid,
+	input wire m_axis_tready,
+	output wire [7:0]m_axis_tdata,
+	output wire m_axis_tlast
+);
+
+/* Frame: 4-byte sequence number (LE), 504 bytes of payload, CRC32C of both (LE) */
+localparam SEQ_LEN = 4;
+localparam PAYLOAD_LEN = 504;
+localparam CRC_LEN = 4;
+
+localparam [1:0]
+	STATE_SEQ = 0,
+	STATE_PAYLOAD = 1,
+	STATE_CRC = 2;
+
+/* CRC32C (Castagnoli), reflected, one byte */
+function [31:0]crc32c_byte;
+	input [31:0]crc;
+	input [7:0]data;
+	integer i;
+	reg [31:0]c;
+	begin
+	
+	c = crc ^ {24'h000000,data};
+	for (i = 0; i < 8; i = i + 1) begin
+		c = (c[0] == 1'b1) ? ((c >> 1) ^ 32'h82F63B78) : (c >> 1);
+	end
+	crc32c_byte = c;
+	
+	end
+endfunction
+
+wire axis_rst;
+wire enable;
+reg active;
+reg [1:0]state;
+reg [8:0]count;
+reg [31:0]seq;
+reg [31:0]crc;
+wire [31:0]crc_out;
+wire [31:0]crc_in;
+wire boundary;
+wire beat;
+
+reg out_tvalid;
+reg [7:0]out_tdata;
+reg out_tlast;
+reg in_tready;
+
+assign m_axis_tvalid = out_tvalid;
+assign m_axis_tdata = out_tdata;
+assign m_axis_tlast = out_tlast;
+assign s_axis_tready = in_tready;
+
+assign crc_out = ~crc;
+assign crc_in = ((state == STATE_SEQ) && (count == 0)) ? 32'hFFFFFFFF : crc;
+assign boundary = (state == STATE_SEQ) && (count == 0);
+assign beat = (out_tvalid == 1'b1) && (m_axis_tready == 1'b1);
+
+/* Path Select */
+always @(*) begin
+	if (active == 1'b0) begin
+		out_tvalid <= s_axis_tvalid;
+		out_tdata <= s_axis_tdata;
+		out_tlast <= s_axis_tlast;
+		in_tready <= m_axis_tready;
+	end else begin
+		case (state)
+		STATE_SEQ: begin
+			/* Held back at boundary once disabled, so framing drops out without a beat */
+			out_tvalid <= (count != 0) || (enable == 1'b1);
+			out_tdata <= seq[8*count[1:0] +: 8];
+			out_tlast <= 1'b0;
+			in_tready <= 1'b0;
+		end
+		STATE_PAYLOAD: begin
+			out_tvalid <= s_axis_tvalid;
+			out_tdata <= s_axis_tdata;
+			out_tlast <= 1'b0;
+			in_tready <= m_axis_tready;
+		end
+		default: begin
+			out_tvalid <= 1'b1;
+			out_tdata <= crc_out[8*count[1:0] +: 8];
+			out_tlast <= (count == CRC_LEN - 1);
+			in_tready <= 1'b0;
+		end
+		endcase
+	end
+end
+
+/* Mode changes only between frames and never under a pending beat */
+always @(posedge axis_clk) begin
+	if (axis_rst == 1'b1) begin
+		active <= 1'b0;
+	end else begin
+		if ((boundary == 1'b1) && !((out_tvalid == 1'b1) && (m_axis_tready == 1'b0))) begin
+			active <= enable;
+		end
+	end
+end
+
+always @(posedge axis_clk) begin
+	if ((axis_rst == 1'b1) || (active == 1'b0)) begin
+		state <= STATE_SEQ;
+		count <= 0;
+		seq <= 0;
+		crc <= 32'hFFFFFFFF;
+	end else begin
+		if (beat == 1'b1) begin
+			case (state)
+			STATE_SEQ: begin
+				crc <= crc32c_byte(crc_in, out_tdata);
+				if (count == SEQ_LEN - 1) begin
+					count <= 0;
+					state <= STATE_PAYLOAD;
+				end else begin
+					count <= count + 1;
+				end
+			end
+			STATE_PAYLOAD: begin
+				crc <= crc32c_byte(crc, out_tdata);
+				if (count == PAYLOAD_LEN - 1) begin
+					count <= 0;
+					state <= STATE_CRC;
+				end else begin
+					count <= count + 1;
+				end
+			end
+			default: begin
+				if (count == CRC_LEN - 1) begin
+					count <= 0;
+					seq <= seq + 1;
+					state <= STATE_SEQ;
+				end else begin
+					count <= count + 1;
+				end
+			end
+			endcase
+		end
+	end
+end
+
+arch_cdc_array #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.WIDTH(1)
+) arch_cdc_array_ctl_inst (
+	.src_clk(usb_clk),
+	.src_data(frame_enable),
+	.dst_clk(axis_clk),
+	.dst_data(enable)
+);
+
+arch_cdc_reset #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY)
+) arch_cdc_reset_inst (
+	.src_rst(rst),
+	.dst_clk(axis_clk),
+	.dst_rst(axis_rst)
+);
+
+endmodule
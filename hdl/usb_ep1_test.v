@@ -0,0 +1,273 @@
+`timescale 1ns / 1ps
+//////////////////////////////////////////////////////////////////////////////////
+// Company:
+// Engineer: Dmitry Matyunin (https://github.com/mcjtag)
+// 
+// Create Date: 19.10.2026 12:00:00
+// Design Name: 
+// Module Name: usb_ep1_test
+// Project Name: axis_usbd
+// Target Devices:
+// Tool Versions:
+// Description: Link test: PRBS31/counter generator on IN, checker on OUT, OUT->IN loopback
+// 
+// Dependencies: 
+// 
+// Revision:
+// Revision 0.01 - File Created
+// Additional Comments:
+// License: MIT
+//  Copyright (c) 2021 Dmitry Matyunin
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+// 
+//////////////////////////////////////////////////////////////////////////////////
+
+module usb_ep1_test #(
+	parameter FPGA_VENDOR = "xilinx",
+	parameter FPGA_FAMILY = "7series"
+)
+(
+	input wire rst,
+	input wire usb_clk,
+	input wire axis_clk,
+	/* Control (usb_clk) */
+	input wire [3:0]test_ctl,
+	output wire [31:0]test_errors,
+	output wire test_locked,
+	/* User AXIS */
+	input wire s_axis_tvalid,
+	output wire s_axis_tready,
+	input wire [7:0]s_axis_tdata,
+	input wire s_axis_tlast,
+	output wire m_axis_tvalid,
+	input wire m_axis_tready,
+	output wire [7:0]m_axis_tdata,
+	output wire m_axis_tlast,
+	/* Endpoint AXIS */
+	output wire ep_in_axis_tvalid,
+	input wire ep_in_axis_tready,
+	output wire [7:0]ep_in_axis_tdata,
+	output wire ep_in_axis_tlast,
+	input wire ep_out_axis_tvalid,
+	output wire ep_out_axis_tready,
+	input wire [7:0]ep_out_axis_tdata,
+	input wire ep_out_axis_tlast
+);
+
+localparam [1:0]
+	MODE_NORMAL = 0,
+	MODE_PRBS = 1,
+	MODE_LOOPBACK = 2;
+
+localparam [0:0]
+	PATTERN_PRBS31 = 0,
+	PATTERN_COUNTER = 1;
+
+wire axis_rst;
+wire [1:0]mode;
+wire pattern;
+wire clear_toggle;
+reg clear_toggle_prev;
+wire clear;
+
+/* Generator */
+reg [30:0]gen_state;
+reg [7:0]gen_count;
+wire [7:0]gen_data;
+wire gen_next;
+
+/* Checker */
+reg [31:0]chk_hist;
+reg [2:0]chk_fill;
+reg [31:0]chk_count;
+reg [31:0]chk_base;
+wire [31:0]chk_errors;
+reg [7:0]chk_expect;
+wire chk_next;
+wire chk_locked;
+
+/* Error count crosses as a free-running counter, clear subtracts a base on each side */
+wire [31:0]errors_count;
+reg [31:0]errors_base;
+reg usb_clear_prev;
+wire usb_clear;
+
+reg in_tvalid;
+reg [7:0]in_tdata;
+reg in_tlast;
+reg out_tready;
+
+assign clear = clear_toggle ^ clear_toggle_prev;
+
+assign ep_in_axis_tvalid = in_tvalid;
+assign ep_in_axis_tdata = in_tdata;
+assign ep_in_axis_tlast = in_tlast;
+assign ep_out_axis_tready = out_tready;
+
+assign s_axis_tready = (mode == MODE_NORMAL) ? ep_in_axis_tready : 1'b0;
+assign m_axis_tvalid = (mode == MODE_NORMAL) ? ep_out_axis_tvalid : 1'b0;
+assign m_axis_tdata = ep_out_axis_tdata;
+assign m_axis_tlast = ep_out_axis_tlast;
+
+/* PRBS31 (x^31 + x^28 + 1), 8 bits per clock, oldest bit in MSB */
+assign gen_data = (pattern == PATTERN_COUNTER) ? gen_count : (gen_state[30:23] ^ gen_state[27:20]);
+assign gen_next = (mode == MODE_PRBS) && (ep_in_axis_tready == 1'b1);
+assign chk_next = (mode == MODE_PRBS) && (ep_out_axis_tvalid == 1'b1);
+assign chk_locked = (chk_fill == 4);
+assign chk_errors = chk_count - chk_base;
+assign usb_clear = test_ctl[3] ^ usb_clear_prev;
+assign test_errors = errors_count - errors_base;
+
+/* Path Select */
+always @(*) begin
+	case (mode)
+	MODE_PRBS: begin
+		in_tvalid <= 1'b1;
+		in_tdata <= gen_data;
+		in_tlast <= 1'b0;
+		out_tready <= 1'b1;
+	end
+	MODE_LOOPBACK: begin
+		in_tvalid <= ep_out_axis_tvalid;
+		in_tdata <= ep_out_axis_tdata;
+		in_tlast <= ep_out_axis_tlast;
+		out_tready <= ep_in_axis_tready;
+	end
+	default: begin
+		in_tvalid <= s_axis_tvalid;
+		in_tdata <= s_axis_tdata;
+		in_tlast <= s_axis_tlast;
+		out_tready <= m_axis_tready;
+	end
+	endcase
+end
+
+always @(posedge axis_clk) begin
+	if (axis_rst == 1'b1) begin
+		clear_toggle_prev <= 1'b0;
+	end else begin
+		clear_toggle_prev <= clear_toggle;
+	end
+end
+
+/* Generator */
+always @(posedge axis_clk) begin
+	if ((axis_rst == 1'b1) || (clear == 1'b1)) begin
+		gen_state <= 31'h7FFFFFFF;
+		gen_count <= 0;
+	end else begin
+		if (gen_next == 1'b1) begin
+			gen_state <= {gen_state[22:0],gen_data};
+			gen_count <= gen_count + 1;
+		end
+	end
+end
+
+/* Checker: self-synchronizing, expects each byte from four previous ones */
+always @(*) begin
+	if (pattern == PATTERN_COUNTER) begin
+		chk_expect <= chk_hist[7:0] + 1;
+	end else begin
+		chk_expect <= chk_hist[30:23] ^ chk_hist[27:20];
+	end
+end
+
+always @(posedge axis_clk) begin
+	if ((axis_rst == 1'b1) || (clear == 1'b1)) begin
+		chk_hist <= 0;
+		chk_fill <= 0;
+	end else begin
+		if (chk_next == 1'b1) begin
+			chk_hist <= {chk_hist[23:0],ep_out_axis_tdata};
+			if (chk_locked == 1'b0) begin
+				chk_fill <= chk_fill + 1;
+			end
+		end
+	end
+end
+
+/* Counter is never cleared, so it changes by at most one per clock as arch_cdc_gray requires */
+always @(posedge axis_clk) begin
+	if (axis_rst == 1'b1) begin
+		chk_count <= 0;
+		chk_base <= 0;
+	end else begin
+		if (clear == 1'b1) begin
+			chk_base <= chk_count;
+		end else if ((chk_next == 1'b1) && (chk_locked == 1'b1) && (ep_out_axis_tdata != chk_expect) && (chk_errors != 32'hFFFFFFFF)) begin
+			chk_count <= chk_count + 1;
+		end
+	end
+end
+
+always @(posedge usb_clk) begin
+	if (rst == 1'b1) begin
+		usb_clear_prev <= 1'b0;
+		errors_base <= 0;
+	end else begin
+		usb_clear_prev <= test_ctl[3];
+		if (usb_clear == 1'b1) begin
+			errors_base <= errors_count;
+		end
+	end
+end
+
+arch_cdc_array #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.WIDTH(4)
+) arch_cdc_array_ctl_inst (
+	.src_clk(usb_clk),
+	.src_data(test_ctl),
+	.dst_clk(axis_clk),
+	.dst_data({clear_toggle,pattern,mode})
+);
+
+arch_cdc_array #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.WIDTH(1)
+) arch_cdc_array_sts_inst (
+	.src_clk(axis_clk),
+	.src_data(chk_locked),
+	.dst_clk(usb_clk),
+	.dst_data(test_locked)
+);
+
+arch_cdc_gray #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY),
+	.WIDTH(32)
+) arch_cdc_gray_inst (
+	.src_clk(axis_clk),
+	.src_data(chk_count),
+	.dst_clk(usb_clk),
+	.dst_data(errors_count)
+);
+
+arch_cdc_reset #(
+	.FPGA_VENDOR(FPGA_VENDOR),
+	.FPGA_FAMILY(FPGA_FAMILY)
+) arch_cdc_reset_inst (
+	.src_rst(rst),
+	.dst_clk(axis_clk),
+	.dst_rst(axis_rst)
+);
+
+endmodule
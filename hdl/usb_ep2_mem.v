@@ -0,0 +1,302 @@
+`timescale 1ns / 1ps
+//////////////////////////////////////////////////////////////////////////////////
+// Company:
+// Engineer: Dmitry Matyunin (https://github.com/mcjtag)
+// 
+// Create Date: 19.10.2026 12:00:00
+// Design Name: 
+// Module Name: usb_ep2_mem
+// Project Name: axis_usbd
+// Target Devices:
+// Tool Versions:
+// Description: AXI4 memory-mapped master driven by command stream on EP2
+// 
+// Dependencies: 
+// 
+// Revision:
+// Revision 0.01 - File Created
+// Additional Comments:
+// License: MIT
+//  Copyright (c) 2021 Dmitry Matyunin
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+// 
+//////////////////////////////////////////////////////////////////////////////////
+
+
+//
+// Command (16 bytes, little-endian): opcode[7:0], reserved[31:8], address[63:32], length[95:64], reserved[127:96]
+// Write: command is followed by 'length' data bytes, response is 4-byte status.
+// Read: response is 'length' data bytes followed by 4-byte status.
+// Address and length are in bytes and must be multiples of 4. Status byte 0: 0x00 - OKAY,
+// 0x02 - SLVERR, 0x03 - DECERR (worst response of all beats), 0xFF - unknown opcode.
+//
+module usb_ep2_mem (
+	input wire clk,
+	input wire rst,
+	/* Command & Write Data */
+	input wire s_axis_tvalid,
+	output wire s_axis_tready,
+	input wire [7:0]s_axis_tdata,
+	/* Read Data & Status */
+	output wire m_axis_tvalid,
+	input wire m_axis_tready,
+	output wire [7:0]m_axis_tdata,
+	output wire m_axis_tlast,
+	/* AXI4 Master */
+	output wire [31:0]m_axi_awaddr,
+	output wire [7:0]m_axi_awlen,
+	output wire [2:0]m_axi_awsize,
+	output wire [1:0]m_axi_awburst,
+	output wire m_axi_awvalid,
+	input wire m_axi_awready,
+	output wire [31:0]m_axi_wdata,
+	output wire [3:0]m_axi_wstrb,
+	output wire m_axi_wlast,
+	output wire m_axi_wvalid,
+	input wire m_axi_wready,
+	input wire [1:0]m_axi_bresp,
+	input wire m_axi_bvalid,
+	output wire m_axi_bready,
+	output wire [31:0]m_axi_araddr,
+	output wire [7:0]m_axi_arlen,
+	output wire [2:0]m_axi_arsize,
+	output wire [1:0]m_axi_arburst,
+	output wire m_axi_arvalid,
+	input wire m_axi_arready,
+	input wire [31:0]m_axi_rdata,
+	input wire [1:0]m_axi_rresp,
+	input wire m_axi_rlast,
+	input wire m_axi_rvalid,
+	output wire m_axi_rready
+);
+
+localparam [2:0]
+	STATE_CMD = 0,
+	STATE_AW = 1,
+	STATE_W = 2,
+	STATE_B = 3,
+	STATE_AR = 4,
+	STATE_R = 5,
+	STATE_STATUS = 6;
+
+localparam [7:0]
+	OPCODE_WRITE = 1,
+	OPCODE_READ = 2;
+
+localparam [7:0]
+	STATUS_OKAY = 8'h00,
+	STATUS_BAD_OPCODE = 8'hFF;
+
+reg [2:0]state;
+reg [3:0]hdr_count;
+reg [7:0]opcode;
+reg [31:0]addr;
+reg [29:0]words;
+reg [8:0]burst_beats;
+reg [8:0]beat_count;
+reg [7:0]status;
+reg [1:0]status_count;
+
+/* Burst: up to 256 beats, never crossing 4KB (address and words are stable in address phase) */
+wire [10:0]boundary_words;
+reg [8:0]next_beats;
+
+/* Write word assembly */
+reg [31:0]wdata;
+reg [1:0]wbyte;
+reg wvalid;
+
+/* Read word serializer */
+reg [31:0]rdata;
+reg [1:0]rbyte;
+reg rbusy;
+
+assign boundary_words = (13'h1000 - {1'b0,addr[11:0]}) >> 2;
+
+always @(*) begin
+	if ((words <= 256) && (words <= boundary_words)) begin
+		next_beats <= words[8:0];
+	end else if (boundary_words <= 256) begin
+		next_beats <= boundary_words[8:0];
+	end else begin
+		next_beats <= 256;
+	end
+end
+
+assign s_axis_tready = (state == STATE_CMD) || ((state == STATE_W) && (wvalid == 1'b0));
+
+assign m_axis_tvalid = (state == STATE_STATUS) || rbusy;
+assign m_axis_tdata = (state == STATE_STATUS) ? ((status_count == 0) ? status : 8'h00) : rdata[rbyte*8+:8];
+assign m_axis_tlast = (state == STATE_STATUS) && (status_count == 3);
+
+assign m_axi_awaddr = {addr[31:2],2'b00};
+assign m_axi_awlen = next_beats - 1;
+assign m_axi_awsize = 3'b010;
+assign m_axi_awburst = 2'b01;
+assign m_axi_awvalid = (state == STATE_AW);
+assign m_axi_wdata = wdata;
+assign m_axi_wstrb = 4'hF;
+assign m_axi_wlast = (beat_count == 1);
+assign m_axi_wvalid = wvalid;
+assign m_axi_bready = (state == STATE_B);
+assign m_axi_araddr = {addr[31:2],2'b00};
+assign m_axi_arlen = next_beats - 1;
+assign m_axi_arsize = 3'b010;
+assign m_axi_arburst = 2'b01;
+assign m_axi_arvalid = (state == STATE_AR);
+assign m_axi_rready = (state == STATE_R) && (rbusy == 1'b0) && (beat_count != 0);
+
+always @(posedge clk) begin
+	if (rst == 1'b1) begin
+		state <= STATE_CMD;
+		hdr_count <= 0;
+		opcode <= 0;
+		addr <= 0;
+		words <= 0;
+		burst_beats <= 0;
+		beat_count <= 0;
+		status <= STATUS_OKAY;
+		status_count <= 0;
+		wdata <= 0;
+		wbyte <= 0;
+		wvalid <= 1'b0;
+		rdata <= 0;
+		rbyte <= 0;
+		rbusy <= 1'b0;
+	end else begin
+		case (state)
+		STATE_CMD: begin
+			if (s_axis_tvalid == 1'b1) begin
+				case (hdr_count)
+				0: opcode <= s_axis_tdata;
+				4: addr[7:0] <= s_axis_tdata;
+				5: addr[15:8] <= s_axis_tdata;
+				6: addr[23:16] <= s_axis_tdata;
+				7: addr[31:24] <= s_axis_tdata;
+				8: words[5:0] <= s_axis_tdata[7:2];
+				9: words[13:6] <= s_axis_tdata;
+				10: words[21:14] <= s_axis_tdata;
+				11: words[29:22] <= s_axis_tdata;
+				default: ;
+				endcase
+				hdr_count <= hdr_count + 1;
+				if (hdr_count == 15) begin
+					status <= STATUS_OKAY;
+					status_count <= 0;
+					if ((opcode != OPCODE_WRITE) && (opcode != OPCODE_READ)) begin
+						status <= STATUS_BAD_OPCODE;
+						state <= STATE_STATUS;
+					end else if (words == 0) begin
+						state <= STATE_STATUS;
+					end else if (opcode == OPCODE_WRITE) begin
+						state <= STATE_AW;
+					end else begin
+						state <= STATE_AR;
+					end
+				end
+			end
+		end
+		STATE_AW: begin
+			if (m_axi_awready == 1'b1) begin
+				burst_beats <= next_beats;
+				beat_count <= next_beats;
+				wbyte <= 0;
+				state <= STATE_W;
+			end
+		end
+		STATE_W: begin
+			if ((s_axis_tvalid == 1'b1) && (wvalid == 1'b0)) begin
+				wdata[wbyte*8+:8] <= s_axis_tdata;
+				wbyte <= wbyte + 1;
+				if (wbyte == 3) begin
+					wvalid <= 1'b1;
+				end
+			end
+			if ((wvalid == 1'b1) && (m_axi_wready == 1'b1)) begin
+				wvalid <= 1'b0;
+				beat_count <= beat_count - 1;
+				if (beat_count == 1) begin
+					state <= STATE_B;
+				end
+			end
+		end
+		STATE_B: begin
+			if (m_axi_bvalid == 1'b1) begin
+				if ((m_axi_bresp[1] == 1'b1) && (m_axi_bresp > status[1:0])) begin
+					status <= {6'h00,m_axi_bresp};
+				end
+				addr <= addr + {burst_beats,2'b00};
+				words <= words - burst_beats;
+				if (words == burst_beats) begin
+					state <= STATE_STATUS;
+				end else begin
+					state <= STATE_AW;
+				end
+			end
+		end
+		STATE_AR: begin
+			if (m_axi_arready == 1'b1) begin
+				burst_beats <= next_beats;
+				beat_count <= next_beats;
+				state <= STATE_R;
+			end
+		end
+		STATE_R: begin
+			if ((m_axi_rvalid == 1'b1) && (m_axi_rready == 1'b1)) begin
+				rdata <= m_axi_rdata;
+				rbyte <= 0;
+				rbusy <= 1'b1;
+				beat_count <= beat_count - 1;
+				if ((m_axi_rresp[1] == 1'b1) && (m_axi_rresp > status[1:0])) begin
+					status <= {6'h00,m_axi_rresp};
+				end
+			end
+			if ((rbusy == 1'b1) && (m_axis_tready == 1'b1)) begin
+				rbyte <= rbyte + 1;
+				if (rbyte == 3) begin
+					rbusy <= 1'b0;
+				end
+			end
+			if ((beat_count == 0) && (rbusy == 1'b0)) begin
+				addr <= addr + {burst_beats,2'b00};
+				words <= words - burst_beats;
+				if (words == burst_beats) begin
+					state <= STATE_STATUS;
+				end else begin
+					state <= STATE_AR;
+				end
+			end
+		end
+		STATE_STATUS: begin
+			if (m_axis_tready == 1'b1) begin
+				status_count <= status_count + 1;
+				if (status_count == 3) begin
+					hdr_count <= 0;
+					state <= STATE_CMD;
+				end
+			end
+		end
+		default: begin
+			state <= STATE_CMD;
+		end
+		endcase
+	end
+end
+
+endmodule
@@ -138,6 +138,7 @@ reg [15:0]tx_counter;
 reg [15:0]ctl_xfer_length_int;
 reg [7:0]ctl_xfer_type_int;
 reg [15:0]data_types;
+reg [15:0]data_types_out;
 reg [3:0]current_endpoint;
 reg [1:0]ctl_status;
 reg ctl_xfer_eop;
@@ -152,6 +153,9 @@ reg [15:0]ctl_xfer_index_int;
 reg tx_trn_send_hsk_int;
 reg tx_trn_data_valid_int;
 reg tx_trn_data_last_int;
+wire std_set_config;
+wire std_clear_halt;
+wire blk_out_accept;
 
 assign ctl_xfer = ctl_xfer_int;
 assign blk_in_xfer = blk_in_xfer_int;
@@ -164,8 +168,15 @@ assign tx_trn_send_hsk = tx_trn_send_hsk_int;
 assign tx_trn_data_valid = tx_trn_data_valid_int;
 assign tx_trn_data_last = tx_trn_data_last_int;
 
+/* Standard requests restarting bulk data toggles at DATA0 */
+assign std_set_config = (ctl_xfer_type_int == 8'h00) && (ctl_xfer_request_int == 8'h09);
+assign std_clear_halt = (ctl_xfer_type_int == 8'h02) && (ctl_xfer_request_int == 8'h01) && (ctl_xfer_value_int == 16'h0000);
+/* OUT data is taken only when ACKed and not a retry of an already accepted packet */
+assign blk_out_accept = (ctl_status == HSK_ACK) && (rx_trn_data_type == {data_types_out[current_endpoint], 1'b0});
+
 assign ctl_xfer_endpoint = current_endpoint;
-assign blk_xfer_endpoint = current_endpoint;
+/* Token endpoint while idle, so has_data/ready_read can be selected per endpoint */
+assign blk_xfer_endpoint = (state == STATE_IDLE) ? trn_endpoint : current_endpoint;
 assign tx_trn_hsk_type = (state == STATE_CONTROL_SETUP_ACK) ? 2'b00 : ctl_status;
 assign ctl_xfer_length = ctl_xfer_length_int;
 assign ctl_xfer_type = ctl_xfer_type_int;
@@ -174,7 +185,7 @@ assign blk_xfer_in_data_ready = (state == STATE_BULK_IN) ? tx_trn_data_ready : 1
 assign tx_trn_data_type = {data_types[current_endpoint], 1'b0};
 assign tx_trn_data = (state == STATE_CONTROL_DATAIN) ? ctl_xfer_data_in : blk_xfer_in_data;
 assign blk_xfer_out_data = rx_trn_data;
-assign blk_xfer_out_data_valid = (state == STATE_BULK_OUT) ? rx_trn_valid : 1'b0;
+assign blk_xfer_out_data_valid = ((state == STATE_BULK_OUT) && (blk_out_accept == 1'b1)) ? rx_trn_valid : 1'b0;
 assign ctl_xfer_data_out = rx_trn_data;
 assign ctl_xfer_data_out_valid = rx_trn_valid;
 
@@ -193,6 +204,11 @@ always @(posedge clk) begin
 		data_types <= 1'b1;
 	end else begin
 		if (state == STATE_CONTROL_SETUP_ACK) begin
+			if (std_set_config == 1'b1) begin
+				data_types[15:1] <= 0;
+			end else if ((std_clear_halt == 1'b1) && (ctl_xfer_index_int[7] == 1'b1)) begin
+				data_types[ctl_xfer_index_int[3:0]] <= 1'b0;
+			end
 			data_types[current_endpoint] <= 1'b1;
 		end else if (state == STATE_CONTROL_DATAIN_ACK) begin
 			if ((rx_trn_hsk_received == 1'b1) && (rx_trn_hsk_type == HSK_ACK)) begin
@@ -210,6 +226,23 @@ always @(posedge clk) begin
 	end
 end
 
+/* OUT Toggling: a packet with the previous toggle is a retry after a lost ACK, it is ACKed and dropped */
+always @(posedge clk) begin
+	if (rst == 1'b1) begin
+		data_types_out <= 0;
+	end else begin
+		if (state == STATE_CONTROL_SETUP_ACK) begin
+			if (std_set_config == 1'b1) begin
+				data_types_out <= 0;
+			end else if ((std_clear_halt == 1'b1) && (ctl_xfer_index_int[7] == 1'b0)) begin
+				data_types_out[ctl_xfer_index_int[3:0]] <= 1'b0;
+			end
+		end else if ((state == STATE_BULK_OUT_ACK) && (tx_trn_hsk_sended == 1'b1) && (blk_out_accept == 1'b1)) begin
+			data_types_out[current_endpoint] <= ~data_types_out[current_endpoint];
+		end
+	end
+end
+
 /* FSM */
 always @(posedge clk) begin
 	if (rst == 1'b1) begin